@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Append-only storage of value-initialized objects addressed by 32-bit indices. Objects never move, so
+// they may be used by other threads while more are allocated, as long as the index was handed over with
+// proper synchronization. Memory grows in chunks of doubling size and is freed all at once.
+template <typename T>
+class Arena {
+public:
+    using Index = uint32_t;
+
+    Index Allocate() {
+        std::lock_guard lock(mutex_);
+        assert(size_ <= std::numeric_limits<Index>::max());
+        const auto index = static_cast<Index>(size_++);
+        auto& chunk = chunks_[Locate(index).first];
+        if (chunk == nullptr) {
+            chunk = std::make_unique<T[]>(kFirstChunkSize << Locate(index).first);
+        }
+        return index;
+    }
+
+    T& operator[](Index index) {
+        const auto [chunk, offset] = Locate(index);
+        return chunks_[chunk][offset];
+    }
+
+    const T& operator[](Index index) const {
+        const auto [chunk, offset] = Locate(index);
+        return chunks_[chunk][offset];
+    }
+
+    [[nodiscard]] size_t Size() const {
+        std::lock_guard lock(mutex_);
+        return size_;
+    }
+
+private:
+    static constexpr size_t kFirstChunkSize = 256;
+    // chunk k holds kFirstChunkSize * 2^k objects, so 25 chunks cover every 32-bit index
+    static constexpr size_t kChunkCount = 25;
+
+    static std::pair<size_t, size_t> Locate(size_t index) {
+        const size_t chunk = 63 - __builtin_clzll(index / kFirstChunkSize + 1);
+        return {chunk, index - kFirstChunkSize * ((size_t{1} << chunk) - 1)};
+    }
+
+    mutable std::mutex mutex_;
+    size_t size_ = 0;
+    std::array<std::unique_ptr<T[]>, kChunkCount> chunks_;
+};
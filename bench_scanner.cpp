@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include "file_filter.h"
+#include "hash.h"
+#include "reader.h"
+#include "scanner.h"
+#include "thread_pool.h"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// Benchmarks the stages of a scan on synthetic corpora and prints the results as one JSON object, so runs
+// of different commits can be compared. The corpora depend only on the seed and the scale and are reused
+// between runs while they match. Reads are measured with a warm page cache.
+
+struct Measurement {
+    std::string stage;
+    std::string name;
+    uintmax_t bytes = 0;
+    // hashed or read blocks, walked files, scans
+    uintmax_t operations = 0;
+    double seconds = 0;
+};
+
+class CorpusGenerator {
+public:
+    CorpusGenerator(fs::path root, uint64_t seed, double scale)
+            : root_(std::move(root))
+            , random_(seed)
+            , scale_(scale) {
+    }
+
+    // Many small files in a few directories, a third of them are copies of the others.
+    void GenerateSmallFiles() {
+        const size_t file_count = Scale(20000);
+        std::vector<std::string> contents;
+        for (size_t i = 0; i < file_count; ++i) {
+            const fs::path path = root_ / "small_files" / std::to_string(i % 16) / std::to_string(i);
+            if (!contents.empty() && Random(3) == 0) {
+                WriteFile(path, contents[Random(contents.size())]);
+            } else {
+                contents.push_back(RandomBytes(1 + Random(4096)));
+                WriteFile(path, contents.back());
+            }
+        }
+    }
+
+    // A few huge files, two pairs of equal ones and two files of their own sizes.
+    void GenerateHugeFiles() {
+        const size_t file_size = Scale(64 << 20);
+        for (size_t i = 0; i < 4; i += 2) {
+            const auto content = RandomBytes(file_size + i);
+            WriteFile(root_ / "huge_files" / std::to_string(i), content);
+            WriteFile(root_ / "huge_files" / std::to_string(i + 1), content);
+        }
+        for (size_t i = 4; i < 6; ++i) {
+            WriteFile(root_ / "huge_files" / std::to_string(i), RandomBytes(file_size + i));
+        }
+    }
+
+    // Files of one size sharing everything but a few bytes near the end.
+    void GenerateSharedPrefixes() {
+        const size_t file_count = Scale(64);
+        const auto prefix = RandomBytes(Scale(4 << 20));
+        for (size_t i = 0; i < file_count; ++i) {
+            const auto suffix = std::to_string(1000 + i % (file_count / 2));
+            WriteFile(root_ / "shared_prefixes" / std::to_string(i), prefix + suffix);
+        }
+    }
+
+    // Every file has several hard links, some of the files are also copies of each other.
+    void GenerateHardLinks() {
+        const size_t file_count = Scale(2000);
+        for (size_t i = 0; i < file_count; ++i) {
+            const fs::path path = root_ / "hard_links" / std::to_string(i);
+            WriteFile(path, RandomBytes(1024 + i % 7));
+            for (size_t link = 0, link_count = 1 + Random(3); link < link_count; ++link) {
+                fs::create_hard_link(path, root_ / "hard_links" / (std::to_string(i) + "_" + std::to_string(link)));
+            }
+        }
+    }
+
+    // A chain of nested directories with a few files at every level.
+    void GenerateDeepTree() {
+        fs::path directory = root_ / "deep_tree";
+        const auto content = RandomBytes(2048);
+        for (size_t depth = 0, max_depth = Scale(64); depth < max_depth; ++depth) {
+            directory /= "d" + std::to_string(depth % 10);
+            for (size_t i = 0; i < 8; ++i) {
+                WriteFile(directory / std::to_string(i), i % 2 == 0 ? content : RandomBytes(2048));
+            }
+        }
+    }
+
+private:
+    size_t Scale(size_t value) const {
+        return std::max<size_t>(2, static_cast<size_t>(static_cast<double>(value) * scale_));
+    }
+
+    size_t Random(size_t bound) {
+        return std::uniform_int_distribution<size_t>(0, bound - 1)(random_);
+    }
+
+    std::string RandomBytes(size_t size) {
+        std::string result(size, 0);
+        for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+            const uint64_t value = random_();
+            std::memcpy(result.data() + i, &value, std::min(sizeof(value), size - i));
+        }
+        return result;
+    }
+
+    static void WriteFile(const fs::path& path, const std::string& content) {
+        fs::create_directories(path.parent_path());
+        fs::ofstream out{path, std::ios::binary};
+        out << content;
+    }
+
+    fs::path root_;
+    std::mt19937_64 random_;
+    double scale_;
+};
+
+static const std::vector<std::pair<std::string, void (CorpusGenerator::*)()>> kCorpora = {
+        {"small_files", &CorpusGenerator::GenerateSmallFiles},
+        {"huge_files", &CorpusGenerator::GenerateHugeFiles},
+        {"shared_prefixes", &CorpusGenerator::GenerateSharedPrefixes},
+        {"hard_links", &CorpusGenerator::GenerateHardLinks},
+        {"deep_tree", &CorpusGenerator::GenerateDeepTree},
+};
+
+// Digests and read bytes are written here, so the work is not optimized away.
+static volatile uint8_t sink = 0;
+
+// Has to be changed together with the generator, so stale corpora are not reused.
+static constexpr int kCorpusVersion = 1;
+
+void PrepareCorpora(const fs::path& root, uint64_t seed, double scale) {
+    const auto stamp = (boost::format("version %1% seed %2% scale %3%") % kCorpusVersion % seed % scale).str();
+    const fs::path stamp_path = root / "corpus_stamp";
+    if (fs::exists(stamp_path)) {
+        std::string existing_stamp;
+        std::getline(fs::ifstream{stamp_path}, existing_stamp);
+        if (existing_stamp == stamp) {
+            return;
+        }
+    }
+    fs::remove_all(root);
+    // every corpus gets its own generator, so changing one of them doesn't change the others
+    for (size_t i = 0; i < kCorpora.size(); ++i) {
+        CorpusGenerator generator(root, seed + i, scale);
+        (generator.*kCorpora[i].second)();
+    }
+    fs::ofstream{stamp_path} << stamp << "\n";
+}
+
+// Runs the benchmark repeat_count times and keeps the fastest run, which is the least disturbed one.
+template <typename Benchmark>
+Measurement Measure(std::string stage, std::string name, size_t repeat_count, Benchmark benchmark) {
+    Measurement result{std::move(stage), std::move(name), 0, 0, 0};
+    for (size_t i = 0; i < repeat_count; ++i) {
+        Measurement measurement;
+        const auto start = std::chrono::steady_clock::now();
+        benchmark(measurement);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < result.seconds) {
+            result.bytes = measurement.bytes;
+            result.operations = measurement.operations;
+            result.seconds = elapsed.count();
+        }
+    }
+    return result;
+}
+
+std::vector<FileInfo> WalkCorpus(const fs::path& directory, ThreadPool& thread_pool) {
+    return FileFilter({directory.string()}, {}, std::numeric_limits<int>::max(), 0, {".*"})
+            .FilterFileInfos(thread_pool);
+}
+
+void WriteMeasurements(std::ostream& out, uint64_t seed, double scale, size_t block_size, size_t thread_count,
+                       const std::vector<Measurement>& measurements) {
+    out << boost::format("{\"seed\":%1%,\"scale\":%2%,\"block_size\":%3%,\"threads\":%4%,\"results\":[")
+            % seed % scale % block_size % thread_count;
+    for (size_t i = 0; i < measurements.size(); ++i) {
+        const auto& measurement = measurements[i];
+        const double seconds = std::max(measurement.seconds, 1e-9);
+        out << (i > 0 ? ",\n" : "\n")
+            << boost::format("{\"stage\":\"%1%\",\"name\":\"%2%\",\"bytes\":%3%,\"operations\":%4%,\"seconds\":%5$.6f,"
+                             "\"mib_per_second\":%6$.1f,\"latency_us\":%7$.3f}")
+                % measurement.stage % measurement.name % measurement.bytes % measurement.operations
+                % measurement.seconds % (static_cast<double>(measurement.bytes) / (1 << 20) / seconds)
+                % (measurement.operations > 0 ? seconds * 1e6 / static_cast<double>(measurement.operations) : 0.0);
+    }
+    out << "\n]}" << std::endl;
+}
+
+int main(int ac, char** av) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help,h", "produce help message")
+            ("corpus-directory", po::value<std::string>()->default_value(
+                    (fs::temp_directory_path() / "bench_scanner_corpus").string()),
+                    "where the corpora are generated, they are reused while the seed and the scale match")
+            ("seed", po::value<uint64_t>()->default_value(1))
+            ("scale", po::value<double>()->default_value(1), "multiplies the file counts and sizes")
+            ("block-size,b", po::value<size_t>()->default_value(65536))
+            ("threads,t", po::value<size_t>()->default_value(1))
+            ("repeat", po::value<size_t>()->default_value(3), "runs of every benchmark, the fastest one is kept")
+            ("stages", po::value<std::vector<std::string>>()->multitoken()->default_value(
+                    {"hash", "reader", "filter", "scanner", "engine"}, "hash reader filter scanner engine"))
+            ;
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(ac, av).options(desc).run(), vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(vm);
+
+    const fs::path root = vm["corpus-directory"].as<std::string>();
+    const auto seed = vm["seed"].as<uint64_t>();
+    const auto scale = vm["scale"].as<double>();
+    const auto block_size = vm["block-size"].as<size_t>();
+    const auto thread_count = vm["threads"].as<size_t>();
+    const auto repeat_count = std::max<size_t>(1, vm["repeat"].as<size_t>());
+    const auto stages = vm["stages"].as<std::vector<std::string>>();
+    const auto has_stage = [&stages](const std::string& stage) {
+        return std::find(stages.begin(), stages.end(), stage) != stages.end();
+    };
+
+    PrepareCorpora(root, seed, scale);
+    ThreadPool thread_pool(thread_count);
+    std::vector<Measurement> measurements;
+
+    if (has_stage("hash")) {
+        std::mt19937_64 random(seed);
+        std::string data(std::max<size_t>(block_size, static_cast<size_t>(static_cast<double>(64 << 20) * scale)), 0);
+        std::generate(data.begin(), data.end(), [&random] { return static_cast<char>(random()); });
+        for (const auto& hash_algorithm : GetPossibleHashAlgorithms()) {
+            const auto hash_strategy = GetHashStrategy(hash_algorithm);
+            measurements.push_back(Measure("hash", hash_algorithm, repeat_count, [&](Measurement& measurement) {
+                for (size_t offset = 0; offset + block_size <= data.size(); offset += block_size) {
+                    sink = hash_strategy(std::string_view(data).substr(offset, block_size)).bytes[0];
+                    measurement.bytes += block_size;
+                    ++measurement.operations;
+                }
+            }));
+        }
+    }
+
+    if (has_stage("reader")) {
+        const auto file_infos = WalkCorpus(root / "huge_files", thread_pool);
+        for (const auto& read_mode : GetPossibleReadModes()) {
+            measurements.push_back(Measure("reader", read_mode, repeat_count, [&](Measurement& measurement) {
+                for (const auto& file_info : file_infos) {
+                    FileBlockReader reader(file_info.path, block_size, GetReadMode(read_mode), file_info.size);
+                    while (!reader.IsEnd()) {
+                        const auto block = reader.ReadNextBlockView();
+                        // a mapped block is only read when its pages are touched
+                        for (size_t offset = 0; offset < block.size(); offset += 4096) {
+                            sink = block[offset];
+                        }
+                        measurement.bytes += block.size();
+                        ++measurement.operations;
+                    }
+                }
+            }));
+        }
+    }
+
+    if (has_stage("filter")) {
+        for (const auto& [corpus, _] : kCorpora) {
+            measurements.push_back(Measure("filter", corpus, repeat_count, [&](Measurement& measurement) {
+                measurement.operations = WalkCorpus(root / corpus, thread_pool).size();
+            }));
+        }
+    }
+
+    if (has_stage("scanner")) {
+        for (const auto& [corpus, _] : kCorpora) {
+            uintmax_t corpus_size = 0;
+            for (const auto& file_info : WalkCorpus(root / corpus, thread_pool)) {
+                corpus_size += file_info.size;
+            }
+            measurements.push_back(Measure("scanner", corpus, repeat_count, [&](Measurement& measurement) {
+                ScannerOptions options;
+                options.thread_count = thread_count;
+                Scanner scanner{{(root / corpus).string()}, {}, std::numeric_limits<int>::max(), 1, {".*"},
+                                static_cast<int>(block_size), "md5", options};
+                scanner.FindEqualFileGroups([](FileGroup) {});
+                measurement.bytes = corpus_size;
+                measurement.operations = 1;
+            }));
+        }
+    }
+
+    if (has_stage("engine")) {
+        for (const auto& [corpus, _] : kCorpora) {
+            for (const auto& grouping_engine : GetPossibleGroupingEngines()) {
+                measurements.push_back(Measure("engine", corpus + "/" + grouping_engine, repeat_count,
+                                               [&](Measurement& measurement) {
+                    ScannerOptions options;
+                    options.thread_count = thread_count;
+                    options.grouping_engine = GetGroupingEngine(grouping_engine);
+                    Scanner scanner{{(root / corpus).string()}, {}, std::numeric_limits<int>::max(), 1, {".*"},
+                                    static_cast<int>(block_size), "md5", options};
+                    scanner.FindEqualFileGroups([&measurement](FileGroup) { ++measurement.operations; });
+                    measurement.bytes = scanner.GetScanStats().bytes_read;
+                }));
+            }
+        }
+    }
+
+    WriteMeasurements(std::cout, seed, scale, block_size, thread_count, measurements);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+static bool IsAvxStateEnabled(uint64_t mask) {
+    uint32_t eax = 0;
+    uint32_t edx = 0;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((static_cast<uint64_t>(edx) << 32 | eax) & mask) == mask;
+}
+
+static CpuFeatures DetectCpuFeatures() {
+    CpuFeatures result;
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return result;
+    }
+    result.sse42 = ecx & bit_SSE4_2;
+    const bool os_saves_ymm = (ecx & bit_OSXSAVE) && IsAvxStateEnabled(0x6);
+    const bool os_saves_zmm = (ecx & bit_OSXSAVE) && IsAvxStateEnabled(0xe6);
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return result;
+    }
+    result.avx2 = os_saves_ymm && (ebx & bit_AVX2);
+    result.avx512f = os_saves_zmm && (ebx & bit_AVX512F);
+    result.sha = ebx & bit_SHA;
+    return result;
+}
+#else
+static CpuFeatures DetectCpuFeatures() {
+    return {};
+}
+#endif
+
+const CpuFeatures& GetCpuFeatures() {
+    static const CpuFeatures kCpuFeatures = DetectCpuFeatures();
+    return kCpuFeatures;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// Instruction set extensions of the CPU we are running on, detected once with CPUID.
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool sha = false;
+};
+
+const CpuFeatures& GetCpuFeatures();
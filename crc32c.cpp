@@ -0,0 +1,135 @@
+#include "hash_kernels.h"
+#include "cpu_features.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+static constexpr uint32_t kCrc32cPolynomial = 0x82f63b78;  // reflected
+
+// Lengths of the three interleaved streams of the hardware kernel.
+static constexpr size_t kLongStreamSize = 8192;
+static constexpr size_t kShortStreamSize = 256;
+
+using Crc32cTables = std::array<std::array<uint32_t, 256>, 8>;
+
+static Crc32cTables MakeCrc32cTables() {
+    Crc32cTables tables{};
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc = n;
+        for (int i = 0; i < 8; ++i) {
+            crc = crc & 1 ? (crc >> 1) ^ kCrc32cPolynomial : crc >> 1;
+        }
+        tables[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+        for (size_t k = 1; k < tables.size(); ++k) {
+            tables[k][n] = (tables[k - 1][n] >> 8) ^ tables[0][tables[k - 1][n] & 0xff];
+        }
+    }
+    return tables;
+}
+
+static const Crc32cTables kCrc32cTables = MakeCrc32cTables();
+
+static uint64_t LoadUint64(const uint8_t* data) {
+    uint64_t result;
+    std::memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+// Multiplies two polynomials modulo the CRC polynomial, x^0 is the highest bit.
+static uint32_t MultiplyModulo(uint32_t lhs, uint32_t rhs) {
+    uint32_t result = 0;
+    for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1) {
+        if (lhs & mask) {
+            result ^= rhs;
+        }
+        rhs = rhs & 1 ? (rhs >> 1) ^ kCrc32cPolynomial : rhs >> 1;
+    }
+    return result;
+}
+
+// x^(8 * size) modulo the CRC polynomial: multiplying a CRC by it appends size zero bytes.
+static uint32_t GetZeroBytesOperator(size_t size) {
+    uint32_t result = 1u << 31;
+    uint32_t power = 1u << 30;
+    for (uint64_t exponent = 8 * static_cast<uint64_t>(size); exponent != 0; exponent >>= 1) {
+        if (exponent & 1) {
+            result = MultiplyModulo(power, result);
+        }
+        power = MultiplyModulo(power, power);
+    }
+    return result;
+}
+
+static const uint32_t kLongStreamOperator = GetZeroBytesOperator(kLongStreamSize);
+static const uint32_t kShortStreamOperator = GetZeroBytesOperator(kShortStreamSize);
+
+uint32_t Crc32cScalar(uint32_t crc, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    const auto& tables = kCrc32cTables;
+    crc = ~crc;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; size >= 8; bytes += 8, size -= 8) {
+        const uint64_t word = LoadUint64(bytes) ^ crc;
+        crc = tables[7][word & 0xff] ^ tables[6][(word >> 8) & 0xff] ^
+              tables[5][(word >> 16) & 0xff] ^ tables[4][(word >> 24) & 0xff] ^
+              tables[3][(word >> 32) & 0xff] ^ tables[2][(word >> 40) & 0xff] ^
+              tables[1][(word >> 48) & 0xff] ^ tables[0][word >> 56];
+    }
+#endif
+    for (; size > 0; ++bytes, --size) {
+        crc = tables[0][(crc ^ *bytes) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+// Runs three independent crc32 instruction chains to hide their latency, then merges them.
+__attribute__((target("sse4.2")))
+static uint64_t Crc32cSse42Streams(uint64_t crc, const uint8_t*& bytes, size_t& size,
+                                   size_t stream_size, uint32_t stream_operator) {
+    for (; size >= 3 * stream_size; bytes += 3 * stream_size, size -= 3 * stream_size) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t i = 0; i < stream_size; i += 8) {
+            crc = _mm_crc32_u64(crc, LoadUint64(bytes + i));
+            crc1 = _mm_crc32_u64(crc1, LoadUint64(bytes + stream_size + i));
+            crc2 = _mm_crc32_u64(crc2, LoadUint64(bytes + 2 * stream_size + i));
+        }
+        crc = MultiplyModulo(stream_operator, static_cast<uint32_t>(crc)) ^ crc1;
+        crc = MultiplyModulo(stream_operator, static_cast<uint32_t>(crc)) ^ crc2;
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t Crc32cSse42(uint32_t crc, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    uint64_t result = ~crc;
+    for (; size > 0 && reinterpret_cast<uintptr_t>(bytes) % 8 != 0; ++bytes, --size) {
+        result = _mm_crc32_u8(static_cast<uint32_t>(result), *bytes);
+    }
+    result = Crc32cSse42Streams(result, bytes, size, kLongStreamSize, kLongStreamOperator);
+    result = Crc32cSse42Streams(result, bytes, size, kShortStreamSize, kShortStreamOperator);
+    for (; size >= 8; bytes += 8, size -= 8) {
+        result = _mm_crc32_u64(result, LoadUint64(bytes));
+    }
+    for (; size > 0; ++bytes, --size) {
+        result = _mm_crc32_u8(static_cast<uint32_t>(result), *bytes);
+    }
+    return ~static_cast<uint32_t>(result);
+}
+#else
+uint32_t Crc32cSse42(uint32_t crc, const void* data, size_t size) {
+    return Crc32cScalar(crc, data, size);
+}
+#endif
+
+uint32_t Crc32c(uint32_t crc, const void* data, size_t size) {
+    static const auto kernel = GetCpuFeatures().sse42 ? Crc32cSse42 : Crc32cScalar;
+    return kernel(crc, data, size);
+}
@@ -0,0 +1,322 @@
+#include "external_sort.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// A run is a sequence of records, all numbers in host byte order.
+// record: size, device, inode, mtime, key size, path size, key, path
+static constexpr size_t kRecordHeaderSize = 8 * 4 + 4 + 4;
+// Bytes buffered by every run writer and reader.
+static constexpr size_t kRunBufferSize = 64 << 10;
+// Runs merged at once, more runs are merged in several passes so that few files are open at a time.
+static constexpr size_t kMaxMergeWidth = 64;
+
+[[noreturn]] static void ThrowSystemError(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error(what, path, boost::system::error_code(errno, boost::system::system_category()));
+}
+
+template <typename T>
+static void AppendValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool ReadValue(std::string_view& in, T& value) {
+    if (in.size() < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+bool operator<(const SpillRecord& lhs, const SpillRecord& rhs) {
+    return std::tie(lhs.file_info.size, lhs.key, lhs.file_info.device, lhs.file_info.inode, lhs.file_info.path)
+           < std::tie(rhs.file_info.size, rhs.key, rhs.file_info.device, rhs.file_info.inode, rhs.file_info.path);
+}
+
+// Memory taken by a buffered record, roughly.
+static size_t GetRecordMemory(const SpillRecord& record) {
+    return sizeof(SpillRecord) + record.key.capacity() + record.file_info.path.native().capacity();
+}
+
+class RunWriter {
+public:
+    explicit RunWriter(fs::path path) : path_(std::move(path)) {
+        fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd_ == -1) {
+            ThrowSystemError("open", path_);
+        }
+    }
+
+    ~RunWriter() {
+        close(fd_);
+    }
+
+    RunWriter(const RunWriter&) = delete;
+    RunWriter& operator=(const RunWriter&) = delete;
+
+    void Write(const SpillRecord& record) {
+        const auto& path = record.file_info.path.native();
+        AppendValue<uint64_t>(buffer_, record.file_info.size);
+        AppendValue<uint64_t>(buffer_, record.file_info.device);
+        AppendValue<uint64_t>(buffer_, record.file_info.inode);
+        AppendValue<int64_t>(buffer_, record.file_info.mtime_ns);
+        AppendValue<uint32_t>(buffer_, record.key.size());
+        AppendValue<uint32_t>(buffer_, path.size());
+        buffer_.append(record.key);
+        buffer_.append(path);
+        if (buffer_.size() >= kRunBufferSize) {
+            Flush();
+        }
+    }
+
+    // The run is only complete after the last flush.
+    void Flush() {
+        std::string_view data = buffer_;
+        while (!data.empty()) {
+            const ssize_t result = write(fd_, data.data(), data.size());
+            if (result == -1 && errno == EINTR) {
+                continue;
+            }
+            if (result == -1) {
+                ThrowSystemError("write", path_);
+            }
+            data.remove_prefix(result);
+        }
+        buffer_.clear();
+    }
+
+private:
+    fs::path path_;
+    int fd_;
+    std::string buffer_;
+};
+
+class RunReader {
+public:
+    explicit RunReader(fs::path path) : path_(std::move(path)) {
+        fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ == -1) {
+            ThrowSystemError("open", path_);
+        }
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    ~RunReader() {
+        close(fd_);
+    }
+
+    RunReader(const RunReader&) = delete;
+    RunReader& operator=(const RunReader&) = delete;
+
+    // Returns nothing at the end of the run.
+    std::optional<SpillRecord> Next() {
+        if (!Fill(kRecordHeaderSize)) {
+            return std::nullopt;
+        }
+        std::string_view in(buffer_.data() + pos_, buffer_.size() - pos_);
+        SpillRecord record;
+        uint64_t size = 0;
+        uint32_t key_size = 0;
+        uint32_t path_size = 0;
+        ReadValue(in, size);
+        ReadValue(in, record.file_info.device);
+        ReadValue(in, record.file_info.inode);
+        ReadValue(in, record.file_info.mtime_ns);
+        ReadValue(in, key_size);
+        ReadValue(in, path_size);
+        record.file_info.size = size;
+        if (!Fill(kRecordHeaderSize + key_size + path_size)) {
+            errno = EIO;
+            ThrowSystemError("truncated run", path_);
+        }
+        const char* data = buffer_.data() + pos_ + kRecordHeaderSize;
+        record.key.assign(data, key_size);
+        record.file_info.path = std::string(data + key_size, path_size);
+        pos_ += kRecordHeaderSize + key_size + path_size;
+        return record;
+    }
+
+private:
+    // Makes size bytes available from pos_, returns false if the run ends before.
+    bool Fill(size_t size) {
+        if (buffer_.size() - pos_ >= size) {
+            return true;
+        }
+        buffer_.erase(0, pos_);
+        pos_ = 0;
+        while (buffer_.size() < size) {
+            const size_t old_size = buffer_.size();
+            buffer_.resize(old_size + std::max(size - old_size, kRunBufferSize));
+            const ssize_t result = read(fd_, buffer_.data() + old_size, buffer_.size() - old_size);
+            if (result == -1 && errno == EINTR) {
+                buffer_.resize(old_size);
+                continue;
+            }
+            if (result == -1) {
+                ThrowSystemError("read", path_);
+            }
+            buffer_.resize(old_size + result);
+            if (result == 0) {
+                if (!buffer_.empty() && buffer_.size() < size) {
+                    errno = EIO;
+                    ThrowSystemError("truncated run", path_);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    fs::path path_;
+    int fd_;
+    std::string buffer_;
+    size_t pos_ = 0;
+};
+
+class ExternalSorterImpl {
+public:
+    ExternalSorterImpl(fs::path directory, size_t memory_budget)
+            : directory_(std::move(directory))
+            , memory_budget_(memory_budget) {
+    }
+
+    ~ExternalSorterImpl() {
+        for (const auto& path : created_runs_) {
+            boost::system::error_code error_code;
+            fs::remove(path, error_code);
+        }
+    }
+
+    void Add(SpillRecord record) {
+        buffer_memory_ += GetRecordMemory(record);
+        buffer_.push_back(std::move(record));
+        if (buffer_memory_ >= memory_budget_) {
+            WriteRun();
+        }
+    }
+
+    void Merge(const std::function<void(SpillRecord)>& on_record) {
+        if (runs_.empty()) {
+            std::sort(buffer_.begin(), buffer_.end());
+            for (auto& record : buffer_) {
+                on_record(std::move(record));
+            }
+            ClearBuffer();
+            return;
+        }
+        if (!buffer_.empty()) {
+            WriteRun();
+        }
+        while (runs_.size() > kMaxMergeWidth) {
+            std::vector<fs::path> merged_runs;
+            for (size_t begin = 0; begin < runs_.size(); begin += kMaxMergeWidth) {
+                const size_t end = std::min(begin + kMaxMergeWidth, runs_.size());
+                std::vector<fs::path> runs(runs_.begin() + begin, runs_.begin() + end);
+                if (runs.size() == 1) {
+                    merged_runs.push_back(runs.front());
+                    continue;
+                }
+                RunWriter writer(CreateRunPath());
+                MergeRuns(runs, [&writer](SpillRecord record) { writer.Write(record); });
+                writer.Flush();
+                merged_runs.push_back(created_runs_.back());
+                RemoveRuns(runs);
+            }
+            runs_ = std::move(merged_runs);
+        }
+        MergeRuns(runs_, on_record);
+        RemoveRuns(runs_);
+        runs_.clear();
+    }
+
+    [[nodiscard]] size_t GetRunCount() const {
+        return created_runs_.size();
+    }
+
+private:
+    fs::path CreateRunPath() {
+        created_runs_.push_back(directory_ / fs::unique_path("otus7-%%%%-%%%%-%%%%-%%%%.run"));
+        return created_runs_.back();
+    }
+
+    void WriteRun() {
+        std::sort(buffer_.begin(), buffer_.end());
+        RunWriter writer(CreateRunPath());
+        for (const auto& record : buffer_) {
+            writer.Write(record);
+        }
+        writer.Flush();
+        runs_.push_back(created_runs_.back());
+        ClearBuffer();
+    }
+
+    void ClearBuffer() {
+        std::vector<SpillRecord>().swap(buffer_);
+        buffer_memory_ = 0;
+    }
+
+    // k-way merge over a heap holding the next record of every run.
+    static void MergeRuns(const std::vector<fs::path>& runs, const std::function<void(SpillRecord)>& on_record) {
+        std::deque<RunReader> readers;
+        std::vector<std::pair<SpillRecord, size_t>> heap;
+        const auto greater = [](const auto& lhs, const auto& rhs) { return rhs.first < lhs.first; };
+        for (const auto& run : runs) {
+            auto& reader = readers.emplace_back(run);
+            if (auto record = reader.Next()) {
+                heap.emplace_back(std::move(*record), readers.size() - 1);
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), greater);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            auto [record, run_index] = std::move(heap.back());
+            heap.pop_back();
+            if (auto next_record = readers[run_index].Next()) {
+                heap.emplace_back(std::move(*next_record), run_index);
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+            on_record(std::move(record));
+        }
+    }
+
+    static void RemoveRuns(const std::vector<fs::path>& runs) {
+        for (const auto& run : runs) {
+            boost::system::error_code error_code;
+            fs::remove(run, error_code);
+        }
+    }
+
+    fs::path directory_;
+    size_t memory_budget_;
+    std::vector<SpillRecord> buffer_;
+    size_t buffer_memory_ = 0;
+    // runs waiting to be merged
+    std::vector<fs::path> runs_;
+    // every run ever written, removed at the end in case of errors
+    std::vector<fs::path> created_runs_;
+};
+
+ExternalSorter::ExternalSorter(fs::path directory, size_t memory_budget)
+        : impl_(std::make_unique<ExternalSorterImpl>(std::move(directory), memory_budget)) {
+}
+
+ExternalSorter::~ExternalSorter() = default;
+
+void ExternalSorter::Add(SpillRecord record) {
+    impl_->Add(std::move(record));
+}
+
+void ExternalSorter::Merge(const std::function<void(SpillRecord)>& on_record) {
+    impl_->Merge(on_record);
+}
+
+size_t ExternalSorter::GetRunCount() const {
+    return impl_->GetRunCount();
+}
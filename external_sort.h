@@ -0,0 +1,39 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <boost/filesystem.hpp>
+#include "file_filter.h"
+
+namespace fs = boost::filesystem;
+
+class ExternalSorterImpl;
+
+// A file listed by the memory-bounded scan. Records are ordered by size, key, device, inode and path, so
+// candidate files come together and the hard links of a file are next to each other.
+struct SpillRecord {
+    FileInfo file_info;
+    // digest of the first block for the files of a size which don't fit in memory together, empty otherwise
+    std::string key;
+};
+
+bool operator<(const SpillRecord& lhs, const SpillRecord& rhs);
+
+// Sorts more records than fit in memory. Records are buffered up to memory_budget bytes, then sorted and
+// written as a run to a temporary file in the directory; the runs are merged at the end. Nothing is written
+// to the disk if all the records fit in the budget. Not thread-safe.
+class ExternalSorter {
+public:
+    ExternalSorter(fs::path directory, size_t memory_budget);
+    // Removes the runs.
+    ~ExternalSorter();
+
+    void Add(SpillRecord record);
+    // Calls on_record with every record added, in order. The sorter is empty afterwards.
+    void Merge(const std::function<void(SpillRecord)>& on_record);
+    // Runs written so far, merge passes included.
+    [[nodiscard]] size_t GetRunCount() const;
+
+private:
+    std::unique_ptr<ExternalSorterImpl> impl_;
+};
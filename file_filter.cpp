@@ -1,6 +1,18 @@
 #include "file_filter.h"
-#include <boost/regex.hpp>
+#include "file_mask.h"
+#include "thread_pool.h"
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
 
 std::set<fs::path> ConvertStringsToPaths(std::vector<std::string> paths) {
     std::set<fs::path> result{};
@@ -10,13 +22,53 @@ std::set<fs::path> ConvertStringsToPaths(std::vector<std::string> paths) {
     return result;
 }
 
-std::vector<boost::regex> ConvertToRegex(std::vector<std::string> strings) {
-    std::vector<boost::regex> result;
-    std::transform(std::make_move_iterator(strings.begin()), std::make_move_iterator(strings.end()),
-                   std::inserter(result, result.end()), [](std::string str) { return boost::regex{std::move(str)}; });
-    return result;
+
+[[noreturn]] static void ThrowSystemError(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error(what, path, boost::system::error_code(errno, boost::system::system_category()));
 }
 
+// Bytes of directory entries fetched by one getdents64 call.
+static constexpr size_t kDirectoryBufferSize = 64 * 1024;
+
+using FileId = std::pair<dev_t, ino_t>;
+
+class Descriptor {
+public:
+    explicit Descriptor(int fd) : fd_(fd) {
+    }
+
+    ~Descriptor() {
+        if (fd_ != -1) {
+            close(fd_);
+        }
+    }
+
+    Descriptor(const Descriptor&) = delete;
+    Descriptor& operator=(const Descriptor&) = delete;
+
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+uint64_t GetPhysicalOffset(const FileInfo& file_info) {
+    const Descriptor fd(open(file_info.path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.Get() != -1) {
+        alignas(fiemap) char buffer[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+        auto* map = reinterpret_cast<fiemap*>(buffer);
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+        if (ioctl(fd.Get(), FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents == 1
+                && (map->fm_extents[0].fe_flags & FIEMAP_EXTENT_UNKNOWN) == 0) {
+            return map->fm_extents[0].fe_physical;
+        }
+    }
+    // inodes are mostly allocated close to their data, and the order is only a hint anyway
+    return file_info.inode;
+}
 
 class FileFilterImpl {
 public:
@@ -27,64 +79,254 @@ public:
             size_t min_file_size,
             std::vector<std::string> file_masks)
             : include_directories_(ConvertStringsToPaths(std::move(include_directories)))
-            , exclude_directories_(ConvertStringsToPaths(std::move(exclude_directories)))
+            , exclude_directories_(GetDirectoryIds(ConvertStringsToPaths(std::move(exclude_directories))))
             , scan_level_(scan_level)
             , min_file_size_(min_file_size)
-            , file_masks_(ConvertToRegex(std::move(file_masks))) {
+            , file_masks_(file_masks) {
         CheckDirectories(include_directories_);
-        CheckDirectories(exclude_directories_);
     }
 
-    [[nodiscard]] std::set<fs::path> FilterFiles() const {
-        std::set<fs::path> result{};
-        for (const auto& directory : include_directories_) {
-            result.merge(FilterFiles(directory, scan_level_));
-        }
+    [[nodiscard]] std::vector<FileInfo> FilterFileInfos(ThreadPool& thread_pool) const {
+        std::vector<FileInfo> result;
+        ListFiles(thread_pool, [&result](std::vector<FileInfo>& files) {
+            std::move(files.begin(), files.end(), std::back_inserter(result));
+        });
+
+        // a file may be reached through several include directories or symlinks
+        std::sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) { return lhs.path < rhs.path; });
+        result.erase(std::unique(result.begin(), result.end(),
+                                 [](const auto& lhs, const auto& rhs) { return lhs.path == rhs.path; }),
+                     result.end());
         return result;
     }
 
+    void FilterFileInfos(ThreadPool& thread_pool, const std::function<void(FileInfo)>& on_file) const {
+        ListFiles(thread_pool, [&on_file](std::vector<FileInfo>& files) {
+            for (auto& file_info : files) {
+                on_file(std::move(file_info));
+            }
+        });
+    }
+
+    [[nodiscard]] std::optional<FileInfo> CheckFile(const fs::path& path) const {
+        if (!MatchesFileMasks(path.filename().native())) {
+            return std::nullopt;
+        }
+        const auto is_listed_under = [this, &path](const fs::path& directory) {
+            const auto [directory_end, name] = std::mismatch(directory.begin(), directory.end(), path.begin(),
+                                                             path.end());
+            if (directory_end != directory.end() || name == path.end()) {
+                return false;
+            }
+            // directories between the include directory and the file
+            const auto depth = std::distance(name, path.end()) - 1;
+            return depth <= scan_level_ && !IsInExcludedDirectory(directory, path);
+        };
+        if (std::none_of(include_directories_.begin(), include_directories_.end(), is_listed_under)) {
+            return std::nullopt;
+        }
+        struct statx statx_buffer{};
+        if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC | AT_SYMLINK_NOFOLLOW,
+                  STATX_TYPE | STATX_SIZE | STATX_INO | STATX_MTIME, &statx_buffer) == -1) {
+            if (errno == ENOENT || errno == ENOTDIR) {
+                return std::nullopt;
+            }
+            ThrowSystemError("statx", path);
+        }
+        if (!S_ISREG(statx_buffer.stx_mode) || statx_buffer.stx_size < min_file_size_) {
+            return std::nullopt;
+        }
+        return MakeFileInfo(statx_buffer, path);
+    }
+
 private:
-    void CheckDirectories(const std::set<fs::path>& directories) const {
+    using FilesCallback = std::function<void(std::vector<FileInfo>&)>;
+
+    // on_files gets the files of one directory at a time, it is called by one thread at a time.
+    void ListFiles(ThreadPool& thread_pool, const FilesCallback& on_files) const {
+        std::mutex on_files_mutex;
+        const FilesCallback on_files_locked = [&on_files, &on_files_mutex](std::vector<FileInfo>& files) {
+            std::lock_guard lock(on_files_mutex);
+            on_files(files);
+        };
+        TaskGroup task_group(thread_pool);
+        for (const auto& directory : include_directories_) {
+            task_group.Run([this, &directory, &task_group, &on_files_locked] {
+                WalkDirectory(directory, scan_level_, false, task_group, on_files_locked);
+            });
+        }
+        task_group.Wait();
+    }
+
+    static void CheckDirectories(const std::set<fs::path>& directories) {
         for (const auto& directory : directories) {
             assert(fs::exists(directory));
             assert(fs::is_directory(directory));
         }
     }
 
-    [[nodiscard]] std::set<fs::path> FilterFiles(const fs::path& directory, int scan_level) const {
-        assert(fs::is_directory(directory));
-        if (scan_level < 0) {
-            return {};
-        }
-        std::set<fs::path> result;
-        for (fs::path path : fs::directory_iterator(directory)) {
-            path = fs::canonical(path);
-            assert(path.is_absolute());
-            if (fs::is_directory(path) && !exclude_directories_.count(path)) {
-                result.merge(FilterFiles(path, scan_level - 1));
-            }
-            if (fs::is_regular_file(path) && CheckFile(path)) {
-                result.insert(path);
+    static std::set<FileId> GetDirectoryIds(const std::set<fs::path>& directories) {
+        CheckDirectories(directories);
+        std::set<FileId> result;
+        for (const auto& directory : directories) {
+            struct stat stat_buffer{};
+            if (stat(directory.c_str(), &stat_buffer) == -1) {
+                ThrowSystemError("stat", directory);
             }
+            result.emplace(stat_buffer.st_dev, stat_buffer.st_ino);
         }
         return result;
     }
 
-    [[nodiscard]] bool CheckFile(const fs::path& file) const {
-        assert(fs::is_regular_file(file));
-        for (const auto& file_mask : file_masks_) {
-            if (boost::regex_match(file.filename().string(), file_mask) && fs::file_size(file) >= min_file_size_) {
+    // The directories between the include directory and the file are checked, as the walk checks them.
+    bool IsInExcludedDirectory(const fs::path& include_directory, const fs::path& path) const {
+        if (exclude_directories_.empty()) {
+            return false;
+        }
+        for (auto directory = path.parent_path(); directory != include_directory && directory.has_relative_path();
+             directory = directory.parent_path()) {
+            struct stat stat_buffer{};
+            if (stat(directory.c_str(), &stat_buffer) == 0
+                    && exclude_directories_.count({stat_buffer.st_dev, stat_buffer.st_ino})) {
                 return true;
             }
         }
         return false;
     }
 
+    // Lists the directory with getdents64, relying on d_type instead of stat calls. Only the files
+    // matching the masks are stat'ed, every subdirectory is walked by its own task.
+    void WalkDirectory(const fs::path& directory, int scan_level, bool check_exclusion, TaskGroup& task_group,
+                       const FilesCallback& on_files) const {
+        if (scan_level < 0) {
+            return;
+        }
+        const Descriptor fd(open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (fd.Get() == -1) {
+            ThrowSystemError("open", directory);
+        }
+        if (check_exclusion) {
+            struct stat stat_buffer{};
+            if (fstat(fd.Get(), &stat_buffer) == -1) {
+                ThrowSystemError("fstat", directory);
+            }
+            if (exclude_directories_.count({stat_buffer.st_dev, stat_buffer.st_ino})) {
+                return;
+            }
+        }
+
+        std::vector<FileInfo> files;
+        std::vector<fs::path> subdirectories;
+        std::vector<char> buffer(kDirectoryBufferSize);
+        while (true) {
+            const long read_size = syscall(SYS_getdents64, fd.Get(), buffer.data(), buffer.size());
+            if (read_size == -1) {
+                ThrowSystemError("getdents64", directory);
+            }
+            if (read_size == 0) {
+                break;
+            }
+            for (long offset = 0; offset < read_size;) {
+                const auto* entry = reinterpret_cast<const dirent64*>(buffer.data() + offset);
+                offset += entry->d_reclen;
+                const std::string_view name = entry->d_name;
+                if (name == "." || name == "..") {
+                    continue;
+                }
+                switch (GetEntryType(fd.Get(), *entry, directory)) {
+                    case DT_DIR:
+                        if (scan_level > 0) {
+                            subdirectories.push_back(directory / entry->d_name);
+                        }
+                        break;
+                    case DT_REG:
+                        if (MatchesFileMasks(entry->d_name)) {
+                            auto file_info = GetFileInfo(fd.Get(), entry->d_name, directory / entry->d_name);
+                            if (file_info.size >= min_file_size_) {
+                                files.push_back(std::move(file_info));
+                            }
+                        }
+                        break;
+                    case DT_LNK:
+                        AddSymlink(directory / entry->d_name, scan_level, files, subdirectories);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        for (auto& subdirectory : subdirectories) {
+            task_group.Run([this, subdirectory = std::move(subdirectory), scan_level, &task_group, &on_files] {
+                WalkDirectory(subdirectory, scan_level - 1, true, task_group, on_files);
+            });
+        }
+        if (!files.empty()) {
+            on_files(files);
+        }
+    }
+
+    // Some file systems don't fill d_type.
+    static unsigned char GetEntryType(int directory_fd, const dirent64& entry, const fs::path& directory) {
+        if (entry.d_type != DT_UNKNOWN) {
+            return entry.d_type;
+        }
+        struct stat stat_buffer{};
+        if (fstatat(directory_fd, entry.d_name, &stat_buffer, AT_SYMLINK_NOFOLLOW) == -1) {
+            ThrowSystemError("fstatat", directory / entry.d_name);
+        }
+        return IFTODT(stat_buffer.st_mode);
+    }
+
+    // name is resolved relative to directory_fd, path is what the file is reported as.
+    static FileInfo GetFileInfo(int directory_fd, const char* name, fs::path path) {
+        struct statx statx_buffer{};
+        if (statx(directory_fd, name, AT_STATX_DONT_SYNC, STATX_SIZE | STATX_INO | STATX_MTIME, &statx_buffer) == -1) {
+            ThrowSystemError("statx", path);
+        }
+        return MakeFileInfo(statx_buffer, std::move(path));
+    }
+
+    static FileInfo MakeFileInfo(const struct statx& statx_buffer, fs::path path) {
+        FileInfo file_info{std::move(path), statx_buffer.stx_size};
+        file_info.device = makedev(statx_buffer.stx_dev_major, statx_buffer.stx_dev_minor);
+        file_info.inode = statx_buffer.stx_ino;
+        file_info.mtime_ns = statx_buffer.stx_mtime.tv_sec * 1'000'000'000LL + statx_buffer.stx_mtime.tv_nsec;
+        return file_info;
+    }
+
+    // Symlinks are rare, so they are resolved the slow way: the target is reported under its canonical path.
+    void AddSymlink(const fs::path& symlink, int scan_level, std::vector<FileInfo>& files,
+                    std::vector<fs::path>& subdirectories) const {
+        boost::system::error_code error_code;
+        const auto path = fs::canonical(symlink, error_code);
+        if (error_code) {
+            // dangling symlink
+            return;
+        }
+        const auto status = fs::status(path);
+        if (fs::is_directory(status)) {
+            if (scan_level > 0) {
+                subdirectories.push_back(path);
+            }
+        } else if (fs::is_regular_file(status) && MatchesFileMasks(path.filename().string())) {
+            auto file_info = GetFileInfo(AT_FDCWD, path.c_str(), path);
+            if (file_info.size >= min_file_size_) {
+                files.push_back(std::move(file_info));
+            }
+        }
+    }
+
+    [[nodiscard]] bool MatchesFileMasks(std::string_view file_name) const {
+        return file_masks_.Matches(file_name);
+    }
+
     std::set<fs::path> include_directories_;
-    std::set<fs::path> exclude_directories_;
+    // (device, inode) of the excluded directories, so they are recognized under any path
+    std::set<FileId> exclude_directories_;
     int scan_level_;
     size_t min_file_size_;
-    std::vector<boost::regex> file_masks_;
+    FileMaskMatcher file_masks_;
 };
 
 FileFilter::FileFilter(
@@ -104,5 +346,26 @@ FileFilter::FileFilter(
 FileFilter::~FileFilter() = default;
 
 std::set<fs::path> FileFilter::FilterFiles() const {
-    return impl_->FilterFiles();
+    std::set<fs::path> result;
+    for (auto& file_info : FilterFileInfos()) {
+        result.insert(result.end(), std::move(file_info.path));
+    }
+    return result;
+}
+
+std::vector<FileInfo> FileFilter::FilterFileInfos() const {
+    ThreadPool thread_pool(1);
+    return impl_->FilterFileInfos(thread_pool);
+}
+
+std::vector<FileInfo> FileFilter::FilterFileInfos(ThreadPool& thread_pool) const {
+    return impl_->FilterFileInfos(thread_pool);
+}
+
+void FileFilter::FilterFileInfos(ThreadPool& thread_pool, const std::function<void(FileInfo)>& on_file) const {
+    impl_->FilterFileInfos(thread_pool, on_file);
+}
+
+std::optional<FileInfo> FileFilter::CheckFile(const fs::path& path) const {
+    return impl_->CheckFile(path);
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include <functional>
+#include <optional>
 #include <vector>
 #include <string>
 #include <boost/filesystem.hpp>
@@ -7,6 +9,20 @@
 namespace fs = boost::filesystem;
 
 class FileFilterImpl;
+class ThreadPool;
+
+struct FileInfo {
+    fs::path path;
+    uintmax_t size;
+    // identity and version of the file contents
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t mtime_ns = 0;
+};
+
+// Position of the first block of the file on its device, taken from FIEMAP. Falls back to the inode number if
+// the file system doesn't map extents, the file is empty or can't be opened.
+uint64_t GetPhysicalOffset(const FileInfo& file_info);
 
 class FileFilter {
 public:
@@ -19,6 +35,16 @@ public:
     ~FileFilter();
 
     [[nodiscard]] std::set<fs::path> FilterFiles() const;
+    // Same files as FilterFiles(), ordered by path, with the sizes seen during the directory walk.
+    [[nodiscard]] std::vector<FileInfo> FilterFileInfos() const;
+    // Subdirectories are walked in parallel on the pool.
+    [[nodiscard]] std::vector<FileInfo> FilterFileInfos(ThreadPool& thread_pool) const;
+    // Streams the files as they are found, in no particular order: a file reached through several include
+    // directories or symlinks comes several times. on_file is called by one thread at a time.
+    void FilterFileInfos(ThreadPool& thread_pool, const std::function<void(FileInfo)>& on_file) const;
+    // Info of the file if a scan would list it under this absolute canonical path, nothing otherwise or if
+    // it's gone. Symlinks are not followed, the scan lists their targets under the targets' own paths.
+    [[nodiscard]] std::optional<FileInfo> CheckFile(const fs::path& path) const;
 
 private:
     std::unique_ptr<FileFilterImpl> impl_;
@@ -0,0 +1,705 @@
+#include "file_mask.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <optional>
+#include <unordered_set>
+#include <boost/regex.hpp>
+
+using ByteSet = std::bitset<256>;
+
+static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+// Counted repetitions are unrolled into the automaton, longer ones are left to boost::regex.
+static constexpr size_t kMaxRepeatCount = 64;
+// Masks blowing the DFA up past this are matched by simulating the NFA instead.
+static constexpr size_t kMaxDfaStates = 4096;
+
+// Thrown for the syntax the automaton can't express, such masks are matched by boost::regex.
+struct UnsupportedMask {};
+
+// Parsed mask: a set of bytes or a combination of the child nodes.
+struct MaskNode {
+    enum class Kind {
+        kEmpty,
+        kBytes,
+        kConcatenation,
+        kAlternation,
+        kRepetition,
+    };
+
+    Kind kind = Kind::kEmpty;
+    ByteSet bytes;
+    std::vector<MaskNode> children;
+    // kRepetition of the only child
+    size_t min = 0;
+    size_t max = 0;
+};
+
+static MaskNode MakeBytes(const ByteSet& bytes) {
+    MaskNode node;
+    node.kind = MaskNode::Kind::kBytes;
+    node.bytes = bytes;
+    return node;
+}
+
+static MaskNode MakeByte(char c) {
+    ByteSet bytes;
+    bytes.set(static_cast<unsigned char>(c));
+    return MakeBytes(bytes);
+}
+
+static MaskNode MakeAnyByte() {
+    return MakeBytes(ByteSet().set());
+}
+
+static MaskNode MakeNode(MaskNode::Kind kind, std::vector<MaskNode> children) {
+    if (children.size() == 1) {
+        return std::move(children.front());
+    }
+    MaskNode node;
+    node.kind = children.empty() ? MaskNode::Kind::kEmpty : kind;
+    node.children = std::move(children);
+    return node;
+}
+
+static MaskNode MakeRepetition(MaskNode child, size_t min, size_t max) {
+    MaskNode node;
+    node.kind = MaskNode::Kind::kRepetition;
+    node.children.push_back(std::move(child));
+    node.min = min;
+    node.max = max;
+    return node;
+}
+
+static ByteSet MakeByteRange(unsigned char low, unsigned char high) {
+    ByteSet bytes;
+    for (unsigned c = low; c <= high; ++c) {
+        bytes.set(c);
+    }
+    return bytes;
+}
+
+// Parses the part of the Perl syntax of boost::regex which describes a finite automaton. The mask has to
+// match the whole name, so the result is exact: what boost::regex_match would accept.
+class RegexParser {
+public:
+    explicit RegexParser(std::string_view pattern) : pattern_(pattern) {
+    }
+
+    MaskNode Parse() {
+        auto result = ParseAlternation();
+        if (pos_ != pattern_.size()) {
+            throw UnsupportedMask{};
+        }
+        return result;
+    }
+
+private:
+    MaskNode ParseAlternation() {
+        std::vector<MaskNode> alternatives{ParseConcatenation()};
+        while (Consume('|')) {
+            alternatives.push_back(ParseConcatenation());
+        }
+        return MakeNode(MaskNode::Kind::kAlternation, std::move(alternatives));
+    }
+
+    MaskNode ParseConcatenation() {
+        std::vector<MaskNode> items;
+        while (pos_ < pattern_.size() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+            items.push_back(ParseRepetition());
+        }
+        return MakeNode(MaskNode::Kind::kConcatenation, std::move(items));
+    }
+
+    MaskNode ParseRepetition() {
+        auto atom = ParseAtom();
+        size_t min = 0;
+        size_t max = kUnbounded;
+        if (Consume('*')) {
+        } else if (Consume('+')) {
+            min = 1;
+        } else if (Consume('?')) {
+            max = 1;
+        } else if (Consume('{')) {
+            ParseCount(min, max);
+        } else {
+            return atom;
+        }
+        // lazy quantifiers accept the same whole names, possessive and nested ones are left to boost
+        Consume('?');
+        if (pos_ < pattern_.size() && std::string_view("*+?{").find(pattern_[pos_]) != std::string_view::npos) {
+            throw UnsupportedMask{};
+        }
+        return MakeRepetition(std::move(atom), min, max);
+    }
+
+    void ParseCount(size_t& min, size_t& max) {
+        min = ParseNumber();
+        max = min;
+        if (Consume(',')) {
+            max = pos_ < pattern_.size() && pattern_[pos_] == '}' ? kUnbounded : ParseNumber();
+        }
+        if (!Consume('}') || min > max || min > kMaxRepeatCount || (max != kUnbounded && max > kMaxRepeatCount)) {
+            throw UnsupportedMask{};
+        }
+    }
+
+    size_t ParseNumber() {
+        size_t result = 0;
+        const size_t begin = pos_;
+        while (pos_ < pattern_.size() && std::isdigit(static_cast<unsigned char>(pattern_[pos_])) && pos_ - begin < 4) {
+            result = result * 10 + (pattern_[pos_++] - '0');
+        }
+        if (pos_ == begin) {
+            throw UnsupportedMask{};
+        }
+        return result;
+    }
+
+    MaskNode ParseAtom() {
+        const char c = pattern_[pos_++];
+        switch (c) {
+            case '.':
+                return MakeAnyByte();
+            case '(': {
+                if (Consume('?') && !Consume(':')) {
+                    throw UnsupportedMask{};
+                }
+                auto result = ParseAlternation();
+                if (!Consume(')')) {
+                    throw UnsupportedMask{};
+                }
+                return result;
+            }
+            case '[':
+                return MakeBytes(ParseClass());
+            case '\\':
+                return MakeBytes(ParseEscape());
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+            case '^':
+            case '$':
+                throw UnsupportedMask{};
+            default:
+                return MakeByte(c);
+        }
+    }
+
+    // The backslash is already consumed.
+    ByteSet ParseEscape() {
+        if (pos_ == pattern_.size()) {
+            throw UnsupportedMask{};
+        }
+        const char c = pattern_[pos_++];
+        const ByteSet digits = MakeByteRange('0', '9');
+        const ByteSet word = MakeByteRange('a', 'z') | MakeByteRange('A', 'Z') | digits | ByteSet().set('_');
+        const ByteSet space = MakeByteRange('\t', '\r') | ByteSet().set(' ');
+        switch (c) {
+            case 'd':
+                return digits;
+            case 'D':
+                return ~digits;
+            case 'w':
+                return word;
+            case 'W':
+                return ~word;
+            case 's':
+                return space;
+            case 'S':
+                return ~space;
+            case 't':
+                return ByteSet().set('\t');
+            case 'n':
+                return ByteSet().set('\n');
+            case 'r':
+                return ByteSet().set('\r');
+            case 'f':
+                return ByteSet().set('\f');
+            case 'v':
+                return ByteSet().set('\v');
+            default:
+                // escaped punctuation stands for itself, escaped letters and digits have special meanings
+                if (std::ispunct(static_cast<unsigned char>(c))) {
+                    return ByteSet().set(static_cast<unsigned char>(c));
+                }
+                throw UnsupportedMask{};
+        }
+    }
+
+    // The opening bracket is already consumed.
+    ByteSet ParseClass() {
+        ByteSet result;
+        const bool negated = Consume('^');
+        for (bool first = true;; first = false) {
+            if (pos_ == pattern_.size()) {
+                throw UnsupportedMask{};
+            }
+            if (pattern_[pos_] == ']' && !first) {
+                ++pos_;
+                break;
+            }
+            if (pattern_[pos_] == '[' && pos_ + 1 < pattern_.size()
+                    && std::string_view(":=.").find(pattern_[pos_ + 1]) != std::string_view::npos) {
+                // POSIX classes, collating elements and equivalence classes
+                throw UnsupportedMask{};
+            }
+            const auto low = ParseClassItem();
+            if (pos_ + 1 < pattern_.size() && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']') {
+                ++pos_;
+                const auto high = ParseClassItem();
+                // ranges of bytes past ASCII depend on the signedness of char in boost
+                if (low.count() != 1 || high.count() != 1) {
+                    throw UnsupportedMask{};
+                }
+                const auto low_byte = FirstByte(low);
+                const auto high_byte = FirstByte(high);
+                if (low_byte > high_byte || high_byte >= 0x80) {
+                    throw UnsupportedMask{};
+                }
+                result |= MakeByteRange(low_byte, high_byte);
+            } else {
+                result |= low;
+            }
+        }
+        return negated ? ~result : result;
+    }
+
+    ByteSet ParseClassItem() {
+        const char c = pattern_[pos_++];
+        if (c == '\\') {
+            return ParseEscape();
+        }
+        return ByteSet().set(static_cast<unsigned char>(c));
+    }
+
+    static unsigned char FirstByte(const ByteSet& bytes) {
+        unsigned char result = 0;
+        while (!bytes.test(result)) {
+            ++result;
+        }
+        return result;
+    }
+
+    bool Consume(char c) {
+        if (pos_ < pattern_.size() && pattern_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    std::string_view pattern_;
+    size_t pos_ = 0;
+};
+
+// An unterminated bracket is a literal, as in fnmatch.
+static std::optional<ByteSet> ParseGlobClass(std::string_view glob, size_t& pos) {
+    size_t end = pos;
+    ByteSet result;
+    const bool negated = end < glob.size() && (glob[end] == '!' || glob[end] == '^');
+    if (negated) {
+        ++end;
+    }
+    const auto read_byte = [&glob, &end]() -> std::optional<unsigned char> {
+        if (end < glob.size() && glob[end] == '\\') {
+            ++end;
+        }
+        if (end == glob.size()) {
+            return std::nullopt;
+        }
+        return static_cast<unsigned char>(glob[end++]);
+    };
+    for (bool first = true;; first = false) {
+        if (end == glob.size()) {
+            return std::nullopt;
+        }
+        if (glob[end] == ']' && !first) {
+            ++end;
+            break;
+        }
+        const auto low = read_byte();
+        if (!low) {
+            return std::nullopt;
+        }
+        if (end + 1 < glob.size() && glob[end] == '-' && glob[end + 1] != ']') {
+            ++end;
+            const auto high = read_byte();
+            if (!high) {
+                return std::nullopt;
+            }
+            if (*low <= *high) {
+                result |= MakeByteRange(*low, *high);
+            }
+        } else {
+            result.set(*low);
+        }
+    }
+    pos = end;
+    return negated ? ~result : result;
+}
+
+static MaskNode ParseGlob(std::string_view glob) {
+    std::vector<MaskNode> items;
+    for (size_t pos = 0; pos < glob.size();) {
+        const char c = glob[pos++];
+        if (c == '*') {
+            items.push_back(MakeRepetition(MakeAnyByte(), 0, kUnbounded));
+        } else if (c == '?') {
+            items.push_back(MakeAnyByte());
+        } else if (c == '[') {
+            const auto bytes = ParseGlobClass(glob, pos);
+            items.push_back(bytes ? MakeBytes(*bytes) : MakeByte(c));
+        } else if (c == '\\' && pos < glob.size()) {
+            items.push_back(MakeByte(glob[pos++]));
+        } else {
+            items.push_back(MakeByte(c));
+        }
+    }
+    return MakeNode(MaskNode::Kind::kConcatenation, std::move(items));
+}
+
+// Masks matching names by their extension: "*.txt" globs and ".*\.txt" regular expressions.
+static std::optional<std::string> GetSuffix(std::string_view pattern, bool is_glob) {
+    const std::string_view prefix = is_glob ? "*." : ".*\\.";
+    if (pattern.size() <= prefix.size() || pattern.substr(0, prefix.size()) != prefix) {
+        return std::nullopt;
+    }
+    const auto extension = pattern.substr(prefix.size());
+    const bool is_plain = std::all_of(extension.begin(), extension.end(), [is_glob](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || (is_glob && c == '.');
+    });
+    if (!is_plain) {
+        return std::nullopt;
+    }
+    return "." + std::string(extension);
+}
+
+// Thompson automaton of all the compiled masks, state 0 is the start.
+class Nfa {
+public:
+    struct State {
+        // a transition to next on these bytes, if next is set
+        ByteSet bytes;
+        int next = -1;
+        std::vector<int> epsilons;
+        bool accepting = false;
+    };
+
+    Nfa() {
+        AddState();
+    }
+
+    void AddMask(const MaskNode& node) {
+        const auto [start, end] = Emit(node);
+        states_[0].epsilons.push_back(start);
+        states_[end].accepting = true;
+    }
+
+    [[nodiscard]] bool IsEmpty() const {
+        return states_.size() == 1;
+    }
+
+    [[nodiscard]] const std::vector<State>& GetStates() const {
+        return states_;
+    }
+
+    // Sorted states reachable from the given ones by epsilon transitions, the given ones included.
+    [[nodiscard]] std::vector<int> GetClosure(std::vector<int> states) const {
+        std::vector<char> visited(states_.size());
+        std::vector<int> stack = states;
+        states.clear();
+        while (!stack.empty()) {
+            const int state = stack.back();
+            stack.pop_back();
+            if (visited[state]) {
+                continue;
+            }
+            visited[state] = true;
+            states.push_back(state);
+            stack.insert(stack.end(), states_[state].epsilons.begin(), states_[state].epsilons.end());
+        }
+        std::sort(states.begin(), states.end());
+        return states;
+    }
+
+    [[nodiscard]] std::vector<int> Move(const std::vector<int>& states, unsigned char byte) const {
+        std::vector<int> result;
+        for (const int state : states) {
+            if (states_[state].next != -1 && states_[state].bytes.test(byte)) {
+                result.push_back(states_[state].next);
+            }
+        }
+        return GetClosure(std::move(result));
+    }
+
+    [[nodiscard]] bool IsAccepting(const std::vector<int>& states) const {
+        return std::any_of(states.begin(), states.end(), [this](int state) { return states_[state].accepting; });
+    }
+
+    // Slow, but never blows up: used for the masks whose DFA would be too large.
+    [[nodiscard]] bool Matches(std::string_view name) const {
+        auto states = GetClosure({0});
+        for (const char c : name) {
+            states = Move(states, static_cast<unsigned char>(c));
+            if (states.empty()) {
+                return false;
+            }
+        }
+        return IsAccepting(states);
+    }
+
+private:
+    int AddState() {
+        states_.emplace_back();
+        return static_cast<int>(states_.size() - 1);
+    }
+
+    void AddEpsilon(int from, int to) {
+        states_[from].epsilons.push_back(to);
+    }
+
+    // Returns the start and the end state of the node.
+    std::pair<int, int> Emit(const MaskNode& node) {
+        switch (node.kind) {
+            case MaskNode::Kind::kEmpty: {
+                const int state = AddState();
+                return {state, state};
+            }
+            case MaskNode::Kind::kBytes: {
+                const int start = AddState();
+                const int end = AddState();
+                states_[start].bytes = node.bytes;
+                states_[start].next = end;
+                return {start, end};
+            }
+            case MaskNode::Kind::kConcatenation: {
+                auto [start, end] = Emit(node.children.front());
+                for (size_t i = 1; i < node.children.size(); ++i) {
+                    const auto [child_start, child_end] = Emit(node.children[i]);
+                    AddEpsilon(end, child_start);
+                    end = child_end;
+                }
+                return {start, end};
+            }
+            case MaskNode::Kind::kAlternation: {
+                const int start = AddState();
+                const int end = AddState();
+                for (const auto& child : node.children) {
+                    const auto [child_start, child_end] = Emit(child);
+                    AddEpsilon(start, child_start);
+                    AddEpsilon(child_end, end);
+                }
+                return {start, end};
+            }
+            case MaskNode::Kind::kRepetition: {
+                const int start = AddState();
+                int end = start;
+                for (size_t i = 0; i < node.min; ++i) {
+                    const auto [child_start, child_end] = Emit(node.children.front());
+                    AddEpsilon(end, child_start);
+                    end = child_end;
+                }
+                if (node.max == kUnbounded) {
+                    const auto [child_start, child_end] = Emit(node.children.front());
+                    const int out = AddState();
+                    AddEpsilon(end, child_start);
+                    AddEpsilon(end, out);
+                    AddEpsilon(child_end, child_start);
+                    AddEpsilon(child_end, out);
+                    return {start, out};
+                }
+                for (size_t i = node.min; i < node.max; ++i) {
+                    const auto [child_start, child_end] = Emit(node.children.front());
+                    const int out = AddState();
+                    AddEpsilon(end, child_start);
+                    AddEpsilon(end, out);
+                    AddEpsilon(child_end, out);
+                    end = out;
+                }
+                return {start, end};
+            }
+        }
+        assert(false);
+        return {0, 0};
+    }
+
+    std::vector<State> states_;
+};
+
+// Determinized automaton over classes of bytes which no mask tells apart.
+class Dfa {
+public:
+    // Returns nothing if the automaton would have more than max_state_count states.
+    static std::optional<Dfa> Build(const Nfa& nfa, size_t max_state_count) {
+        Dfa dfa;
+        dfa.ComputeByteClasses(nfa);
+        std::map<std::vector<int>, int> state_ids;
+        std::vector<std::vector<int>> state_sets{nfa.GetClosure({0})};
+        state_ids.emplace(state_sets.front(), 0);
+        for (size_t state = 0; state < state_sets.size(); ++state) {
+            if (state_sets.size() > max_state_count) {
+                return std::nullopt;
+            }
+            const auto nfa_states = state_sets[state];
+            dfa.accepting_.push_back(nfa.IsAccepting(nfa_states));
+            for (size_t byte_class = 0; byte_class < dfa.class_count_; ++byte_class) {
+                auto next_states = nfa.Move(nfa_states, dfa.class_bytes_[byte_class]);
+                int next_state = -1;
+                if (!next_states.empty()) {
+                    const auto [iter, inserted] = state_ids.emplace(next_states, static_cast<int>(state_sets.size()));
+                    if (inserted) {
+                        state_sets.push_back(std::move(next_states));
+                    }
+                    next_state = iter->second;
+                }
+                dfa.transitions_.push_back(next_state);
+            }
+        }
+        return dfa;
+    }
+
+    [[nodiscard]] bool Matches(std::string_view name) const {
+        int state = 0;
+        for (const char c : name) {
+            state = transitions_[state * class_count_ + byte_classes_[static_cast<unsigned char>(c)]];
+            if (state == -1) {
+                return false;
+            }
+        }
+        return accepting_[state];
+    }
+
+private:
+    // Bytes go to one class if every transition of the NFA takes either all or none of them.
+    void ComputeByteClasses(const Nfa& nfa) {
+        std::map<std::vector<bool>, size_t> classes;
+        for (unsigned byte = 0; byte < 256; ++byte) {
+            std::vector<bool> signature;
+            for (const auto& state : nfa.GetStates()) {
+                if (state.next != -1) {
+                    signature.push_back(state.bytes.test(byte));
+                }
+            }
+            const auto [iter, inserted] = classes.emplace(std::move(signature), classes.size());
+            if (inserted) {
+                class_bytes_.push_back(static_cast<unsigned char>(byte));
+            }
+            byte_classes_[byte] = static_cast<uint16_t>(iter->second);
+        }
+        class_count_ = classes.size();
+    }
+
+    std::array<uint16_t, 256> byte_classes_{};
+    // a representative byte of every class
+    std::vector<unsigned char> class_bytes_;
+    size_t class_count_ = 0;
+    // the next state by the state and the byte class, -1 if no mask can match anymore
+    std::vector<int> transitions_;
+    std::vector<bool> accepting_;
+};
+
+class FileMaskMatcherImpl {
+public:
+    explicit FileMaskMatcherImpl(const std::vector<std::string>& masks) {
+        Nfa nfa;
+        for (const auto& mask : masks) {
+            const bool is_glob = mask.rfind("glob:", 0) == 0;
+            std::string_view pattern = mask;
+            if (is_glob) {
+                pattern.remove_prefix(5);
+            } else if (mask.rfind("regex:", 0) == 0) {
+                pattern.remove_prefix(6);
+            }
+            if (pattern == (is_glob ? "*" : ".*")) {
+                matches_everything_ = true;
+            } else if (auto suffix = GetSuffix(pattern, is_glob)) {
+                suffixes_.push_back(std::move(*suffix));
+            } else if (is_glob) {
+                nfa.AddMask(ParseGlob(pattern));
+            } else {
+                try {
+                    nfa.AddMask(RegexParser(pattern).Parse());
+                } catch (const UnsupportedMask&) {
+                    fallback_masks_.emplace_back(pattern.begin(), pattern.end());
+                }
+            }
+        }
+        // the views point to the strings, which don't move anymore
+        for (const auto& suffix : suffixes_) {
+            suffix_set_.insert(suffix);
+            max_suffix_size_ = std::max(max_suffix_size_, suffix.size());
+        }
+        if (!nfa.IsEmpty()) {
+            dfa_ = Dfa::Build(nfa, kMaxDfaStates);
+            if (!dfa_) {
+                nfa_ = std::move(nfa);
+            }
+        }
+    }
+
+    [[nodiscard]] bool Matches(std::string_view file_name) const {
+        if (matches_everything_) {
+            return true;
+        }
+        if (MatchesSuffix(file_name)) {
+            return true;
+        }
+        if ((dfa_ && dfa_->Matches(file_name)) || (nfa_ && nfa_->Matches(file_name))) {
+            return true;
+        }
+        return std::any_of(fallback_masks_.begin(), fallback_masks_.end(), [file_name](const boost::regex& mask) {
+            return boost::regex_match(file_name.begin(), file_name.end(), mask);
+        });
+    }
+
+    [[nodiscard]] size_t GetFallbackMaskCount() const {
+        return fallback_masks_.size();
+    }
+
+private:
+    // Tries the tails of the name starting at its dots, shortest first.
+    [[nodiscard]] bool MatchesSuffix(std::string_view file_name) const {
+        for (size_t pos = file_name.size(); pos > 0;) {
+            pos = file_name.rfind('.', pos - 1);
+            if (pos == std::string_view::npos || file_name.size() - pos > max_suffix_size_) {
+                return false;
+            }
+            if (suffix_set_.count(file_name.substr(pos))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool matches_everything_ = false;
+    std::vector<std::string> suffixes_;
+    std::unordered_set<std::string_view> suffix_set_;
+    size_t max_suffix_size_ = 0;
+    std::optional<Dfa> dfa_;
+    std::optional<Nfa> nfa_;
+    std::vector<boost::regex> fallback_masks_;
+};
+
+FileMaskMatcher::FileMaskMatcher(const std::vector<std::string>& masks)
+        : impl_(std::make_unique<FileMaskMatcherImpl>(masks)) {
+}
+
+FileMaskMatcher::~FileMaskMatcher() = default;
+
+FileMaskMatcher::FileMaskMatcher(FileMaskMatcher&& other) noexcept = default;
+
+FileMaskMatcher& FileMaskMatcher::operator=(FileMaskMatcher&& other) noexcept = default;
+
+bool FileMaskMatcher::Matches(std::string_view file_name) const {
+    return impl_->Matches(file_name);
+}
+
+size_t FileMaskMatcher::GetFallbackMaskCount() const {
+    return impl_->GetFallbackMaskCount();
+}
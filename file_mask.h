@@ -0,0 +1,30 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class FileMaskMatcherImpl;
+
+// Matches file names against a set of masks at once. A mask is a regular expression which has to match the
+// whole name, or a shell glob if it starts with "glob:" ("*", "?", "[a-z]", "[!a-z]", "\" escapes); an
+// explicit "regex:" prefix is accepted too. The masks are compiled into one DFA which takes a single pass
+// over the name without allocating, masks like "*.txt" are looked up by their suffix in a hash set. Regular
+// expressions the DFA can't express (back references, anchors, lookarounds, ...) are matched by boost::regex.
+class FileMaskMatcher {
+public:
+    // Throws boost::regex_error if a mask is not a valid regular expression.
+    explicit FileMaskMatcher(const std::vector<std::string>& masks);
+    ~FileMaskMatcher();
+
+    FileMaskMatcher(FileMaskMatcher&& other) noexcept;
+    FileMaskMatcher& operator=(FileMaskMatcher&& other) noexcept;
+
+    [[nodiscard]] bool Matches(std::string_view file_name) const;
+
+    // Number of masks which are not compiled and are matched by boost::regex one by one.
+    [[nodiscard]] size_t GetFallbackMaskCount() const;
+
+private:
+    std::unique_ptr<FileMaskMatcherImpl> impl_;
+};
@@ -1,66 +1,173 @@
 #include "hash.h"
+#include "hash_kernels.h"
+#include "cpu_features.h"
 
-#include <boost/uuid/sha1.hpp>
 #include <boost/crc.hpp>
 #include <map>
+#include <numeric>
 #include <openssl/md5.h>
 #include <boost/functional/hash.hpp>
-#include <iomanip>
+#include <boost/endian/conversion.hpp>
 
-using boost::uuids::detail::sha1;
+// The digest words are kept in the host byte order, as boost's sha1 used to produce them.
+HashValue CalcSha1Hash(std::string_view block) {
+    const auto digest = CalcSha1(block.data(), block.size());
+    return HashValue(digest.data(), sizeof(digest));
+}
 
-HashValue GetHexHashRepresentation(const u_char* data, const size_t size) {
-    std::stringstream ss;
-    ss << std::hex;
-    for (size_t i = 0; i < size; ++i) {
-        ss << std::setw(2);
-        ss << std::setfill('0');
-        ss << static_cast<uint16_t>(data[i]);
+HashValue CalcSha256Hash(std::string_view block) {
+    auto digest = CalcSha256(block.data(), block.size());
+    for (auto& word : digest) {
+        word = boost::endian::native_to_big(word);
     }
-    return ss.str();
+    return HashValue(digest.data(), sizeof(digest));
+}
+
+HashValue CalcCrc32cHash(std::string_view block) {
+    const uint32_t checksum = boost::endian::native_to_big(Crc32c(0, block.data(), block.size()));
+    return HashValue(&checksum, sizeof(checksum));
 }
 
-HashValue CalcSha1Hash(const std::string& block) {
-    sha1 hash;
-    uint32_t digest[5]{};
-    hash.process_bytes(block.data(), block.size());
-    hash.get_digest(digest);
-    return GetHexHashRepresentation((u_char*)digest, sizeof(digest));
+// xxHash digests are stored in their canonical (big endian) form.
+HashValue CalcXxh3Hash(std::string_view block) {
+    const uint64_t hash = boost::endian::native_to_big(Xxh3_64(block.data(), block.size()));
+    return HashValue(&hash, sizeof(hash));
 }
 
-HashValue CalcHashCombine(const std::string& block) {
+HashValue CalcXxh128Hash(std::string_view block) {
+    const auto hash = Xxh3_128(block.data(), block.size());
+    const uint64_t canonical[2] = {boost::endian::native_to_big(hash.high), boost::endian::native_to_big(hash.low)};
+    return HashValue(canonical, sizeof(canonical));
+}
+
+HashValue CalcHashCombine(std::string_view block) {
     size_t hash = boost::hash_range(block.begin(), block.end());
-    return GetHexHashRepresentation((u_char*)&hash, sizeof(hash));
+    return HashValue(&hash, sizeof(hash));
 }
 
-HashValue CalcCrc32Hash(const std::string& block) {
+HashValue CalcCrc32Hash(std::string_view block) {
     boost::crc_32_type result;
     result.process_bytes(block.data(), block.size());
     const auto checksum = result.checksum();
-    return GetHexHashRepresentation((u_char*)&checksum, sizeof(checksum));
+    return HashValue(&checksum, sizeof(checksum));
 }
 
-HashValue CalcMd5Hash(const std::string& block) {
-    std::vector<u_char> data(block.begin(), block.end());
-    std::vector<u_char> result(MD5_DIGEST_LENGTH);
-    MD5(data.data(), data.size(), result.data());
-    return GetHexHashRepresentation(result.data(), result.size());
+HashValue CalcMd5Hash(std::string_view block) {
+    HashValue result;
+    result.size = MD5_DIGEST_LENGTH;
+    MD5(reinterpret_cast<const u_char*>(block.data()), block.size(), result.bytes.data());
+    return result;
 }
 
 static const std::map<std::string, HashStrategy> kHashStrategies = {
         {"crc32", CalcCrc32Hash},
+        {"crc32c", CalcCrc32cHash},
         {"hash_combine", CalcHashCombine},
         {"md5", CalcMd5Hash},
         {"sha1", CalcSha1Hash},
+        {"sha256", CalcSha256Hash},
+        {"xxh128", CalcXxh128Hash},
+        {"xxh3", CalcXxh3Hash},
 };
 
+static const std::string kAutoHashAlgorithm = "auto";
+
+template <typename State>
+using MultiBufferFunction = void (*)(const uint8_t* const* messages, size_t count, size_t size, State* digests,
+                                     MultiBufferKernel kernel);
+
+// Equal sizes are hashed together, lane by lane in the order of the blocks. A call costs as much with empty
+// lanes as with full ones, so fewer than min_lanes blocks are left to the single-buffer kernel.
+template <typename State>
+static void HashInLanes(const std::string_view* blocks, size_t count, HashValue* digests,
+                        const HashStrategy& hash_strategy, MultiBufferFunction<State> calc_multi_buffer,
+                        MultiBufferKernel kernel, size_t min_lanes) {
+    const size_t lane_count = GetLaneCount(kernel);
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [blocks](size_t lhs, size_t rhs) {
+        return blocks[lhs].size() < blocks[rhs].size();
+    });
+    std::vector<const uint8_t*> messages(lane_count);
+    std::vector<State> states(lane_count);
+    for (size_t begin = 0; begin < count;) {
+        const size_t size = blocks[order[begin]].size();
+        size_t end = begin;
+        while (end < count && end - begin < lane_count && blocks[order[end]].size() == size) {
+            ++end;
+        }
+        if (end - begin < min_lanes) {
+            for (size_t i = begin; i < end; ++i) {
+                digests[order[i]] = hash_strategy(blocks[order[i]]);
+            }
+        } else {
+            for (size_t i = begin; i < end; ++i) {
+                messages[i - begin] = reinterpret_cast<const uint8_t*>(blocks[order[i]].data());
+            }
+            calc_multi_buffer(messages.data(), end - begin, size, states.data(), kernel);
+            for (size_t i = begin; i < end; ++i) {
+                // host byte order, as the single-buffer kernels store the words
+                digests[order[i]] = HashValue(states[i - begin].data(), sizeof(State));
+            }
+        }
+        begin = end;
+    }
+}
+
+std::string ResolveHashAlgorithm(const std::string& hash_algorithm) {
+    // xxh128 outruns even SHA-NI sha256 several times over, and its 128-bit digest is as safe against
+    // accidental collisions as md5, so it wins on every CPU we dispatch for
+    return hash_algorithm == kAutoHashAlgorithm ? "xxh128" : hash_algorithm;
+}
+
 HashStrategy GetHashStrategy(const std::string& hash_algorithm) {
-    return kHashStrategies.at(hash_algorithm);
+    return kHashStrategies.at(ResolveHashAlgorithm(hash_algorithm));
+}
+
+BatchHashStrategy GetBatchHashStrategy(const std::string& hash_algorithm) {
+    const auto resolved_hash_algorithm = ResolveHashAlgorithm(hash_algorithm);
+    auto hash_strategy = GetHashStrategy(resolved_hash_algorithm);
+    const auto kernel = GetMultiBufferKernel();
+    if (kernel && resolved_hash_algorithm == "md5") {
+        return [hash_strategy, kernel](const std::string_view* blocks, size_t count, HashValue* digests) {
+            HashInLanes<Md5State>(blocks, count, digests, hash_strategy, CalcMd5MultiBuffer, *kernel, 2);
+        };
+    }
+    if (kernel && resolved_hash_algorithm == "sha1") {
+        // SHA-NI hashes a single block several times faster than a lane does
+        const size_t min_lanes = GetCpuFeatures().sha ? GetLaneCount(*kernel) / 2 : 2;
+        return [hash_strategy, kernel, min_lanes](const std::string_view* blocks, size_t count, HashValue* digests) {
+            HashInLanes<Sha1State>(blocks, count, digests, hash_strategy, CalcSha1MultiBuffer, *kernel, min_lanes);
+        };
+    }
+    return [hash_strategy](const std::string_view* blocks, size_t count, HashValue* digests) {
+        for (size_t i = 0; i < count; ++i) {
+            digests[i] = hash_strategy(blocks[i]);
+        }
+    };
+}
+
+size_t GetHashBatchSize(const std::string& hash_algorithm) {
+    const auto resolved_hash_algorithm = ResolveHashAlgorithm(hash_algorithm);
+    const auto kernel = GetMultiBufferKernel();
+    return kernel && (resolved_hash_algorithm == "md5" || resolved_hash_algorithm == "sha1")
+           ? GetLaneCount(*kernel)
+           : 1;
 }
 
 std::vector<std::string> GetPossibleHashAlgorithms() {
-    std::vector<std::string> result;
+    std::vector<std::string> result{kAutoHashAlgorithm};
     std::transform(kHashStrategies.begin(), kHashStrategies.end(), std::back_inserter(result),
             [](const auto& kv) { return kv.first; });
     return result;
 }
+
+std::string GetHexHashRepresentation(const HashValue& hash_value) {
+    static constexpr char kHexDigits[] = "0123456789abcdef";
+    std::string result(hash_value.size * 2, 0);
+    for (size_t i = 0; i < hash_value.size; ++i) {
+        result[2 * i] = kHexDigits[hash_value.bytes[i] >> 4];
+        result[2 * i + 1] = kHexDigits[hash_value.bytes[i] & 0xf];
+    }
+    return result;
+}
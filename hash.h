@@ -1,10 +1,69 @@
 #pragma once
+#include <array>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <string_view>
 #include <boost/filesystem.hpp>
 
-using HashValue = std::string;
-using HashStrategy = std::function<HashValue(std::string)>;
+// Binary digest of a block, its size depends on the hash algorithm.
+struct HashValue {
+    static constexpr size_t kMaxSize = 32;
+
+    HashValue() = default;
+    HashValue(const void* data, size_t size) : size(static_cast<uint8_t>(size)) {
+        assert(size <= kMaxSize);
+        std::memcpy(bytes.data(), data, size);
+    }
+
+    bool operator==(const HashValue& other) const {
+        return size == other.size && std::memcmp(bytes.data(), other.bytes.data(), size) == 0;
+    }
+
+    bool operator!=(const HashValue& other) const {
+        return !(*this == other);
+    }
+
+    bool operator<(const HashValue& other) const {
+        const int result = std::memcmp(bytes.data(), other.bytes.data(), std::min(size, other.size));
+        return result < 0 || (result == 0 && size < other.size);
+    }
+
+    std::array<uint8_t, kMaxSize> bytes{};
+    uint8_t size = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<HashValue>);
+
+namespace std {
+template <>
+struct hash<HashValue> {
+    size_t operator()(const HashValue& hash_value) const {
+        // digests are uniformly distributed already, their first bytes are good enough
+        size_t result = 0;
+        std::memcpy(&result, hash_value.bytes.data(), std::min<size_t>(sizeof(result), hash_value.size));
+        return result;
+    }
+};
+}
+
+using HashStrategy = std::function<HashValue(std::string_view)>;
 
 HashStrategy GetHashStrategy(const std::string& hash_algorithm);
 
+// Hashes count blocks at once, digests[i] gets the digest the hash strategy gives for blocks[i].
+using BatchHashStrategy = std::function<void(const std::string_view* blocks, size_t count, HashValue* digests)>;
+
+// Blocks of equal sizes are hashed side by side in the lanes of AVX2 or AVX-512 vectors if the algorithm
+// has a multi-buffer kernel (md5, sha1) and the CPU runs it, the other blocks one by one.
+BatchHashStrategy GetBatchHashStrategy(const std::string& hash_algorithm);
+// Blocks worth hashing in one batch: the lane count, 1 if the algorithm has no multi-buffer kernel here.
+size_t GetHashBatchSize(const std::string& hash_algorithm);
+
+// Maps "auto" to the fastest algorithm with a digest long enough to rule out accidental collisions,
+// returns other names unchanged.
+std::string ResolveHashAlgorithm(const std::string& hash_algorithm);
+
 std::vector<std::string> GetPossibleHashAlgorithms();
+
+std::string GetHexHashRepresentation(const HashValue& hash_value);
@@ -0,0 +1,302 @@
+#include "hash_cache.h"
+#include "hash_kernels.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The file is a header followed by the entries, all numbers in host byte order.
+// header: magic, version, block size, max block size, probe count, hash algorithm, generation, entry count, crc32c of the entries
+// entry: device, inode, size, mtime, generation of the last use, digests size, digests
+static constexpr char kMagic[8] = {'B', 'L', 'K', 'C', 'A', 'C', 'H', 'E'};
+static constexpr uint32_t kVersion = 3;
+static constexpr size_t kAlgorithmSize = 16;
+static constexpr size_t kHeaderSize = sizeof(kMagic) + 4 + 8 + 8 + 8 + kAlgorithmSize + 8 + 8 + 4;
+static constexpr size_t kEntryHeaderSize = 8 * 5 + 4;
+
+[[noreturn]] static void ThrowSystemError(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error(what, path, boost::system::error_code(errno, boost::system::system_category()));
+}
+
+template <typename T>
+static void AppendValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool ReadValue(std::string_view& in, T& value) {
+    if (in.size() < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+static void WriteFile(const fs::path& path, std::string_view data) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        ThrowSystemError("open", path);
+    }
+    while (!data.empty()) {
+        const ssize_t result = write(fd, data.data(), data.size());
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result == -1) {
+            close(fd);
+            ThrowSystemError("write", path);
+        }
+        data.remove_prefix(result);
+    }
+    if (fsync(fd) == -1) {
+        close(fd);
+        ThrowSystemError("fsync", path);
+    }
+    close(fd);
+}
+
+class HashCacheImpl {
+public:
+    HashCacheImpl(fs::path cache_path, size_t block_size, size_t max_block_size, size_t probe_count,
+                  std::string hash_algorithm, uintmax_t max_size)
+            : cache_path_(std::move(cache_path))
+            , block_size_(block_size)
+            , max_block_size_(max_block_size)
+            , probe_count_(probe_count)
+            , hash_algorithm_(std::move(hash_algorithm))
+            , max_size_(max_size) {
+        assert(hash_algorithm_.size() <= kAlgorithmSize);
+        if (!Load()) {
+            entries_.clear();
+            generation_ = 1;
+        }
+    }
+
+    std::string Lookup(const FileInfo& file_info) {
+        std::lock_guard lock(mutex_);
+        const auto iter = entries_.find(GetKey(file_info));
+        if (iter == entries_.end()) {
+            ++stats_.misses;
+            return {};
+        }
+        ++stats_.hits;
+        iter->second.last_used = generation_;
+        return iter->second.digests;
+    }
+
+    void Store(const FileInfo& file_info, std::string digests) {
+        std::lock_guard lock(mutex_);
+        auto& entry = entries_[GetKey(file_info)];
+        entry.last_used = generation_;
+        if (digests.size() > entry.digests.size()) {
+            entry.digests = std::move(digests);
+        }
+    }
+
+    void Erase(const FileInfo& file_info) {
+        std::lock_guard lock(mutex_);
+        entries_.erase(GetKey(file_info));
+    }
+
+    void Save() {
+        if (cache_path_.empty()) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        std::vector<std::pair<const Key*, const Entry*>> entries;
+        entries.reserve(entries_.size());
+        for (const auto& [key, entry] : entries_) {
+            entries.emplace_back(&key, &entry);
+        }
+        std::sort(entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.second->last_used > rhs.second->last_used;
+        });
+
+        std::string payload;
+        uint64_t entry_count = 0;
+        for (const auto& [key, entry] : entries) {
+            if (kHeaderSize + payload.size() + kEntryHeaderSize + entry->digests.size() > max_size_) {
+                break;
+            }
+            AppendValue(payload, key->device);
+            AppendValue(payload, key->inode);
+            AppendValue(payload, key->size);
+            AppendValue(payload, key->mtime_ns);
+            AppendValue(payload, entry->last_used);
+            AppendValue(payload, static_cast<uint32_t>(entry->digests.size()));
+            payload += entry->digests;
+            ++entry_count;
+        }
+
+        std::string data(kMagic, sizeof(kMagic));
+        AppendValue(data, kVersion);
+        AppendValue(data, static_cast<uint64_t>(block_size_));
+        AppendValue(data, static_cast<uint64_t>(max_block_size_));
+        AppendValue(data, static_cast<uint64_t>(probe_count_));
+        data += hash_algorithm_;
+        data.resize(data.size() + kAlgorithmSize - hash_algorithm_.size(), '\0');
+        AppendValue(data, generation_);
+        AppendValue(data, entry_count);
+        AppendValue(data, Crc32c(0, payload.data(), payload.size()));
+        assert(data.size() == kHeaderSize);
+        data += payload;
+
+        // a crash leaves either the old or the new cache file, never a partially written one
+        const fs::path temporary_path = cache_path_.string() + ".tmp." + std::to_string(getpid());
+        try {
+            WriteFile(temporary_path, data);
+        } catch (...) {
+            unlink(temporary_path.c_str());
+            throw;
+        }
+        if (rename(temporary_path.c_str(), cache_path_.c_str()) == -1) {
+            unlink(temporary_path.c_str());
+            ThrowSystemError("rename", cache_path_);
+        }
+        SyncParentDirectory();
+    }
+
+    HashCacheStats GetStats() const {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Key {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_ns;
+
+        bool operator==(const Key& other) const {
+            return device == other.device && inode == other.inode && size == other.size
+                    && mtime_ns == other.mtime_ns;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t seed = 0;
+            boost::hash_combine(seed, key.device);
+            boost::hash_combine(seed, key.inode);
+            boost::hash_combine(seed, key.size);
+            boost::hash_combine(seed, key.mtime_ns);
+            return seed;
+        }
+    };
+
+    struct Entry {
+        std::string digests;
+        // generation of the last scan which used the entry
+        uint64_t last_used = 0;
+    };
+
+    static Key GetKey(const FileInfo& file_info) {
+        return {file_info.device, file_info.inode, file_info.size, file_info.mtime_ns};
+    }
+
+    bool Load() {
+        if (cache_path_.empty()) {
+            return false;
+        }
+        fs::ifstream in(cache_path_, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        const std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+        std::string_view view = data;
+
+        if (view.substr(0, sizeof(kMagic)) != std::string_view(kMagic, sizeof(kMagic))) {
+            return false;
+        }
+        view.remove_prefix(sizeof(kMagic));
+        uint32_t version = 0;
+        uint64_t block_size = 0;
+        uint64_t max_block_size = 0;
+        uint64_t probe_count = 0;
+        if (!ReadValue(view, version) || version != kVersion || !ReadValue(view, block_size)
+                || block_size != block_size_ || !ReadValue(view, max_block_size) || max_block_size != max_block_size_
+                || !ReadValue(view, probe_count) || probe_count != probe_count_ || view.size() < kAlgorithmSize) {
+            return false;
+        }
+        const std::string_view algorithm = view.substr(0, kAlgorithmSize);
+        view.remove_prefix(kAlgorithmSize);
+        if (algorithm.substr(0, algorithm.find('\0')) != hash_algorithm_) {
+            return false;
+        }
+        uint64_t entry_count = 0;
+        uint32_t crc = 0;
+        if (!ReadValue(view, generation_) || !ReadValue(view, entry_count) || !ReadValue(view, crc)
+                || Crc32c(0, view.data(), view.size()) != crc) {
+            return false;
+        }
+        ++generation_;
+
+        for (uint64_t i = 0; i < entry_count; ++i) {
+            Key key{};
+            Entry entry;
+            uint32_t digests_size = 0;
+            if (!ReadValue(view, key.device) || !ReadValue(view, key.inode) || !ReadValue(view, key.size)
+                    || !ReadValue(view, key.mtime_ns) || !ReadValue(view, entry.last_used)
+                    || !ReadValue(view, digests_size) || view.size() < digests_size) {
+                return false;
+            }
+            entry.digests = view.substr(0, digests_size);
+            view.remove_prefix(digests_size);
+            entries_.emplace(key, std::move(entry));
+        }
+        return view.empty();
+    }
+
+    void SyncParentDirectory() const {
+        const auto directory = fs::absolute(cache_path_).parent_path();
+        const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd != -1) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    fs::path cache_path_;
+    size_t block_size_;
+    size_t max_block_size_;
+    size_t probe_count_;
+    std::string hash_algorithm_;
+    uintmax_t max_size_;
+    uint64_t generation_ = 1;
+    mutable std::mutex mutex_;
+    std::unordered_map<Key, Entry, KeyHash> entries_;
+    HashCacheStats stats_;
+};
+
+HashCache::HashCache(fs::path cache_path, size_t block_size, size_t max_block_size, size_t probe_count,
+                     std::string hash_algorithm, uintmax_t max_size)
+        : impl_(std::make_unique<HashCacheImpl>(std::move(cache_path), block_size, max_block_size, probe_count,
+                                                std::move(hash_algorithm), max_size)) {
+}
+
+HashCache::~HashCache() = default;
+
+std::string HashCache::Lookup(const FileInfo& file_info) {
+    return impl_->Lookup(file_info);
+}
+
+void HashCache::Store(const FileInfo& file_info, std::string digests) {
+    impl_->Store(file_info, std::move(digests));
+}
+
+void HashCache::Erase(const FileInfo& file_info) {
+    impl_->Erase(file_info);
+}
+
+void HashCache::Save() {
+    impl_->Save();
+}
+
+HashCacheStats HashCache::GetStats() const {
+    return impl_->GetStats();
+}
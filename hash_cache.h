@@ -0,0 +1,42 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <boost/filesystem.hpp>
+#include "file_filter.h"
+
+namespace fs = boost::filesystem;
+
+class HashCacheImpl;
+
+struct HashCacheStats {
+    // files some block digests of which were known
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+// Block digests of files computed by previous scans, stored in a file between runs. A file is identified
+// by (device, inode, size, mtime), so its entry is not used anymore once the file is changed. The cache
+// file is only valid for the block sizes, probes and hash algorithm it was written with.
+class HashCache {
+public:
+    // The cache starts empty if the file doesn't exist, is damaged or was written with other parameters.
+    // With an empty path the cache is only kept in memory.
+    HashCache(fs::path cache_path, size_t block_size, size_t max_block_size, size_t probe_count,
+              std::string hash_algorithm, uintmax_t max_size);
+    ~HashCache();
+
+    // Digests of the first blocks of the file concatenated, empty if nothing is known.
+    [[nodiscard]] std::string Lookup(const FileInfo& file_info);
+    // Replaces the digests of the file if more of them are known now.
+    void Store(const FileInfo& file_info, std::string digests);
+    // Drops the digests of a file which is gone or was changed.
+    void Erase(const FileInfo& file_info);
+    // Atomically replaces the cache file. Least recently used entries are evicted to keep it under max_size.
+    // Does nothing for a cache kept in memory.
+    void Save();
+
+    [[nodiscard]] HashCacheStats GetStats() const;
+
+private:
+    std::unique_ptr<HashCacheImpl> impl_;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Kernels behind the hash strategies. Every accelerated kernel has a portable counterpart with the same
+// result; the functions without a suffix pick the best one for GetCpuFeatures() once, at startup.
+
+// CRC-32C (Castagnoli), crc is the checksum of the preceding data, 0 for the first call.
+uint32_t Crc32cScalar(uint32_t crc, const void* data, size_t size);
+uint32_t Crc32cSse42(uint32_t crc, const void* data, size_t size);
+uint32_t Crc32c(uint32_t crc, const void* data, size_t size);
+
+using Sha1State = std::array<uint32_t, 5>;
+using Sha256State = std::array<uint32_t, 8>;
+// Compression functions, consume block_count whole 64-byte blocks.
+using Sha1Compress = void (*)(Sha1State& state, const uint8_t* data, size_t block_count);
+using Sha256Compress = void (*)(Sha256State& state, const uint8_t* data, size_t block_count);
+
+void Sha1CompressScalar(Sha1State& state, const uint8_t* data, size_t block_count);
+void Sha1CompressShaNi(Sha1State& state, const uint8_t* data, size_t block_count);
+void Sha256CompressScalar(Sha256State& state, const uint8_t* data, size_t block_count);
+void Sha256CompressShaNi(Sha256State& state, const uint8_t* data, size_t block_count);
+
+Sha1State CalcSha1(const void* data, size_t size, Sha1Compress compress);
+Sha1State CalcSha1(const void* data, size_t size);
+Sha256State CalcSha256(const void* data, size_t size, Sha256Compress compress);
+Sha256State CalcSha256(const void* data, size_t size);
+
+enum class Xxh3Kernel {
+    kScalar,
+    kSse2,
+    kAvx2,
+};
+
+struct Xxh128Value {
+    uint64_t low;
+    uint64_t high;
+};
+
+// XXH3 with the default secret and zero seed.
+uint64_t Xxh3_64(const void* data, size_t size, Xxh3Kernel kernel);
+uint64_t Xxh3_64(const void* data, size_t size);
+Xxh128Value Xxh3_128(const void* data, size_t size, Xxh3Kernel kernel);
+Xxh128Value Xxh3_128(const void* data, size_t size);
+
+using Md5State = std::array<uint32_t, 4>;
+
+// Multi-buffer kernels hash up to 8 (AVX2) or 16 (AVX-512) messages of one size side by side, every one in
+// its own 32-bit lane of the vectors. The digests are the same as those of the single-buffer kernels.
+enum class MultiBufferKernel {
+    kAvx2,
+    kAvx512,
+};
+
+// The widest kernel this CPU runs, nothing without AVX2.
+std::optional<MultiBufferKernel> GetMultiBufferKernel();
+size_t GetLaneCount(MultiBufferKernel kernel);
+void CalcMd5MultiBuffer(const uint8_t* const* messages, size_t count, size_t size, Md5State* digests,
+                        MultiBufferKernel kernel);
+void CalcSha1MultiBuffer(const uint8_t* const* messages, size_t count, size_t size, Sha1State* digests,
+                         MultiBufferKernel kernel);
@@ -0,0 +1,318 @@
+#include "io_ring.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static constexpr size_t kBufferAlignment = 4096;
+
+[[noreturn]] static void ThrowSystemError(const std::string& what, int error = errno) {
+    throw std::system_error(error, std::system_category(), what);
+}
+
+static int IoUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(SYS_io_uring_setup, entries, params));
+}
+
+static int IoUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int IoUringRegister(int fd, unsigned opcode, const void* arg, unsigned arg_count) {
+    return static_cast<int>(syscall(SYS_io_uring_register, fd, opcode, arg, arg_count));
+}
+
+bool IsIoRingSupported() {
+    io_uring_params params{};
+    const int fd = IoUringSetup(1, &params);
+    if (fd == -1) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+class IoRingImpl {
+public:
+    IoRingImpl(size_t queue_depth, size_t max_read_size)
+            : queue_depth_(queue_depth)
+            , buffer_size_((max_read_size + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment) {
+        assert(queue_depth_ > 0);
+        assert(max_read_size > 0);
+        io_uring_params params{};
+        fd_ = IoUringSetup(static_cast<unsigned>(queue_depth_), &params);
+        if (fd_ == -1) {
+            ThrowSystemError("io_uring_setup");
+        }
+        try {
+            MapRings(params);
+            AllocateBuffers();
+        } catch (...) {
+            Destroy();
+            throw;
+        }
+    }
+
+    ~IoRingImpl() {
+        Destroy();
+    }
+
+    void Read(size_t request_count, const std::function<ReadRequest(size_t)>& get_request,
+              const IoRing::ReadCallback& on_read) {
+        std::vector<size_t> free_slots(slots_.size());
+        for (size_t i = 0; i < free_slots.size(); ++i) {
+            free_slots[i] = free_slots.size() - 1 - i;
+        }
+        std::exception_ptr exception;
+        size_t next_index = 0;
+        size_t in_flight = 0;
+        while (true) {
+            while (!exception && next_index < request_count && !free_slots.empty()) {
+                const size_t slot_index = free_slots.back();
+                auto& slot = slots_[slot_index];
+                try {
+                    slot.request = get_request(next_index);
+                } catch (...) {
+                    exception = std::current_exception();
+                    break;
+                }
+                assert(slot.request.size <= buffer_size_);
+                slot.index = next_index++;
+                slot.read_size = 0;
+                free_slots.pop_back();
+                PrepareRead(slot_index);
+                ++in_flight;
+            }
+            if (in_flight == 0) {
+                break;
+            }
+            try {
+                SubmitAndWait();
+            } catch (...) {
+                WaitInFlight(in_flight);
+                throw;
+            }
+            ReapCompletions([&](size_t slot_index, int result) {
+                auto& slot = slots_[slot_index];
+                if (result == -EINTR || result == -EAGAIN) {
+                    PrepareRead(slot_index);
+                    return;
+                }
+                if (result > 0) {
+                    slot.read_size += result;
+                    if (slot.read_size < slot.request.size) {
+                        // a short read before the end of file, the rest is read again
+                        PrepareRead(slot_index);
+                        return;
+                    }
+                }
+                --in_flight;
+                free_slots.push_back(slot_index);
+                if (exception) {
+                    return;
+                }
+                try {
+                    on_read(slot.index, result < 0 ? -result : 0,
+                            {buffers_[slot_index], result < 0 ? 0 : slot.read_size});
+                } catch (...) {
+                    exception = std::current_exception();
+                }
+            });
+        }
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    [[nodiscard]] size_t GetQueueDepth() const {
+        return queue_depth_;
+    }
+
+private:
+    struct Slot {
+        ReadRequest request{-1, 0, 0};
+        size_t index = 0;
+        // bytes read so far, a read may complete in several parts
+        size_t read_size = 0;
+    };
+
+    void MapRings(const io_uring_params& params) {
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = params.features & IORING_FEAT_SINGLE_MMAP ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+
+        auto* sq = static_cast<char*>(sq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        // at most queue_depth reads are in flight, so the rings never overflow
+        assert(params.sq_entries >= queue_depth_ && params.cq_entries >= queue_depth_);
+    }
+
+    void* Map(size_t size, off_t offset) {
+        void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        if (result == MAP_FAILED) {
+            ThrowSystemError("mmap");
+        }
+        return result;
+    }
+
+    void AllocateBuffers() {
+        slots_.resize(queue_depth_);
+        std::vector<iovec> iovecs;
+        for (size_t i = 0; i < queue_depth_; ++i) {
+            void* buffer = nullptr;
+            if (posix_memalign(&buffer, kBufferAlignment, buffer_size_) != 0) {
+                throw std::bad_alloc();
+            }
+            buffers_.push_back(static_cast<char*>(buffer));
+            iovecs.push_back({buffer, buffer_size_});
+        }
+        // registered buffers save pinning the pages on every read, plain reads are used if the memory lock
+        // limit doesn't allow to register them
+        buffers_registered_ = IoUringRegister(fd_, IORING_REGISTER_BUFFERS, iovecs.data(),
+                                              static_cast<unsigned>(iovecs.size())) == 0;
+    }
+
+    void PrepareRead(size_t slot_index) {
+        const auto& slot = slots_[slot_index];
+        const unsigned tail = *sq_tail_;
+        const unsigned sqe_index = tail & sq_mask_;
+        auto& sqe = sqes_[sqe_index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = buffers_registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = slot.request.fd;
+        sqe.off = slot.request.offset + slot.read_size;
+        sqe.addr = reinterpret_cast<uintptr_t>(buffers_[slot_index] + slot.read_size);
+        sqe.len = static_cast<uint32_t>(slot.request.size - slot.read_size);
+        sqe.buf_index = buffers_registered_ ? static_cast<uint16_t>(slot_index) : 0;
+        sqe.user_data = slot_index;
+        sq_array_[sqe_index] = sqe_index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++pending_submissions_;
+    }
+
+    void SubmitAndWait() {
+        while (true) {
+            const int result = IoUringEnter(fd_, pending_submissions_, 1, IORING_ENTER_GETEVENTS);
+            if (result == -1 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+                continue;
+            }
+            if (result == -1) {
+                ThrowSystemError("io_uring_enter");
+            }
+            pending_submissions_ -= result;
+            return;
+        }
+    }
+
+    // Drops the reads not submitted yet and waits for the submitted ones without reading any further, so no
+    // read writes to a buffer after Read has thrown. If even waiting fails, the buffers are never freed.
+    void WaitInFlight(size_t& in_flight) noexcept {
+        // a failed io_uring_enter consumes no submissions, the kernel hasn't looked at them yet
+        __atomic_store_n(sq_tail_, *sq_tail_ - pending_submissions_, __ATOMIC_RELEASE);
+        in_flight -= pending_submissions_;
+        pending_submissions_ = 0;
+        while (in_flight > 0) {
+            if (IoUringEnter(fd_, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR && errno != EAGAIN) {
+                leak_buffers_ = true;
+                return;
+            }
+            ReapCompletions([&in_flight](size_t, int) { --in_flight; });
+        }
+    }
+
+    template <typename Callback>
+    void ReapCompletions(Callback callback) {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const auto& cqe = cqes_[head & cq_mask_];
+            const auto slot_index = static_cast<size_t>(cqe.user_data);
+            const int result = cqe.res;
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            callback(slot_index, result);
+        }
+    }
+
+    void Destroy() {
+        // Read returns or throws only when no read is in flight, unless it couldn't wait for them; then the
+        // kernel may still write to the buffers after the ring is closed, so they are leaked instead of freed
+        if (sqes_ != nullptr) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != nullptr) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (fd_ != -1) {
+            close(fd_);
+        }
+        if (leak_buffers_) {
+            return;
+        }
+        for (auto* buffer : buffers_) {
+            free(buffer);
+        }
+    }
+
+    size_t queue_depth_;
+    size_t buffer_size_;
+    int fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned pending_submissions_ = 0;
+    std::vector<Slot> slots_;
+    std::vector<char*> buffers_;
+    bool buffers_registered_ = false;
+    bool leak_buffers_ = false;
+};
+
+IoRing::IoRing(size_t queue_depth, size_t max_read_size)
+        : impl_(std::make_unique<IoRingImpl>(queue_depth, max_read_size)) {
+}
+
+IoRing::~IoRing() = default;
+
+void IoRing::Read(size_t request_count, const std::function<ReadRequest(size_t)>& get_request,
+                  const ReadCallback& on_read) {
+    impl_->Read(request_count, get_request, on_read);
+}
+
+size_t IoRing::GetQueueDepth() const {
+    return impl_->GetQueueDepth();
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string_view>
+#include "reader.h"
+
+// Returns false if io_uring can't be used, e.g. on an old kernel or when it's disabled by a sandbox.
+bool IsIoRingSupported();
+
+class IoRingImpl;
+
+// Reads blocks asynchronously through io_uring into buffers registered with the kernel once and reused by
+// all the reads. Not thread-safe, every thread needs its own ring.
+class IoRing {
+public:
+    // Keeps up to queue_depth reads of at most max_read_size bytes in flight.
+    // Throws std::system_error if io_uring is not supported.
+    IoRing(size_t queue_depth, size_t max_read_size);
+    ~IoRing();
+
+    // Called with the index of a request as soon as it completes: either error is 0 and data is what was read
+    // (shorter than requested at the end of file, valid until the callback returns) or error is an errno value.
+    using ReadCallback = std::function<void(size_t index, int error, std::string_view data)>;
+
+    // Reads request_count blocks, get_request is called for every index in order right before its read is
+    // submitted, so it may open files lazily. Both callbacks are called from the calling thread. If one of
+    // them throws, or io_uring_enter fails, no more reads are submitted, the reads in flight are waited for and
+    // the exception is rethrown.
+    void Read(size_t request_count, const std::function<ReadRequest(size_t index)>& get_request,
+              const ReadCallback& on_read);
+
+    [[nodiscard]] size_t GetQueueDepth() const;
+
+private:
+    std::unique_ptr<IoRingImpl> impl_;
+};
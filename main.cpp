@@ -1,12 +1,94 @@
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/format.hpp>
 #include "scanner.h"
+#include "hash.h"
+#include "output_format.h"
+#include "shard.h"
+#include "watcher.h"
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
+// Changes arriving within this time after the first one are taken in together.
+static constexpr std::chrono::milliseconds kChangeBatchTime{50};
+
+// Readers of the report always see a whole one: it's written aside and renamed over the old one.
+static void WriteReport(const fs::path& report_path, const std::vector<FileGroup>& file_groups,
+                        OutputFormat output_format, bool mark_hard_links) {
+    const fs::path temporary_path = report_path.string() + ".tmp";
+    {
+        fs::ofstream out{temporary_path};
+        for (const auto& file_group : file_groups) {
+            WriteFileGroup(out, file_group, output_format, mark_hard_links);
+        }
+        if (!out) {
+            throw fs::filesystem_error("write", temporary_path,
+                                       boost::system::error_code(errno, boost::system::system_category()));
+        }
+    }
+    fs::rename(temporary_path, report_path);
+}
+
+// Scans once, then keeps the report current by scanning again only the files changed under the include
+// directories. Runs until the process is killed.
+[[noreturn]] static void WatchFileGroups(Scanner& scanner, const std::vector<fs::path>& directories, int scan_level,
+                                         const fs::path& report_path, OutputFormat output_format,
+                                         bool mark_hard_links, bool print_stats) {
+    // watching starts before the first scan, so no change made during the scan is missed
+    auto watcher = std::make_unique<DirectoryWatcher>(directories, scan_level);
+    scanner.BuildIndex();
+    WriteReport(report_path, scanner.GetIndexedGroups(), output_format, mark_hard_links);
+    while (true) {
+        auto changes = watcher->Wait(std::chrono::milliseconds(-1));
+        const auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < kChangeBatchTime) {
+            auto more_changes = watcher->Wait(kChangeBatchTime / 5);
+            if (more_changes.empty()) {
+                break;
+            }
+            std::move(more_changes.begin(), more_changes.end(), std::back_inserter(changes));
+        }
+        bool is_overflow = false;
+        for (const auto& change : changes) {
+            switch (change.kind) {
+                case FileChange::Kind::kChanged:
+                    scanner.AddFile(change.path);
+                    break;
+                case FileChange::Kind::kRemoved:
+                    scanner.RemoveFile(change.path);
+                    break;
+                case FileChange::Kind::kDirectoryRemoved:
+                    scanner.RemoveDirectory(change.path);
+                    break;
+                case FileChange::Kind::kOverflow:
+                    is_overflow = true;
+                    break;
+            }
+        }
+        if (is_overflow) {
+            // the directories made while events were lost have no watches, a new watcher walks the tree again;
+            // it's made before the rescan for the same reason as the first one
+            watcher.reset();
+            watcher = std::make_unique<DirectoryWatcher>(directories, scan_level);
+            scanner.BuildIndex();
+        }
+        const auto file_groups = scanner.GetIndexedGroups();
+        const auto refine_end = std::chrono::steady_clock::now();
+        WriteReport(report_path, file_groups, output_format, mark_hard_links);
+        if (print_stats) {
+            std::cerr << boost::format("%1% changes%2%, %3% groups, report updated in %4$.3f s (refine %5$.3f s)\n")
+                    % changes.size() % (is_overflow ? " (events lost, rescanned)" : "") % file_groups.size()
+                    % std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                    % std::chrono::duration<double>(refine_end - start).count();
+        }
+    }
+}
+
 int main(int ac, char** av) {
     po::options_description desc("Allowed options");
     desc.add_options()
@@ -15,9 +97,45 @@ int main(int ac, char** av) {
             ("exclude-directories,e", po::value<std::vector<std::string>>()->default_value({}, ""))
             ("scan-level,l", po::value<int>()->default_value(0))
             ("min-file-size,f", po::value<int>()->default_value(1))
-            ("file-masks,m", po::value<std::vector<std::string>>()->default_value({".*"}, "\".*\""))
+            ("file-masks,m", po::value<std::vector<std::string>>()->default_value({".*"}, "\".*\""),
+                    "regular expressions matching whole file names, or globs prefixed with glob:")
             ("block-size,b", po::value<int>()->required())
             ("hash-algorithm,a", po::value<std::string>()->default_value("md5"))
+            ("max-block-size", po::value<size_t>()->default_value(0),
+                    "grow blocks geometrically from the block size up to this size")
+            ("probes", po::value<size_t>()->default_value(1),
+                    "blocks compared before reading sequentially: the last one, then ones in the middle")
+            ("read-mode", po::value<std::string>()->default_value("pread"),
+                    "pread, mmap, io_uring, fadvise (drops the pages read from the page cache) or direct (O_DIRECT)")
+            ("engine", po::value<std::string>()->default_value("trie"),
+                    "trie, or rounds reading the next block of all the candidates of a size at a time")
+            ("queue-depth", po::value<size_t>()->default_value(32), "reads in flight per thread with io_uring")
+            ("physical-order", po::value<std::vector<std::string>>()->default_value({}, ""),
+                    "directories whose files are read in the order of their blocks on the disk")
+            ("max-open-files", po::value<size_t>()->default_value(512))
+            ("memory-budget", po::value<uintmax_t>()->default_value(0),
+                    "memory for the file lists in MiB, beyond it they are sorted on the disk; 0 keeps them in memory")
+            ("spill-directory", po::value<std::string>()->default_value(""),
+                    "directory of the sorted runs, the temporary directory by default")
+            ("threads,t", po::value<size_t>()->default_value(1), "threads reading and hashing files")
+            ("hash-cache", po::value<std::string>()->default_value(""), "file keeping block digests between runs")
+            ("hash-cache-size", po::value<uintmax_t>()->default_value(256), "hash cache size limit in MiB")
+            ("format", po::value<std::string>()->default_value("text"), "text, nul or json")
+            ("mark-hard-links", "mark paths which are hard links to the same file")
+            ("verify", "compare the files of every group byte by byte, which makes weak hashes like crc32c or xxh3 "
+                    "safe")
+            ("stats", "print scan statistics and phase times to stderr")
+            ("trace", po::value<std::string>()->default_value(""), "file to write Chrome trace events of the scan to")
+            ("watch", po::value<std::string>(),
+                    "keep running and keep the groups in this file current, rescanning only the changed files")
+            ("shards", po::value<size_t>()->default_value(1), "split the scan by file size into this many shards")
+            ("shard-index", po::value<size_t>(), "scan only this shard")
+            ("shard-directory", po::value<std::string>(),
+                    "keep the groups of every shard in this directory; without a shard index the missing shards are "
+                    "scanned by worker processes and the groups of all the shards are printed")
+            ("jobs,j", po::value<size_t>()->default_value(1), "worker processes scanning shards at a time")
+            ("merge", po::value<std::vector<std::string>>()->multitoken(),
+                    "print the groups of these shard files and exit")
             ;
 
     po::variables_map vm;
@@ -28,24 +146,142 @@ int main(int ac, char** av) {
         return 0;
     }
 
+    const auto output_format = GetOutputFormat(vm["format"].as<std::string>());
+    const bool mark_hard_links = vm.count("mark-hard-links") > 0;
+    const auto write_file_group = [output_format, mark_hard_links](FileGroup file_group) {
+        WriteFileGroup(std::cout, file_group, output_format, mark_hard_links);
+    };
+    if (vm.count("merge")) {
+        const auto shard_paths = vm["merge"].as<std::vector<std::string>>();
+        MergeShards({shard_paths.begin(), shard_paths.end()}, write_file_group);
+        return 0;
+    }
+
     po::notify(vm);
 
-    Scanner scanner{
-        vm["include-directories"].as<std::vector<std::string>>(),
-        vm["exclude-directories"].as<std::vector<std::string>>(),
-        vm["scan-level"].as<int>(),
-        vm["min-file-size"].as<int>(),
-        vm["file-masks"].as<std::vector<std::string>>(),
-        vm["block-size"].as<int>(),
-        vm["hash-algorithm"].as<std::string>()
+    ScannerOptions options;
+    options.max_block_size = vm["max-block-size"].as<size_t>();
+    options.probe_count = vm["probes"].as<size_t>();
+    options.read_mode = GetReadMode(vm["read-mode"].as<std::string>());
+    options.grouping_engine = GetGroupingEngine(vm["engine"].as<std::string>());
+    options.queue_depth = vm["queue-depth"].as<size_t>();
+    const auto physical_order_directories = vm["physical-order"].as<std::vector<std::string>>();
+    options.physical_order_directories.assign(physical_order_directories.begin(), physical_order_directories.end());
+    // the scanner rejects 0
+    options.max_open_files = vm["max-open-files"].as<size_t>();
+    options.memory_budget = vm["memory-budget"].as<uintmax_t>() << 20;
+    options.spill_directory = vm["spill-directory"].as<std::string>();
+    options.thread_count = vm["threads"].as<size_t>();
+    options.hash_cache_path = vm["hash-cache"].as<std::string>();
+    options.hash_cache_max_size = vm["hash-cache-size"].as<uintmax_t>() << 20;
+    options.measure_block_times = vm.count("stats") > 0;
+    options.measure_page_cache = vm.count("stats") > 0;
+    options.verify_groups = vm.count("verify") > 0;
+    options.trace_path = vm["trace"].as<std::string>();
+    options.shard_count = vm["shards"].as<size_t>();
+    if (options.shard_count == 0
+            || (vm.count("shard-index") && vm["shard-index"].as<size_t>() >= options.shard_count)) {
+        throw po::error("the shard index must be less than the number of shards");
+    }
+    const auto create_scanner = [&vm](const ScannerOptions& options) {
+        return std::make_unique<Scanner>(
+            vm["include-directories"].as<std::vector<std::string>>(),
+            vm["exclude-directories"].as<std::vector<std::string>>(),
+            vm["scan-level"].as<int>(),
+            vm["min-file-size"].as<int>(),
+            vm["file-masks"].as<std::vector<std::string>>(),
+            vm["block-size"].as<int>(),
+            vm["hash-algorithm"].as<std::string>(),
+            options
+        );
+    };
+    // runs one shard and keeps its groups, the hash cache of every shard is a file of its own
+    const auto scan_shard = [&create_scanner, &options](size_t shard_index, const fs::path& shard_directory) {
+        auto shard_options = options;
+        shard_options.shard_index = shard_index;
+        if (!shard_options.hash_cache_path.empty()) {
+            shard_options.hash_cache_path += "." + std::to_string(shard_index);
+        }
+        std::vector<FileGroup> file_groups;
+        create_scanner(shard_options)->FindEqualFileGroups([&file_groups](FileGroup file_group) {
+            file_groups.push_back(std::move(file_group));
+        });
+        WriteShard(GetShardPath(shard_directory, shard_index), std::move(file_groups));
     };
+    if (vm.count("shard-directory")) {
+        const fs::path shard_directory = vm["shard-directory"].as<std::string>();
+        fs::create_directories(shard_directory);
+        // the tuning options don't change the groups, only these do
+        ShardManifest manifest{{"shards", std::to_string(options.shard_count)}};
+        for (const auto& directory : vm["include-directories"].as<std::vector<std::string>>()) {
+            manifest.emplace_back("include-directory", fs::absolute(directory).string());
+        }
+        for (const auto& directory : vm["exclude-directories"].as<std::vector<std::string>>()) {
+            manifest.emplace_back("exclude-directory", fs::absolute(directory).string());
+        }
+        manifest.emplace_back("scan-level", std::to_string(vm["scan-level"].as<int>()));
+        manifest.emplace_back("min-file-size", std::to_string(vm["min-file-size"].as<int>()));
+        for (const auto& file_mask : vm["file-masks"].as<std::vector<std::string>>()) {
+            manifest.emplace_back("file-mask", file_mask);
+        }
+        manifest.emplace_back("block-size", std::to_string(vm["block-size"].as<int>()));
+        manifest.emplace_back("hash-algorithm", ResolveHashAlgorithm(vm["hash-algorithm"].as<std::string>()));
+        manifest.emplace_back("verify", options.verify_groups ? "1" : "0");
+        CheckShardManifest(shard_directory, manifest);
+        if (vm.count("shard-index")) {
+            scan_shard(vm["shard-index"].as<size_t>(), shard_directory);
+            return 0;
+        }
+        RunShards(options.shard_count, std::max<size_t>(vm["jobs"].as<size_t>(), 1), shard_directory,
+                  [&scan_shard, &shard_directory](size_t shard_index) { scan_shard(shard_index, shard_directory); });
+        std::vector<fs::path> shard_paths;
+        for (size_t shard_index = 0; shard_index < options.shard_count; ++shard_index) {
+            shard_paths.push_back(GetShardPath(shard_directory, shard_index));
+        }
+        MergeShards(shard_paths, write_file_group);
+        return 0;
+    }
+    if (options.shard_count > 1 && !vm.count("shard-index")) {
+        throw po::error("several shards need a shard index or a shard directory");
+    }
+    options.shard_index = vm.count("shard-index") ? vm["shard-index"].as<size_t>() : 0;
+
+    const auto scanner_ptr = create_scanner(options);
+    auto& scanner = *scanner_ptr;
+    if (vm.count("watch")) {
+        const auto include_directories = vm["include-directories"].as<std::vector<std::string>>();
+        WatchFileGroups(scanner, {include_directories.begin(), include_directories.end()}, vm["scan-level"].as<int>(),
+                        vm["watch"].as<std::string>(), output_format, mark_hard_links, vm.count("stats") > 0);
+    }
+    scanner.FindEqualFileGroups(write_file_group);
 
-    const auto& file_groups = scanner.FindEqualFileGroups();
-    for (const auto& file_group : file_groups) {
-        for (const auto& file_name : file_group) {
-            std::cout << file_name << "\n";
+    if (vm.count("stats")) {
+        const auto scan_stats = scanner.GetScanStats();
+        std::cerr << boost::format("files: %1% listed, %2% candidates in %3% size buckets, %4% groups, "
+                                   "%5% runs spilled\n")
+                % scan_stats.files_listed % scan_stats.candidate_files % scan_stats.size_buckets % scan_stats.groups
+                % scan_stats.spill_runs;
+        std::cerr << boost::format("blocks: %1% read (%2% bytes), %3% from the hash cache, %4% trie nodes, "
+                                   "%5% rounds\n")
+                % scan_stats.blocks_read % scan_stats.bytes_read % scan_stats.cached_blocks % scan_stats.trie_nodes
+                % scan_stats.refine_rounds;
+        std::cerr << boost::format("page cache: %1% bytes of the files read left resident\n")
+                % scan_stats.resident_bytes;
+        std::cerr << boost::format("time: list %1$.3f s, refine %2$.3f s (read %3$.3f s, hash %4$.3f s over all "
+                                   "threads), save %5$.3f s\n")
+                % scan_stats.list_seconds % scan_stats.refine_seconds % scan_stats.read_seconds
+                % scan_stats.hash_seconds % scan_stats.save_seconds;
+        if (options.verify_groups) {
+            std::cerr << boost::format("verify: %1% bytes compared in %2$.3f s over all threads, %3% groups split\n")
+                    % scan_stats.verified_bytes % scan_stats.verify_seconds % scan_stats.split_groups;
         }
-        std::cout << "\n";
+        const auto reader_pool_stats = scanner.GetReaderPoolStats();
+        std::cerr << boost::format("reader pool: %1% hits, %2% misses, %3% reopens, %4% open at most\n")
+                % reader_pool_stats.hits % reader_pool_stats.misses % reader_pool_stats.reopens
+                % reader_pool_stats.peak_open_readers;
+        const auto hash_cache_stats = scanner.GetHashCacheStats();
+        std::cerr << boost::format("hash cache: %1% hits, %2% misses\n")
+                % hash_cache_stats.hits % hash_cache_stats.misses;
     }
 
     return 0;
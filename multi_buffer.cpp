@@ -0,0 +1,262 @@
+#include "hash_kernels.h"
+#include "cpu_features.h"
+
+#include <cassert>
+#include <cstring>
+#include <tuple>
+
+// The lanes are generic GCC vectors, the target attributes of the entry points pick the instructions.
+using Vector8 = uint32_t __attribute__((vector_size(32)));
+using Vector16 = uint32_t __attribute__((vector_size(64)));
+
+#define MULTI_BUFFER_INLINE __attribute__((always_inline)) inline
+
+// Vectors are only passed between functions inlined into the entry points, never across an ABI boundary.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+static constexpr size_t kBlockSize = 64;
+
+static constexpr Md5State kMd5InitialState = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+static constexpr Sha1State kSha1InitialState = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+static constexpr uint32_t kMd5RoundConstants[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+static constexpr int kMd5Shifts[4][4] = {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+
+template <typename Vector>
+static constexpr size_t kLanes = sizeof(Vector) / sizeof(uint32_t);
+
+template <typename Vector>
+MULTI_BUFFER_INLINE Vector RotateLeft(Vector value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+// Word i of the current block of every lane.
+template <typename Vector, bool kBigEndian>
+MULTI_BUFFER_INLINE Vector LoadWord(const uint8_t* const* blocks, size_t i) {
+    Vector result;
+    for (size_t lane = 0; lane < kLanes<Vector>; ++lane) {
+        uint32_t word;
+        std::memcpy(&word, blocks[lane] + 4 * i, sizeof(word));
+        result[lane] = kBigEndian ? __builtin_bswap32(word) : word;
+    }
+    return result;
+}
+
+template <typename Vector>
+MULTI_BUFFER_INLINE void Md5CompressLanes(Vector* state, const uint8_t** blocks, size_t block_count) {
+    for (; block_count > 0; --block_count) {
+        Vector words[16];
+        for (size_t i = 0; i < 16; ++i) {
+            words[i] = LoadWord<Vector, false>(blocks, i);
+        }
+        Vector a = state[0], b = state[1], c = state[2], d = state[3];
+#pragma GCC unroll 64
+        for (int i = 0; i < 64; ++i) {
+            Vector f;
+            int g;
+            if (i < 16) {
+                f = d ^ (b & (c ^ d));
+                g = i;
+            } else if (i < 32) {
+                f = c ^ (d & (b ^ c));
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            const Vector temp = d;
+            d = c;
+            c = b;
+            b = b + RotateLeft(a + f + kMd5RoundConstants[i] + words[g], kMd5Shifts[i / 16][i % 4]);
+            a = temp;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        for (size_t lane = 0; lane < kLanes<Vector>; ++lane) {
+            blocks[lane] += kBlockSize;
+        }
+    }
+}
+
+template <typename Vector>
+MULTI_BUFFER_INLINE void Sha1CompressLanes(Vector* state, const uint8_t** blocks, size_t block_count) {
+    for (; block_count > 0; --block_count) {
+        Vector words[16];
+        for (size_t i = 0; i < 16; ++i) {
+            words[i] = LoadWord<Vector, true>(blocks, i);
+        }
+        Vector a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+#pragma GCC unroll 80
+        for (int i = 0; i < 80; ++i) {
+            if (i >= 16) {
+                words[i % 16] = RotateLeft(words[(i - 3) % 16] ^ words[(i - 8) % 16] ^ words[(i - 14) % 16]
+                                           ^ words[i % 16], 1);
+            }
+            Vector f;
+            uint32_t k;
+            if (i < 20) {
+                f = d ^ (b & (c ^ d));
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (d & (b | c));
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            const Vector temp = RotateLeft(a, 5) + f + e + k + words[i % 16];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        for (size_t lane = 0; lane < kLanes<Vector>; ++lane) {
+            blocks[lane] += kBlockSize;
+        }
+    }
+}
+
+// Compresses every message followed by the standard padding: 0x80, zeros and the bit length, little endian
+// for MD5 and big endian for SHA-1. Lanes beyond count hash the first message again.
+template <typename Vector, typename State, bool kBigEndian, typename Compress>
+MULTI_BUFFER_INLINE void CalcMultiBuffer(const uint8_t* const* messages, size_t count, size_t size, State* digests,
+                                         const State& initial_state, Compress compress) {
+    constexpr size_t kStateWords = std::tuple_size_v<State>;
+    Vector state[kStateWords];
+    for (size_t i = 0; i < kStateWords; ++i) {
+        for (size_t lane = 0; lane < kLanes<Vector>; ++lane) {
+            state[i][lane] = initial_state[i];
+        }
+    }
+    const uint8_t* blocks[kLanes<Vector>];
+    for (size_t lane = 0; lane < kLanes<Vector>; ++lane) {
+        blocks[lane] = messages[lane < count ? lane : 0];
+    }
+    const size_t whole_blocks = size / kBlockSize;
+    compress(state, blocks, whole_blocks);
+
+    const size_t tail_size = size % kBlockSize;
+    const size_t tail_blocks = tail_size + 1 + 8 <= kBlockSize ? 1 : 2;
+    const uint64_t bit_size = static_cast<uint64_t>(size) * 8;
+    uint8_t tails[kLanes<Vector>][2 * kBlockSize];
+    for (size_t lane = 0; lane < kLanes<Vector>; ++lane) {
+        std::memset(tails[lane], 0, sizeof(tails[lane]));
+        std::memcpy(tails[lane], blocks[lane], tail_size);
+        tails[lane][tail_size] = 0x80;
+        for (size_t i = 0; i < 8; ++i) {
+            const size_t position = kBigEndian ? tail_blocks * kBlockSize - 1 - i : tail_blocks * kBlockSize - 8 + i;
+            tails[lane][position] = static_cast<uint8_t>(bit_size >> (8 * i));
+        }
+        blocks[lane] = tails[lane];
+    }
+    compress(state, blocks, tail_blocks);
+
+    for (size_t lane = 0; lane < count; ++lane) {
+        for (size_t i = 0; i < kStateWords; ++i) {
+            digests[lane][i] = state[i][lane];
+        }
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void CalcMd5Avx2(const uint8_t* const* messages, size_t count, size_t size, Md5State* digests) {
+    CalcMultiBuffer<Vector8, Md5State, false>(messages, count, size, digests, kMd5InitialState,
+                                              [](Vector8* state, const uint8_t** blocks, size_t block_count) {
+        Md5CompressLanes(state, blocks, block_count);
+    });
+}
+
+__attribute__((target("avx512f")))
+static void CalcMd5Avx512(const uint8_t* const* messages, size_t count, size_t size, Md5State* digests) {
+    CalcMultiBuffer<Vector16, Md5State, false>(messages, count, size, digests, kMd5InitialState,
+                                               [](Vector16* state, const uint8_t** blocks, size_t block_count) {
+        Md5CompressLanes(state, blocks, block_count);
+    });
+}
+
+__attribute__((target("avx2")))
+static void CalcSha1Avx2(const uint8_t* const* messages, size_t count, size_t size, Sha1State* digests) {
+    CalcMultiBuffer<Vector8, Sha1State, true>(messages, count, size, digests, kSha1InitialState,
+                                              [](Vector8* state, const uint8_t** blocks, size_t block_count) {
+        Sha1CompressLanes(state, blocks, block_count);
+    });
+}
+
+__attribute__((target("avx512f")))
+static void CalcSha1Avx512(const uint8_t* const* messages, size_t count, size_t size, Sha1State* digests) {
+    CalcMultiBuffer<Vector16, Sha1State, true>(messages, count, size, digests, kSha1InitialState,
+                                               [](Vector16* state, const uint8_t** blocks, size_t block_count) {
+        Sha1CompressLanes(state, blocks, block_count);
+    });
+}
+#endif
+
+std::optional<MultiBufferKernel> GetMultiBufferKernel() {
+    const auto& cpu_features = GetCpuFeatures();
+    if (cpu_features.avx512f) {
+        return MultiBufferKernel::kAvx512;
+    }
+    if (cpu_features.avx2) {
+        return MultiBufferKernel::kAvx2;
+    }
+    return std::nullopt;
+}
+
+size_t GetLaneCount(MultiBufferKernel kernel) {
+    return kernel == MultiBufferKernel::kAvx512 ? 16 : 8;
+}
+
+void CalcMd5MultiBuffer(const uint8_t* const* messages, size_t count, size_t size, Md5State* digests,
+                        MultiBufferKernel kernel) {
+    assert(count > 0 && count <= GetLaneCount(kernel));
+#if defined(__x86_64__)
+    if (kernel == MultiBufferKernel::kAvx512) {
+        CalcMd5Avx512(messages, count, size, digests);
+    } else {
+        CalcMd5Avx2(messages, count, size, digests);
+    }
+#else
+    std::ignore = std::make_tuple(messages, count, size, digests, kernel);
+    assert(false);
+#endif
+}
+
+void CalcSha1MultiBuffer(const uint8_t* const* messages, size_t count, size_t size, Sha1State* digests,
+                         MultiBufferKernel kernel) {
+    assert(count > 0 && count <= GetLaneCount(kernel));
+#if defined(__x86_64__)
+    if (kernel == MultiBufferKernel::kAvx512) {
+        CalcSha1Avx512(messages, count, size, digests);
+    } else {
+        CalcSha1Avx2(messages, count, size, digests);
+    }
+#else
+    std::ignore = std::make_tuple(messages, count, size, digests, kernel);
+    assert(false);
+#endif
+}
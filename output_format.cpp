@@ -0,0 +1,93 @@
+#include "output_format.h"
+#include <map>
+#include <set>
+#include <boost/format.hpp>
+
+static const std::map<std::string, OutputFormat> kOutputFormats = {
+        {"json", OutputFormat::kJsonLines},
+        {"nul", OutputFormat::kNul},
+        {"text", OutputFormat::kText},
+};
+
+OutputFormat GetOutputFormat(const std::string& output_format) {
+    return kOutputFormats.at(output_format);
+}
+
+std::vector<std::string> GetPossibleOutputFormats() {
+    std::vector<std::string> result;
+    std::transform(kOutputFormats.begin(), kOutputFormats.end(), std::back_inserter(result),
+            [](const auto& kv) { return kv.first; });
+    return result;
+}
+
+// Paths are byte strings, bytes which are not ASCII are written as is.
+static void WriteJsonString(std::ostream& out, const std::string& str) {
+    out << '"';
+    for (const char c : str) {
+        switch (c) {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\t':
+                out << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out << boost::format("\\u%04x") % static_cast<int>(c);
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+void WriteFileGroup(std::ostream& out, const FileGroup& file_group, OutputFormat output_format,
+                    bool mark_hard_links) {
+    mark_hard_links = mark_hard_links && file_group.link_ids.size() == file_group.paths.size();
+    switch (output_format) {
+        case OutputFormat::kText: {
+            std::set<size_t> written_link_ids;
+            for (size_t i = 0; i < file_group.paths.size(); ++i) {
+                out << file_group.paths[i];
+                if (mark_hard_links && !written_link_ids.insert(file_group.link_ids[i]).second) {
+                    out << " (hard link)";
+                }
+                out << "\n";
+            }
+            out << "\n";
+            break;
+        }
+        case OutputFormat::kNul:
+            for (const auto& path : file_group.paths) {
+                out << path.native() << '\0';
+            }
+            out << '\0';
+            break;
+        case OutputFormat::kJsonLines:
+            out << "{\"size\":" << file_group.file_size << ",\"paths\":[";
+            for (size_t i = 0; i < file_group.paths.size(); ++i) {
+                if (i > 0) {
+                    out << ',';
+                }
+                WriteJsonString(out, file_group.paths[i].native());
+            }
+            out << ']';
+            if (mark_hard_links) {
+                out << ",\"links\":[";
+                for (size_t i = 0; i < file_group.link_ids.size(); ++i) {
+                    out << (i > 0 ? "," : "") << file_group.link_ids[i];
+                }
+                out << ']';
+            }
+            out << "}\n";
+            break;
+    }
+    out.flush();
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "scanner.h"
+
+enum class OutputFormat {
+    kText,       // quoted paths one per line, groups separated by empty lines
+    kNul,        // paths terminated by NUL, groups terminated by one more NUL
+    kJsonLines,  // one JSON object per group: {"size":...,"paths":[...]}
+};
+
+OutputFormat GetOutputFormat(const std::string& output_format);
+
+std::vector<std::string> GetPossibleOutputFormats();
+
+// Writes the group and flushes the stream, so the consumer gets it right away. With mark_hard_links text
+// output tags paths linked to a file listed earlier in the group and json output gets a "links" array
+// with the link ids, nul output stays unchanged.
+void WriteFileGroup(std::ostream& out, const FileGroup& file_group, OutputFormat output_format,
+                    bool mark_hard_links = false);
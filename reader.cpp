@@ -1,45 +1,317 @@
 #include "reader.h"
 
+#include <map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const std::map<std::string, ReadMode> kReadModes = {
+        {"direct", ReadMode::kDirect},
+        {"fadvise", ReadMode::kFadvise},
+        {"io_uring", ReadMode::kIoUring},
+        {"mmap", ReadMode::kMmap},
+        {"pread", ReadMode::kPread},
+};
+
+// also the alignment of O_DIRECT offsets and sizes, no device has larger logical blocks
+static constexpr size_t kBufferAlignment = 4096;
+
+// Sequential O_DIRECT reads fetch at least this much, the kernel readahead doesn't apply to them.
+static constexpr size_t kDirectReadahead = 64 << 10;
+
+static uintmax_t AlignDown(uintmax_t value) {
+    return value / kBufferAlignment * kBufferAlignment;
+}
+
+static uintmax_t AlignUp(uintmax_t value) {
+    return AlignDown(value + kBufferAlignment - 1);
+}
+
+ReadMode GetReadMode(const std::string& read_mode) {
+    return kReadModes.at(read_mode);
+}
+
+std::vector<std::string> GetPossibleReadModes() {
+    std::vector<std::string> result;
+    std::transform(kReadModes.begin(), kReadModes.end(), std::back_inserter(result),
+            [](const auto& kv) { return kv.first; });
+    return result;
+}
+
+[[noreturn]] void ThrowSystemError(const std::string& what, const fs::path& file_path) {
+    throw fs::filesystem_error(what, file_path, boost::system::error_code(errno, boost::system::system_category()));
+}
+
+uintmax_t GetResidentBytes(const fs::path& file_path, uintmax_t file_size) {
+    if (file_size == 0) {
+        return 0;
+    }
+    const int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    // mapping a file doesn't fault its pages in
+    void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((file_size + page_size - 1) / page_size);
+    uintmax_t result = 0;
+    if (mincore(mapping, file_size, pages.data()) == 0) {
+        for (size_t i = 0; i < pages.size(); ++i) {
+            if (pages[i] & 1) {
+                result += std::min<uintmax_t>(page_size, file_size - i * page_size);
+            }
+        }
+    }
+    munmap(mapping, file_size);
+    return result;
+}
+
 class FileBlockReaderImpl {
 public:
-    FileBlockReaderImpl(fs::path file_path, size_t block_size)
+    FileBlockReaderImpl(fs::path file_path, size_t block_size, ReadMode read_mode, std::optional<uintmax_t> file_size,
+                        size_t max_block_size)
             : file_path_(std::move(file_path))
-            , block_size_(block_size) {
+            , block_size_(block_size)
+            , max_block_size_(std::max(block_size, max_block_size))
+            , read_mode_(read_mode)
+            , file_size_(file_size ? *file_size : fs::file_size(file_path_)) {
         assert(fs::exists(file_path_));
         assert(fs::is_regular_file(file_path_));
+        assert(block_size_ > 0);
+    }
+
+    ~FileBlockReaderImpl() {
+        Close();
     }
 
     std::string ReadNextBlock() {
+        const size_t block_size = block_size_;
+        std::string block(ReadNextBlockView());
+        block.resize(block_size, 0);
+        return block;
+    }
+
+    std::string_view ReadNextBlockView() {
         assert(!IsEnd());
-        if (!ifstream_) {
-            ifstream_.emplace(file_path_);
-            assert(ifstream_->good());
-        }
-        std::string block(block_size_, 0);
-        for (size_t i = 0; i < block_size_; ++i) {
-            ifstream_->get(block[i]);
-            if (ifstream_->eof()) {
-                break;
-            }
+        if (fd_ == -1) {
+            Open();
         }
-        if (!ifstream_->eof() && ifstream_->get() != fs::ofstream::traits_type::eof()) {
-            ifstream_->unget();
+        const size_t size = std::min<uintmax_t>(block_size_, file_size_ - offset_);
+        std::string_view block;
+        if (mapping_ != nullptr) {
+            block = {static_cast<const char*>(mapping_) + offset_, size};
+        } else {
+            block = ReadView(offset_, size, true);
         }
+        // a file truncated after it was listed ends earlier than expected
+        offset_ = block.size() == size ? offset_ + size : file_size_;
+        GrowBlockSize();
         return block;
     }
 
+    std::string_view ReadBlockView(uintmax_t offset, size_t size) {
+        assert(offset + size <= file_size_);
+        if (fd_ == -1) {
+            Open();
+        }
+        if (mapping_ != nullptr) {
+            return {static_cast<const char*>(mapping_) + offset, size};
+        }
+        return ReadView(offset, size, false);
+    }
+
+    ReadRequest GetNextBlockRequest() {
+        assert(!IsEnd());
+        return GetBlockRequest(offset_, std::min<uintmax_t>(block_size_, file_size_ - offset_));
+    }
+
+    ReadRequest GetBlockRequest(uintmax_t offset, size_t size) {
+        assert(offset + size <= file_size_);
+        if (fd_ == -1) {
+            Open();
+        }
+        return {fd_, offset, size};
+    }
+
+    void SkipNextBlock() {
+        assert(!IsEnd());
+        offset_ = std::min<uintmax_t>(offset_ + block_size_, file_size_);
+        GrowBlockSize();
+    }
+
     bool IsEnd() const {
-        return ifstream_.has_value() && ifstream_->eof();
+        return offset_ >= file_size_;
+    }
+
+    void Close() {
+        if (mapping_ != nullptr) {
+            munmap(mapping_, file_size_);
+            mapping_ = nullptr;
+        }
+        if (fd_ != -1) {
+            if (IsDroppingPages()) {
+                // the kernel readahead went past the reads
+                posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+            }
+            close(fd_);
+            fd_ = -1;
+        }
+        // many readers may wait closed for their turn, only the open ones keep a buffer
+        buffer_.reset();
+        buffer_size_ = 0;
+        window_size_ = 0;
+    }
+
+    bool IsOpen() const {
+        return fd_ != -1;
     }
 
 private:
+    struct FreeDeleter {
+        void operator()(char* buffer) const {
+            free(buffer);
+        }
+    };
+
+    void Open() {
+        if (read_mode_ == ReadMode::kDirect) {
+            fd_ = open(file_path_.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+            // tmpfs and some network file systems refuse O_DIRECT, the plain open below reads with fadvise then
+            is_direct_ = fd_ != -1;
+        }
+        if (fd_ == -1) {
+            fd_ = open(file_path_.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd_ == -1) {
+            ThrowSystemError("open", file_path_);
+        }
+        if (IsDroppingPages()) {
+            posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+        if (read_mode_ == ReadMode::kMmap && IsSizeUnchanged()) {
+            mapping_ = mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (mapping_ == MAP_FAILED) {
+                mapping_ = nullptr;
+                ThrowSystemError("mmap", file_path_);
+            }
+            madvise(mapping_, file_size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    // Touching a mapped page past the end of the file raises SIGBUS, so a file whose size changed since it was
+    // listed is read with pread instead, which just reads less.
+    bool IsSizeUnchanged() const {
+        struct stat file_stat{};
+        return fstat(fd_, &file_stat) == 0 && static_cast<uintmax_t>(file_stat.st_size) == file_size_;
+    }
+
+    // The pages read through the page cache are dropped, with O_DIRECT there are none.
+    bool IsDroppingPages() const {
+        return read_mode_ == ReadMode::kFadvise || (read_mode_ == ReadMode::kDirect && !is_direct_);
+    }
+
+    void ReserveBuffer(size_t size) {
+        if (size <= buffer_size_) {
+            return;
+        }
+        void* buffer = nullptr;
+        const size_t buffer_size = (size + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+        if (posix_memalign(&buffer, kBufferAlignment, buffer_size) != 0) {
+            throw std::bad_alloc();
+        }
+        buffer_.reset(static_cast<char*>(buffer));
+        buffer_size_ = buffer_size;
+    }
+
+    void GrowBlockSize() {
+        block_size_ = std::min(block_size_ * 2, max_block_size_);
+    }
+
+    // The view may be shorter than size if the file was truncated. Sequential reads are the next blocks.
+    std::string_view ReadView(uintmax_t offset, size_t size, bool is_sequential) {
+        if (is_direct_) {
+            return ReadDirectView(offset, size, is_sequential);
+        }
+        ReserveBuffer(size);
+        const size_t read_size = ReadToBuffer(offset, size);
+        if (IsDroppingPages() && read_size > 0) {
+            // whole pages only, the ones partly read are dropped as well
+            posix_fadvise(fd_, AlignDown(offset), AlignUp(offset + read_size) - AlignDown(offset),
+                          POSIX_FADV_DONTNEED);
+        }
+        return {buffer_.get(), read_size};
+    }
+
+    // O_DIRECT needs aligned offsets, sizes and buffers: the aligned range around the block is read into the
+    // window, together with the readahead for sequential reads, and the block is a view into it.
+    std::string_view ReadDirectView(uintmax_t offset, size_t size, bool is_sequential) {
+        const uintmax_t window_end = window_offset_ + window_size_;
+        const bool is_in_window = window_size_ > 0 && offset >= window_offset_
+                                  && (offset + size <= window_end || window_end >= file_size_);
+        if (!is_in_window) {
+            const uintmax_t aligned_offset = AlignDown(offset);
+            uintmax_t aligned_end = AlignUp(offset + size);
+            if (is_sequential) {
+                aligned_end = std::min(std::max(aligned_end, aligned_offset + kDirectReadahead),
+                                       AlignUp(file_size_));
+            }
+            ReserveBuffer(aligned_end - aligned_offset);
+            window_offset_ = aligned_offset;
+            window_size_ = ReadToBuffer(aligned_offset, aligned_end - aligned_offset);
+        }
+        const uintmax_t available = std::max<uintmax_t>(window_offset_ + window_size_, offset) - offset;
+        return {buffer_.get() + (offset - window_offset_), static_cast<size_t>(std::min<uintmax_t>(size, available))};
+    }
+
+    size_t ReadToBuffer(uintmax_t offset, size_t size) {
+        size_t read_size = 0;
+        while (read_size < size) {
+            const ssize_t result = pread(fd_, buffer_.get() + read_size, size - read_size, offset + read_size);
+            if (result == -1 && errno == EINTR) {
+                continue;
+            }
+            if (result == -1) {
+                ThrowSystemError("pread", file_path_);
+            }
+            if (result == 0) {
+                break;
+            }
+            read_size += result;
+            if (is_direct_ && result % kBufferAlignment != 0) {
+                // the end of the file, the next offset wouldn't be aligned anyway
+                break;
+            }
+        }
+        return read_size;
+    }
+
     fs::path file_path_;
+    // size of the next block
     size_t block_size_;
-    std::optional<fs::ifstream> ifstream_{};
+    size_t max_block_size_;
+    ReadMode read_mode_;
+    uintmax_t file_size_;
+    uintmax_t offset_ = 0;
+    int fd_ = -1;
+    std::unique_ptr<char, FreeDeleter> buffer_{};
+    size_t buffer_size_ = 0;
+    void* mapping_ = nullptr;
+    // the file is open with O_DIRECT, the buffer holds window_size_ bytes read at window_offset_
+    bool is_direct_ = false;
+    uintmax_t window_offset_ = 0;
+    size_t window_size_ = 0;
 };
 
-FileBlockReader::FileBlockReader(fs::path file_path, size_t block_size)
-        : impl_(std::make_unique<FileBlockReaderImpl>(std::move(file_path), block_size)) {
+FileBlockReader::FileBlockReader(fs::path file_path, size_t block_size, ReadMode read_mode,
+                                 std::optional<uintmax_t> file_size, size_t max_block_size)
+        : impl_(std::make_unique<FileBlockReaderImpl>(
+                std::move(file_path), block_size, read_mode, file_size, max_block_size)) {
 }
 
 FileBlockReader::~FileBlockReader() = default;
@@ -48,7 +320,34 @@ std::string FileBlockReader::ReadNextBlock() {
     return impl_->ReadNextBlock();
 }
 
+std::string_view FileBlockReader::ReadNextBlockView() {
+    return impl_->ReadNextBlockView();
+}
+
+std::string_view FileBlockReader::ReadBlockView(uintmax_t offset, size_t size) {
+    return impl_->ReadBlockView(offset, size);
+}
+
+ReadRequest FileBlockReader::GetNextBlockRequest() {
+    return impl_->GetNextBlockRequest();
+}
+
+ReadRequest FileBlockReader::GetBlockRequest(uintmax_t offset, size_t size) {
+    return impl_->GetBlockRequest(offset, size);
+}
+
+void FileBlockReader::SkipNextBlock() {
+    impl_->SkipNextBlock();
+}
+
 bool FileBlockReader::IsEnd() const {
     return impl_->IsEnd();
 }
 
+void FileBlockReader::Close() {
+    impl_->Close();
+}
+
+bool FileBlockReader::IsOpen() const {
+    return impl_->IsOpen();
+}
@@ -1,22 +1,63 @@
 #pragma once
 #include <memory>
+#include <optional>
+#include <string_view>
 #include <boost/filesystem.hpp>
 
 namespace fs = boost::filesystem;
 
+enum class ReadMode {
+    kPread,  // pread into a reused aligned buffer
+    kMmap,   // whole file is mapped, blocks are views into the mapping; pread if its size changed since it was
+             // listed, a file truncated while it's mapped still raises SIGBUS
+    kIoUring,  // blocks of many files are read at once through io_uring, pread is used for single reads
+    kFadvise,  // pread with sequential readahead, the pages read are dropped from the page cache
+    kDirect,   // O_DIRECT reads past the page cache with a small readahead of its own, kFadvise where unsupported
+};
+
+// A read of size bytes at offset from an open file descriptor, made outside of the reader.
+struct ReadRequest {
+    int fd;
+    uintmax_t offset;
+    size_t size;
+};
+
+ReadMode GetReadMode(const std::string& read_mode);
+
+std::vector<std::string> GetPossibleReadModes();
+
+// Bytes of the file in the page cache, 0 if it can't be mapped.
+uintmax_t GetResidentBytes(const fs::path& file_path, uintmax_t file_size);
+
 class FileBlockReaderImpl;
 
 class FileBlockReader {
 public:
-    FileBlockReader(fs::path file_path, size_t block_size);
+    // file_size is used to detect the end of file, it is taken from the file system if not provided.
+    // If max_block_size is greater than block_size, every next block is twice as large up to it.
+    FileBlockReader(fs::path file_path, size_t block_size, ReadMode read_mode = ReadMode::kPread,
+                    std::optional<uintmax_t> file_size = std::nullopt, size_t max_block_size = 0);
     ~FileBlockReader();
 
+    // Returns a copy of the next block, the last block is padded with zeros up to its block size.
     std::string ReadNextBlock();
+    // Returns the next block without copying and padding, the view is valid until the next read.
+    std::string_view ReadNextBlockView();
+    // Returns size bytes at offset without moving to the next block, the view is valid until the next read.
+    // It may be shorter than requested if the file was truncated.
+    std::string_view ReadBlockView(uintmax_t offset, size_t size);
+    // Describe the reads of the next block and of size bytes at offset, opening the file if needed. The
+    // descriptor stays valid until the reader is closed. The next block is passed over with SkipNextBlock.
+    ReadRequest GetNextBlockRequest();
+    ReadRequest GetBlockRequest(uintmax_t offset, size_t size);
+    // Moves past the next block without reading it.
+    void SkipNextBlock();
     bool IsEnd() const;
 
+    // Releases the descriptor (and mapping), the next read reopens the file at the current offset.
+    void Close();
+    bool IsOpen() const;
+
 private:
     std::unique_ptr<FileBlockReaderImpl> impl_;
 };
-
-
-
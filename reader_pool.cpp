@@ -0,0 +1,116 @@
+#include "reader_pool.h"
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+class ReaderPoolImpl {
+public:
+    explicit ReaderPoolImpl(size_t max_open_readers) : max_open_readers_(max_open_readers) {
+        assert(max_open_readers_ > 0);
+    }
+
+    void Acquire(FileBlockReader& reader) {
+        std::lock_guard lock(mutex_);
+        auto [iter, inserted] = readers_.try_emplace(&reader, ReaderState{open_readers_.end(), 0});
+        auto& state = iter->second;
+        ++state.leases;
+        if (state.position != open_readers_.end()) {
+            ++stats_.hits;
+            open_readers_.splice(open_readers_.begin(), open_readers_, state.position);
+            return;
+        }
+        if (inserted) {
+            ++stats_.misses;
+        } else {
+            ++stats_.reopens;
+        }
+        EvictReaders(max_open_readers_ - 1);
+        open_readers_.push_front(&reader);
+        state.position = open_readers_.begin();
+        stats_.peak_open_readers = std::max(stats_.peak_open_readers, open_readers_.size());
+    }
+
+    void Unlease(FileBlockReader& reader) {
+        std::lock_guard lock(mutex_);
+        const auto iter = readers_.find(&reader);
+        if (iter != readers_.end() && --iter->second.leases == 0) {
+            // readers opened beyond the limit while others were leased are closed as soon as possible
+            EvictReaders(max_open_readers_);
+        }
+    }
+
+    void Release(FileBlockReader& reader) {
+        std::lock_guard lock(mutex_);
+        reader.Close();
+        const auto iter = readers_.find(&reader);
+        if (iter == readers_.end()) {
+            return;
+        }
+        assert(iter->second.leases == 0);
+        if (iter->second.position != open_readers_.end()) {
+            open_readers_.erase(iter->second.position);
+        }
+        readers_.erase(iter);
+    }
+
+    [[nodiscard]] ReaderPoolStats GetStats() const {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct ReaderState {
+        // position in open_readers_ or open_readers_.end() if the reader was closed by the pool
+        std::list<FileBlockReader*>::iterator position;
+        // leased readers are being read from and can't be closed
+        size_t leases;
+    };
+
+    // Closes least recently used readers until at most max_open_readers are open. Leased readers are
+    // skipped, so the limit may be exceeded by the number of concurrent reads.
+    void EvictReaders(size_t max_open_readers) {
+        auto iter = open_readers_.end();
+        while (open_readers_.size() > max_open_readers && iter != open_readers_.begin()) {
+            --iter;
+            auto& state = readers_.at(*iter);
+            if (state.leases > 0) {
+                continue;
+            }
+            (*iter)->Close();
+            state.position = open_readers_.end();
+            iter = open_readers_.erase(iter);
+        }
+    }
+
+    size_t max_open_readers_;
+    mutable std::mutex mutex_;
+    // most recently used readers go first
+    std::list<FileBlockReader*> open_readers_;
+    std::unordered_map<FileBlockReader*, ReaderState> readers_;
+    ReaderPoolStats stats_;
+};
+
+ReaderPool::ReaderPool(size_t max_open_readers) : impl_(std::make_unique<ReaderPoolImpl>(max_open_readers)) {
+}
+
+ReaderPool::~ReaderPool() = default;
+
+ReaderPool::Lease::~Lease() {
+    if (reader_pool_ != nullptr) {
+        reader_pool_->impl_->Unlease(*reader_);
+    }
+}
+
+ReaderPool::Lease ReaderPool::Acquire(FileBlockReader& reader) {
+    impl_->Acquire(reader);
+    return Lease(*this, reader);
+}
+
+void ReaderPool::Release(FileBlockReader& reader) {
+    impl_->Release(reader);
+}
+
+ReaderPoolStats ReaderPool::GetStats() const {
+    return impl_->GetStats();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <utility>
+#include "reader.h"
+
+struct ReaderPoolStats {
+    size_t hits = 0;     // the reader was still open
+    size_t misses = 0;   // the reader was opened for the first time
+    size_t reopens = 0;  // the reader was closed by the pool before and had to be opened again
+    size_t peak_open_readers = 0;
+};
+
+class ReaderPoolImpl;
+
+// Bounds the number of simultaneously open FileBlockReaders by closing the least recently used ones.
+// Closed readers keep their offset and are reopened transparently on the next read. Thread-safe.
+class ReaderPool {
+public:
+    // Keeps the reader from being closed by the pool while the lease is alive.
+    class Lease {
+    public:
+        Lease(ReaderPool& reader_pool, FileBlockReader& reader) : reader_pool_(&reader_pool), reader_(&reader) {
+        }
+        Lease(Lease&& other) noexcept
+                : reader_pool_(std::exchange(other.reader_pool_, nullptr)), reader_(other.reader_) {
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+    private:
+        ReaderPool* reader_pool_;
+        FileBlockReader* reader_;
+    };
+
+    explicit ReaderPool(size_t max_open_readers);
+    ~ReaderPool();
+
+    // Must be called before every read from the reader, the lease has to be held during the read.
+    [[nodiscard]] Lease Acquire(FileBlockReader& reader);
+    // Closes the reader and forgets it, must be called before the reader is destroyed.
+    void Release(FileBlockReader& reader);
+
+    [[nodiscard]] ReaderPoolStats GetStats() const;
+
+private:
+    std::unique_ptr<ReaderPoolImpl> impl_;
+};
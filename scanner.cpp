@@ -1,103 +1,961 @@
 #include "scanner.h"
+#include "arena.h"
+#include "external_sort.h"
 #include "hash.h"
+#include "hash_cache.h"
+#include "io_ring.h"
 #include "reader.h"
+#include "reader_pool.h"
+#include "thread_pool.h"
 #include "file_filter.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <iostream>
+#include <boost/container/small_vector.hpp>
 #include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
 #include <map>
+#include <set>
+#include <stdexcept>
+#include <unistd.h>
 
 
 
+// Blocks of this many bytes are hashed by one task when the files of a trie node are split between threads.
+static constexpr size_t kBytesPerTask = 1 << 20;
+// Verification of a group reads this many bytes of every file at a time, from at most kMaxVerifiedFiles files.
+static constexpr size_t kVerifyChunkSize = 64 << 10;
+static constexpr size_t kMaxVerifiedFiles = 64;
+
+static const std::map<std::string, GroupingEngine> kGroupingEngines = {
+        {"rounds", GroupingEngine::kRounds},
+        {"trie", GroupingEngine::kTrie},
+};
+
+GroupingEngine GetGroupingEngine(const std::string& grouping_engine) {
+    return kGroupingEngines.at(grouping_engine);
+}
+
+std::vector<std::string> GetPossibleGroupingEngines() {
+    std::vector<std::string> result;
+    std::transform(kGroupingEngines.begin(), kGroupingEngines.end(), std::back_inserter(result),
+            [](const auto& kv) { return kv.first; });
+    return result;
+}
+
+// Rings are not thread-safe, so every task reading through io_uring borrows one for the time of its reads.
+// Rings are created on demand, there are at most as many of them as threads.
+class IoRingPool {
+public:
+    IoRingPool(size_t queue_depth, size_t max_read_size)
+            : queue_depth_(queue_depth)
+            , max_read_size_(max_read_size) {
+    }
+
+    std::unique_ptr<IoRing> Acquire() {
+        {
+            std::lock_guard lock(mutex_);
+            if (!free_rings_.empty()) {
+                auto result = std::move(free_rings_.back());
+                free_rings_.pop_back();
+                return result;
+            }
+        }
+        return std::make_unique<IoRing>(queue_depth_, max_read_size_);
+    }
+
+    void Release(std::unique_ptr<IoRing> ring) {
+        std::lock_guard lock(mutex_);
+        free_rings_.push_back(std::move(ring));
+    }
+
+private:
+    size_t queue_depth_;
+    size_t max_read_size_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<IoRing>> free_rings_;
+};
+
+// Counters shared by the tries of a scan. Relaxed increments cost next to nothing compared to a read or a hash.
+struct ScanCounters {
+    std::atomic<uintmax_t> blocks_read{0};
+    std::atomic<uintmax_t> bytes_read{0};
+    std::atomic<uintmax_t> cached_blocks{0};
+    std::atomic<uintmax_t> trie_nodes{0};
+    std::atomic<uintmax_t> refine_rounds{0};
+    std::atomic<uintmax_t> groups{0};
+    std::atomic<uintmax_t> verified_bytes{0};
+    std::atomic<uintmax_t> split_groups{0};
+    std::atomic<uintmax_t> resident_bytes{0};
+    std::atomic<int64_t> verify_nanoseconds{0};
+    std::atomic<int64_t> read_nanoseconds{0};
+    std::atomic<int64_t> hash_nanoseconds{0};
+    // reading the clock around every block is not free, so it's only done on demand
+    bool measure_block_times = false;
+    bool measure_page_cache = false;
+};
+
+// Adds the time of its scope to the counter if enabled.
+class BlockTimer {
+public:
+    BlockTimer(std::atomic<int64_t>& nanoseconds, bool enabled)
+            : nanoseconds_(enabled ? &nanoseconds : nullptr)
+            , start_(enabled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point()) {
+    }
+
+    BlockTimer(const BlockTimer&) = delete;
+    BlockTimer& operator=(const BlockTimer&) = delete;
+
+    ~BlockTimer() {
+        if (nanoseconds_ != nullptr) {
+            const auto duration = std::chrono::steady_clock::now() - start_;
+            nanoseconds_->fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+                                    std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<int64_t>* nanoseconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+static double ToSeconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+// A file together with all the paths it is hard linked under, the first one is used for reading.
+struct LinkedFile {
+    FileInfo file_info;
+    std::vector<fs::path> paths;
+};
+
+// The read modes keeping the page cache as it was.
+static bool IsDroppingPages(ReadMode read_mode) {
+    return read_mode == ReadMode::kFadvise || read_mode == ReadMode::kDirect;
+}
+
+// Read mode of the readers reading a single block or a few sequential chunks: a mapping costs more than a
+// read then, and io_uring helps only with many reads in flight.
+static ReadMode GetSingleReadMode(ReadMode read_mode) {
+    return IsDroppingPages(read_mode) ? read_mode : ReadMode::kPread;
+}
+
+// Splits files of one size into classes of equal contents by reading them side by side and comparing the
+// bytes. A file which can't be read in full is a class of its own. Returns the indices of the paths. The
+// files are read through the reader pool, one lease at a time, so they count against its limit.
+static std::vector<std::vector<size_t>> SplitByContent(const std::vector<fs::path>& paths, uintmax_t size,
+                                                       ReadMode read_mode, ReaderPool& reader_pool,
+                                                       ScanCounters& counters) {
+    std::vector<std::vector<size_t>> result;
+    std::deque<FileBlockReader> readers;
+    std::vector<std::string> chunks;
+    std::vector<ssize_t> chunk_sizes;
+    for (size_t begin = 0; begin < paths.size(); begin += kMaxVerifiedFiles) {
+        // one file of every class found by the previous batches is read again, the new files join its class
+        std::vector<size_t> files;
+        for (const auto& file_class : result) {
+            files.push_back(file_class.front());
+        }
+        const size_t known_class_count = files.size();
+        for (size_t i = begin; i < std::min(begin + kMaxVerifiedFiles, paths.size()); ++i) {
+            files.push_back(i);
+        }
+        for (const auto file : files) {
+            readers.emplace_back(paths[file], kVerifyChunkSize, GetSingleReadMode(read_mode), size);
+        }
+        chunks.resize(files.size());
+        chunk_sizes.assign(files.size(), 0);
+        // positions in files, the classes of single files are not read anymore
+        std::vector<std::vector<size_t>> classes(1, std::vector<size_t>(files.size()));
+        std::iota(classes.front().begin(), classes.front().end(), 0);
+        for (auto& chunk : chunks) {
+            chunk.resize(kVerifyChunkSize);
+        }
+        for (uintmax_t offset = 0; offset < size && classes.size() < files.size(); offset += kVerifyChunkSize) {
+            const size_t chunk_size = std::min<uintmax_t>(kVerifyChunkSize, size - offset);
+            std::vector<std::vector<size_t>> next_classes;
+            for (auto& file_class : classes) {
+                if (file_class.size() == 1) {
+                    next_classes.push_back(std::move(file_class));
+                    continue;
+                }
+                for (const auto file : file_class) {
+                    if (chunk_sizes[file] == -1) {
+                        continue;
+                    }
+                    try {
+                        const auto lease = reader_pool.Acquire(readers[file]);
+                        const auto chunk = readers[file].ReadBlockView(offset, chunk_size);
+                        std::memcpy(chunks[file].data(), chunk.data(), chunk.size());
+                        chunk_sizes[file] = static_cast<ssize_t>(chunk.size());
+                    } catch (const fs::filesystem_error&) {
+                        chunk_sizes[file] = -1;
+                    }
+                    counters.verified_bytes.fetch_add(std::max<ssize_t>(chunk_sizes[file], 0),
+                                                      std::memory_order_relaxed);
+                }
+                const size_t first_next_class = next_classes.size();
+                for (const auto file : file_class) {
+                    const auto is_equal = [&](size_t other_file) {
+                        return chunk_sizes[file] == static_cast<ssize_t>(chunk_size)
+                               && chunk_sizes[other_file] == static_cast<ssize_t>(chunk_size)
+                               && std::memcmp(chunks[file].data(), chunks[other_file].data(), chunk_size) == 0;
+                    };
+                    const auto iter = std::find_if(
+                            next_classes.begin() + first_next_class, next_classes.end(),
+                            [&is_equal](const auto& next_class) { return is_equal(next_class.front()); });
+                    if (iter == next_classes.end()) {
+                        next_classes.push_back({file});
+                    } else {
+                        iter->push_back(file);
+                    }
+                }
+            }
+            classes = std::move(next_classes);
+        }
+        for (auto& reader : readers) {
+            reader_pool.Release(reader);
+        }
+        readers.clear();
+        for (const auto& file_class : classes) {
+            // files of different classes differ, so a class holds at most one file of a known class
+            const auto known_iter = std::find_if(file_class.begin(), file_class.end(),
+                                                 [known_class_count](size_t file) { return file < known_class_count; });
+            auto& result_class = known_iter == file_class.end() ? result.emplace_back() : result[*known_iter];
+            for (const auto file : file_class) {
+                if (file >= known_class_count) {
+                    result_class.push_back(files[file]);
+                }
+            }
+        }
+    }
+    return result;
+}
+
 class FileTrie {
 public:
-    FileTrie(size_t block_size, HashStrategy hash_strategy)
-        : block_size_(block_size), head_(std::make_shared<Node>()), hash_strategy_(hash_strategy) {
+    // All the files must be of the same size. Blocks grow from block_size up to max_block_size, if it's
+    // greater. Before reading sequentially, probe_count blocks are compared: the last one and evenly spaced
+    // ones in the middle. on_group is called from the refining threads. hash_cache may be null, then every
+    // block is read from the disk. Blocks of many files are read at once through io_ring_pool if it's not null.
+    // With verify_groups the files of every group are compared byte by byte before it is reported. Blocks of
+    // hash_batch_size files are read before they are hashed together by batch_hash_strategy. The rounds
+    // grouping engine refines the files level by level instead of node by node, see RefineInRounds.
+    FileTrie(size_t block_size, size_t max_block_size, size_t probe_count, HashStrategy hash_strategy,
+             BatchHashStrategy batch_hash_strategy, size_t hash_batch_size, ReadMode read_mode,
+             GroupingEngine grouping_engine, ReaderPool& reader_pool, ThreadPool& thread_pool, HashCache* hash_cache,
+             IoRingPool* io_ring_pool, bool verify_groups, ScanCounters& counters, FileGroupCallback on_group)
+        : block_size_(block_size)
+        , max_block_size_(max_block_size)
+        , probe_count_(probe_count)
+        , hash_strategy_(hash_strategy)
+        , batch_hash_strategy_(std::move(batch_hash_strategy))
+        , hash_batch_size_(hash_batch_size)
+        , digest_size_(hash_strategy_({}).size)
+        , read_mode_(read_mode)
+        , grouping_engine_(grouping_engine)
+        , reader_pool_(reader_pool)
+        , thread_pool_(thread_pool)
+        , hash_cache_(hash_cache)
+        , io_ring_pool_(io_ring_pool)
+        , verify_groups_(verify_groups)
+        , counters_(counters)
+        , on_group_(std::move(on_group))
+        , head_(nodes_.Allocate()) {
     }
 
-    void AddFile(const fs::path file_path) {
-        assert(files_to_handle_.empty());
-        AddFile(head_, std::make_shared<FileData>(file_path, block_size_));
-        HandleSavedFiles();
-        assert(files_to_handle_.empty());
+    ~FileTrie() {
+        // the rounds engine keeps only the head, its rounds are counted instead
+        if (grouping_engine_ == GroupingEngine::kTrie) {
+            counters_.trie_nodes.fetch_add(nodes_.Size(), std::memory_order_relaxed);
+        }
+        for (auto& file_data : file_data_) {
+            if (file_data.file_block_reader) {
+                reader_pool_.Release(*file_data.file_block_reader);
+            }
+        }
+        if (counters_.measure_page_cache) {
+            for (const auto& file_data : file_data_) {
+                if (file_data.is_read) {
+                    counters_.resident_bytes.fetch_add(GetResidentBytes(file_data.file_info.path,
+                                                                        file_data.file_info.size),
+                                                       std::memory_order_relaxed);
+                }
+            }
+        }
     }
 
-    std::vector<std::vector<fs::path>> GetEqualFileGroups() {
-        assert(files_to_handle_.empty());
-        std::vector<std::vector<fs::path>> result;
-        FindEqualFileGroups(head_, result);
-        return result;
+    // Blocks of the file are not read until the trie is refined. Files are read in the order of their
+    // physical offsets, files with equal offsets in the order they were added.
+    void AddFile(const LinkedFile& linked_file, uint64_t physical_offset = 0) {
+        assert(file_data_.size() < std::numeric_limits<FileIndex>::max());
+        if (file_data_.empty()) {
+            probe_offsets_ = GetProbeOffsets(linked_file.file_info.size);
+        }
+        assert(file_data_.empty() || file_data_.front().file_info.size == linked_file.file_info.size);
+        auto& file_data = file_data_.emplace_back(linked_file, block_size_, max_block_size_, read_mode_);
+        file_data.physical_offset = physical_offset;
+        if (hash_cache_ != nullptr) {
+            file_data.digests = hash_cache_->Lookup(linked_file.file_info);
+            file_data.cached_digests_size = file_data.digests.size();
+        }
+        nodes_[head_].files.push_back(static_cast<FileIndex>(file_data_.size() - 1));
+        nodes_[head_].needs_refinement = true;
+    }
+
+    // Reads the added files until they are told apart. Every group of equal files is reported as soon
+    // as its files are read to the end.
+    void Refine() {
+        if (!nodes_[head_].needs_refinement) {
+            return;
+        }
+        // files keep their relative order when they are moved between the nodes, so every batch of reads
+        // goes along the disk
+        auto& files = nodes_[head_].files;
+        std::stable_sort(files.begin(), files.end(), [this](FileIndex lhs, FileIndex rhs) {
+            return file_data_[lhs].physical_offset < file_data_[rhs].physical_offset;
+        });
+        if (grouping_engine_ == GroupingEngine::kRounds) {
+            RefineInRounds();
+            return;
+        }
+        TaskGroup task_group(thread_pool_);
+        task_group.Run([this, &task_group] { RefineNode(head_, task_group); });
+        task_group.Wait();
     }
 
 private:
+    using NodeIndex = uint32_t;
+    using FileIndex = uint32_t;
+
     struct FileData {
-        FileData(fs::path file_path, size_t block_size)
-                : file_path(file_path), file_block_reader(file_path, block_size) {
+        FileData(const LinkedFile& linked_file, size_t block_size, size_t max_block_size, ReadMode read_mode)
+                : file_info(linked_file.file_info)
+                , paths(linked_file.paths)
+                , file_block_reader(std::in_place, file_info.path, block_size, read_mode, file_info.size,
+                                    max_block_size) {
         }
 
-        fs::path file_path;
-        FileBlockReader file_block_reader;
+        FileInfo file_info;
+        std::vector<fs::path> paths;
+        // reset once the file is finished, it keeps a buffer while open
+        std::optional<FileBlockReader> file_block_reader;
+        // digests of the first blocks concatenated, taken from the hash cache and extended by the reads
+        std::string digests;
+        size_t cached_digests_size = 0;
+        // blocks hashed so far, probes included
+        size_t block_index = 0;
+        size_t probe_index = 0;
+        uint64_t physical_offset = 0;
+        // a block was read from the disk, not only taken from the hash cache
+        bool is_read = false;
     };
 
+    // A node holds the files whose blocks read so far are equal. Files which can't be told apart from the
+    // others yet (or were read to the end) stay at the node, the rest move to the next nodes by the hash
+    // of their next block. A node and its next nodes are only changed by the task refining the node.
+    // Nodes are only created where files differ, a run of equal blocks is one node.
     struct Node {
-        std::unordered_map<HashValue, std::shared_ptr<Node>> next_nodes;
-        std::set<std::shared_ptr<FileData>> file_data_set;
+        // hash of the first block leading to the node from its parent
+        HashValue hash;
+        // usually a node has one next node (equal blocks) or two, ordered by hash
+        boost::container::small_vector<NodeIndex, 2> next_nodes;
+        std::vector<FileIndex> files;
+        bool needs_refinement = false;
     };
 
-    void AddFile(std::shared_ptr<Node> node, const std::shared_ptr<FileData>& file_data) {
-        assert(file_data != nullptr);
-        while (!file_data->file_block_reader.IsEnd() &&
-                (!node->next_nodes.empty() || !node->file_data_set.empty())) {
-            for (auto iter = node->file_data_set.begin(); iter != node->file_data_set.end();) {
-                const auto node_file_data = *iter;
-                if (node_file_data->file_block_reader.IsEnd()) {
-                    // this file data is not going to be moved anywhere
-                    ++iter;
-                    continue;
+    // Files leaving a node together with the hashes of their next blocks.
+    struct MovingFiles {
+        NodeIndex node;
+        std::vector<FileIndex> files;
+        std::vector<HashValue> hashes;
+        std::atomic<size_t> pending_chunks{0};
+    };
+
+    void RefineNode(NodeIndex node_index, TaskGroup& task_group) {
+        auto& node = nodes_[node_index];
+        node.needs_refinement = false;
+        auto moving_files = ExtractMovingFiles(node_index);
+        FinishFiles(node.files);
+        if (moving_files == nullptr) {
+            return;
+        }
+        const size_t file_count = moving_files->files.size();
+        const size_t files_per_task = GetFilesPerTask(file_count);
+        const size_t chunk_count = (file_count + files_per_task - 1) / files_per_task;
+        if (chunk_count == 1) {
+            HashFiles(*moving_files, 0, file_count);
+            MoveFiles(*moving_files, task_group);
+            return;
+        }
+        // blocks are read and hashed by several tasks, the last one to finish moves the files
+        moving_files->pending_chunks = chunk_count;
+        for (size_t begin = 0; begin < file_count; begin += files_per_task) {
+            const size_t end = std::min(begin + files_per_task, file_count);
+            task_group.Run([this, moving_files, begin, end, &task_group] {
+                HashFiles(*moving_files, begin, end);
+                if (moving_files->pending_chunks.fetch_sub(1) == 1) {
+                    MoveFiles(*moving_files, task_group);
                 }
-                files_to_handle_.emplace(node, node_file_data);
-                iter = node->file_data_set.erase(iter);
+            });
+        }
+    }
+
+    size_t GetFilesPerTask(size_t file_count) const {
+        return thread_pool_.GetThreadCount() == 1 ? file_count : std::max<size_t>(1, kBytesPerTask / block_size_);
+    }
+
+    // The level-synchronous alternative to the trie. The live files are flat arrays of file indices and group
+    // ids in the order of reading. A round reads the next block of every live file, batched across the groups,
+    // and splits the groups by (group id, digest) with one sort. A file left alone in its group is finished, so
+    // are the groups read to the end: files of one size reach their ends in the same round.
+    void RefineInRounds() {
+        MovingFiles live;
+        live.node = head_;
+        live.files.swap(nodes_[head_].files);
+        std::vector<uint32_t> group_ids(live.files.size(), 0);
+        // positions of the live files ordered by group
+        std::vector<size_t> order(live.files.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::vector<FileIndex> finished_files;
+        std::vector<uint32_t> next_group_ids;
+        while (!live.files.empty()) {
+            std::vector<bool> is_live(live.files.size(), true);
+            for (size_t begin = 0; begin < order.size();) {
+                size_t end = begin + 1;
+                while (end < order.size() && group_ids[order[end]] == group_ids[order[begin]]) {
+                    ++end;
+                }
+                if (end - begin == 1 || file_data_[live.files[order[begin]]].file_block_reader->IsEnd()) {
+                    for (size_t i = begin; i < end; ++i) {
+                        finished_files.push_back(live.files[order[i]]);
+                        is_live[order[i]] = false;
+                    }
+                    FinishFiles(finished_files);
+                }
+                begin = end;
+            }
+            size_t live_count = 0;
+            for (size_t i = 0; i < live.files.size(); ++i) {
+                if (is_live[i]) {
+                    live.files[live_count] = live.files[i];
+                    group_ids[live_count] = group_ids[i];
+                    ++live_count;
+                }
+            }
+            live.files.resize(live_count);
+            group_ids.resize(live_count);
+            if (live_count == 0) {
+                break;
+            }
+
+            live.hashes.assign(live_count, HashValue());
+            HashRound(live);
+            counters_.refine_rounds.fetch_add(1, std::memory_order_relaxed);
+            order.resize(live_count);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&live, &group_ids](size_t lhs, size_t rhs) {
+                return group_ids[lhs] != group_ids[rhs] ? group_ids[lhs] < group_ids[rhs]
+                                                        : live.hashes[lhs] < live.hashes[rhs];
+            });
+            next_group_ids.resize(live_count);
+            uint32_t group_id = 0;
+            for (size_t i = 0; i < live_count; ++i) {
+                if (i > 0 && (group_ids[order[i]] != group_ids[order[i - 1]]
+                              || !(live.hashes[order[i]] == live.hashes[order[i - 1]]))) {
+                    ++group_id;
+                }
+                next_group_ids[order[i]] = group_id;
+            }
+            group_ids.swap(next_group_ids);
+        }
+    }
+
+    // Reads and hashes the next block of every file, the round ends when all of them are hashed.
+    void HashRound(MovingFiles& files) {
+        const size_t file_count = files.files.size();
+        const size_t files_per_task = GetFilesPerTask(file_count);
+        if (files_per_task >= file_count) {
+            HashFiles(files, 0, file_count);
+            return;
+        }
+        TaskGroup task_group(thread_pool_);
+        for (size_t begin = 0; begin < file_count; begin += files_per_task) {
+            const size_t end = std::min(begin + files_per_task, file_count);
+            task_group.Run([this, &files, begin, end] { HashFiles(files, begin, end); });
+        }
+        task_group.Wait();
+    }
+
+    // Takes the files which have to be read further out of the node: all of the unfinished files
+    // if the node has next nodes or more than one such file, none otherwise.
+    std::shared_ptr<MovingFiles> ExtractMovingFiles(NodeIndex node_index) {
+        auto& node = nodes_[node_index];
+        auto& files = node.files;
+        const auto unfinished_begin = std::stable_partition(files.begin(), files.end(),
+                [this](FileIndex file) { return file_data_[file].file_block_reader->IsEnd(); });
+        const auto unfinished_count = static_cast<size_t>(files.end() - unfinished_begin);
+        if (unfinished_count == 0 || (node.next_nodes.empty() && unfinished_count < 2)) {
+            return nullptr;
+        }
+        auto moving_files = std::make_shared<MovingFiles>();
+        moving_files->node = node_index;
+        moving_files->files.assign(unfinished_begin, files.end());
+        moving_files->hashes.resize(unfinished_count);
+        files.erase(unfinished_begin, files.end());
+        return moving_files;
+    }
+
+    // Probes are read before the sequential blocks and are a part of the digests too.
+    bool IsNextBlockProbe(const FileData& file_data) const {
+        return file_data.probe_index < probe_offsets_.size();
+    }
+
+    // Known digests are used instead of reading, returns nothing if the next block has to be read.
+    std::optional<HashValue> TakeKnownBlockHash(FileData& file_data) {
+        const size_t digest_offset = file_data.block_index * digest_size_;
+        if (digest_offset + digest_size_ > file_data.digests.size()) {
+            return std::nullopt;
+        }
+        const HashValue hash(file_data.digests.data() + digest_offset, digest_size_);
+        counters_.cached_blocks.fetch_add(1, std::memory_order_relaxed);
+        if (!IsNextBlockProbe(file_data)) {
+            file_data.file_block_reader->SkipNextBlock();
+        }
+        PassBlock(file_data);
+        return hash;
+    }
+
+    // Called once the next block is hashed, a sequential block must have been passed by the reader already.
+    // The digest is recorded if there is a hash cache.
+    void RecordBlockHash(FileData& file_data, const HashValue& hash) {
+        file_data.is_read = true;
+        if (hash_cache_ != nullptr) {
+            file_data.digests.append(reinterpret_cast<const char*>(hash.bytes.data()), hash.size);
+        }
+        PassBlock(file_data);
+    }
+
+    void PassBlock(FileData& file_data) {
+        if (IsNextBlockProbe(file_data)) {
+            ++file_data.probe_index;
+        }
+        ++file_data.block_index;
+        if (file_data.file_block_reader->IsEnd()) {
+            // nothing is going to be read from this file anymore
+            reader_pool_.Release(*file_data.file_block_reader);
+        }
+    }
+
+    HashValue ReadNextBlockHash(FileData& file_data) {
+        if (const auto hash = TakeKnownBlockHash(file_data)) {
+            return *hash;
+        }
+        auto& file_block_reader = *file_data.file_block_reader;
+        HashValue hash;
+        {
+            const auto lease = reader_pool_.Acquire(file_block_reader);
+            std::string_view block;
+            {
+                BlockTimer timer(counters_.read_nanoseconds, counters_.measure_block_times);
+                block = IsNextBlockProbe(file_data)
+                        ? file_block_reader.ReadBlockView(probe_offsets_[file_data.probe_index], block_size_)
+                        : file_block_reader.ReadNextBlockView();
             }
-            HashValue hash = hash_strategy_(file_data->file_block_reader.ReadNextBlock());
-            auto& next_node = node->next_nodes[hash];
-            if (next_node == nullptr) {
-                next_node = std::make_shared<Node>();
+            hash = HashBlock(block);
+        }
+        RecordBlockHash(file_data, hash);
+        return hash;
+    }
+
+    HashValue HashBlock(std::string_view block) {
+        counters_.blocks_read.fetch_add(1, std::memory_order_relaxed);
+        counters_.bytes_read.fetch_add(block.size(), std::memory_order_relaxed);
+        BlockTimer timer(counters_.hash_nanoseconds, counters_.measure_block_times);
+        return hash_strategy_(block);
+    }
+
+    // Files sharing a long prefix are often told apart by their ends. The first block is read first
+    // anyway, so only the files longer than two blocks are probed.
+    std::vector<uintmax_t> GetProbeOffsets(uintmax_t file_size) const {
+        std::vector<uintmax_t> result;
+        if (probe_count_ == 0 || file_size <= 2 * block_size_) {
+            return result;
+        }
+        result.push_back(file_size - block_size_);
+        const uintmax_t middle_size = file_size - 2 * block_size_;
+        for (size_t i = 1; i < probe_count_; ++i) {
+            result.push_back(block_size_ + middle_size * i / probe_count_);
+        }
+        return result;
+    }
+
+    void HashFiles(MovingFiles& moving_files, size_t begin, size_t end) {
+        if (io_ring_pool_ != nullptr) {
+            HashFilesAsync(moving_files, begin, end);
+            return;
+        }
+        if (hash_batch_size_ == 1) {
+            for (size_t i = begin; i < end; ++i) {
+                moving_files.hashes[i] = ReadNextBlockHash(file_data_[moving_files.files[i]]);
             }
-            node = next_node;
+            return;
+        }
+        for (size_t batch_begin = begin; batch_begin < end; batch_begin += hash_batch_size_) {
+            HashFilesInBatch(moving_files, batch_begin, std::min(batch_begin + hash_batch_size_, end));
         }
-        // reading blocks is not needed, place current file here
-        node->file_data_set.insert(file_data);
     }
 
-    void HandleSavedFiles() {
-        while (!files_to_handle_.empty()) {
-            auto [node, file_data] = files_to_handle_.top();
-            files_to_handle_.pop();
-            AddFile(node, file_data);
+    // The blocks which are not known are read first, the leases keep their views valid, and then they are
+    // hashed by one call of the batch strategy.
+    void HashFilesInBatch(MovingFiles& moving_files, size_t begin, size_t end) {
+        std::vector<size_t> unknown;
+        std::vector<std::string_view> blocks;
+        std::vector<ReaderPool::Lease> leases;
+        leases.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            auto& file_data = file_data_[moving_files.files[i]];
+            if (const auto hash = TakeKnownBlockHash(file_data)) {
+                moving_files.hashes[i] = *hash;
+                continue;
+            }
+            auto& file_block_reader = *file_data.file_block_reader;
+            leases.push_back(reader_pool_.Acquire(file_block_reader));
+            BlockTimer timer(counters_.read_nanoseconds, counters_.measure_block_times);
+            blocks.push_back(IsNextBlockProbe(file_data)
+                    ? file_block_reader.ReadBlockView(probe_offsets_[file_data.probe_index], block_size_)
+                    : file_block_reader.ReadNextBlockView());
+            unknown.push_back(i);
+        }
+        if (unknown.empty()) {
+            return;
+        }
+        std::vector<HashValue> hashes(unknown.size());
+        {
+            uintmax_t bytes = 0;
+            for (const auto block : blocks) {
+                bytes += block.size();
+            }
+            counters_.blocks_read.fetch_add(blocks.size(), std::memory_order_relaxed);
+            counters_.bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+            BlockTimer timer(counters_.hash_nanoseconds, counters_.measure_block_times);
+            batch_hash_strategy_(blocks.data(), blocks.size(), hashes.data());
+        }
+        leases.clear();
+        for (size_t i = 0; i < unknown.size(); ++i) {
+            RecordBlockHash(file_data_[moving_files.files[unknown[i]]], hashes[i]);
+            moving_files.hashes[unknown[i]] = hashes[i];
         }
     }
 
-    void FindEqualFileGroups(const std::shared_ptr<Node>& node, std::vector<std::vector<fs::path>>& result) {
-        assert(node != nullptr);
-        if (node->file_data_set.size() > 1) {
-            std::vector<fs::path> equal_group;
-            for (const auto& file_data : node->file_data_set) {
-                assert(file_data->file_block_reader.IsEnd());
-                equal_group.push_back(file_data->file_path);
+    // The blocks which are not known are read through a ring, up to its queue depth at once, and every one
+    // is hashed as soon as it arrives while the others are still being read.
+    void HashFilesAsync(MovingFiles& moving_files, size_t begin, size_t end) {
+        std::vector<size_t> unknown;
+        for (size_t i = begin; i < end; ++i) {
+            if (const auto hash = TakeKnownBlockHash(file_data_[moving_files.files[i]])) {
+                moving_files.hashes[i] = *hash;
+            } else {
+                unknown.push_back(i);
             }
-            result.push_back(std::move(equal_group));
         }
-        for (const auto& [_, next_node] : node->next_nodes) {
-            FindEqualFileGroups(next_node, result);
+        if (unknown.empty()) {
+            return;
+        }
+        auto ring = io_ring_pool_->Acquire();
+        // the files are kept open by the pool while their reads are in flight
+        std::vector<std::optional<ReaderPool::Lease>> leases(unknown.size());
+        ring->Read(unknown.size(),
+                [this, &moving_files, &unknown, &leases](size_t index) {
+                    auto& file_data = file_data_[moving_files.files[unknown[index]]];
+                    auto& file_block_reader = *file_data.file_block_reader;
+                    leases[index].emplace(reader_pool_.Acquire(file_block_reader));
+                    return IsNextBlockProbe(file_data)
+                            ? file_block_reader.GetBlockRequest(probe_offsets_[file_data.probe_index], block_size_)
+                            : file_block_reader.GetNextBlockRequest();
+                },
+                [this, &moving_files, &unknown, &leases](size_t index, int error, std::string_view data) {
+                    auto& file_data = file_data_[moving_files.files[unknown[index]]];
+                    leases[index].reset();
+                    if (error != 0) {
+                        throw fs::filesystem_error("read", file_data.file_info.path,
+                                boost::system::error_code(error, boost::system::system_category()));
+                    }
+                    const auto hash = HashBlock(data);
+                    if (!IsNextBlockProbe(file_data)) {
+                        file_data.file_block_reader->SkipNextBlock();
+                    }
+                    RecordBlockHash(file_data, hash);
+                    moving_files.hashes[unknown[index]] = hash;
+                });
+        io_ring_pool_->Release(std::move(ring));
+    }
+
+    // Files staying at a node after the moving ones were taken out, or finished by a round, are not read
+    // anymore. Files of the same size reach their ends together, so more than one of them is a group of equal
+    // files. A single file is never read, but it makes a group on its own if it has several hard links.
+    void FinishFiles(std::vector<FileIndex>& files) {
+        if (verify_groups_ && files.size() > 1) {
+            // equal digests of a weak hash may still hide different files
+            const auto verify_start = std::chrono::steady_clock::now();
+            std::vector<fs::path> paths;
+            for (const auto file : files) {
+                paths.push_back(file_data_[file].file_info.path);
+            }
+            const auto file_classes = SplitByContent(paths, file_data_[files.front()].file_info.size,
+                                                     read_mode_, reader_pool_, counters_);
+            counters_.verify_nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - verify_start).count(), std::memory_order_relaxed);
+            if (file_classes.size() > 1) {
+                counters_.split_groups.fetch_add(1, std::memory_order_relaxed);
+            }
+            for (const auto& file_class : file_classes) {
+                std::vector<FileIndex> class_files;
+                for (const auto index : file_class) {
+                    class_files.push_back(files[index]);
+                }
+                ReportGroup(class_files);
+            }
+        } else {
+            ReportGroup(files);
+        }
+        for (const auto file : files) {
+            auto& file_data = file_data_[file];
+            if (hash_cache_ != nullptr && file_data.digests.size() > file_data.cached_digests_size) {
+                hash_cache_->Store(file_data.file_info, std::move(file_data.digests));
+            }
+            reader_pool_.Release(*file_data.file_block_reader);
+            file_data.file_block_reader.reset();
+            std::string().swap(file_data.digests);
+            std::vector<fs::path>().swap(file_data.paths);
+        }
+        std::vector<FileIndex>().swap(files);
+    }
+
+    void ReportGroup(const std::vector<FileIndex>& files) {
+        if (files.size() > 1 || (!files.empty() && file_data_[files.front()].paths.size() > 1)) {
+            std::vector<std::pair<fs::path, size_t>> paths;
+            for (size_t i = 0; i < files.size(); ++i) {
+                const auto& file_data = file_data_[files[i]];
+                assert(files.size() == 1 || file_data.file_block_reader->IsEnd());
+                for (const auto& path : file_data.paths) {
+                    paths.emplace_back(path, i);
+                }
+            }
+            std::sort(paths.begin(), paths.end());
+            FileGroup file_group{file_data_[files.front()].file_info.size, {}, {}};
+            for (auto& [path, link_id] : paths) {
+                file_group.paths.push_back(std::move(path));
+                file_group.link_ids.push_back(link_id);
+            }
+            counters_.groups.fetch_add(1, std::memory_order_relaxed);
+            on_group_(std::move(file_group));
+        }
+    }
+
+    // Finds the next node by the hash of the block leading to it, creates the node if there is none.
+    NodeIndex GetNextNode(Node& node, const HashValue& hash) {
+        const auto iter = std::lower_bound(node.next_nodes.begin(), node.next_nodes.end(), hash,
+                [this](NodeIndex next_node, const HashValue& hash) { return nodes_[next_node].hash < hash; });
+        if (iter != node.next_nodes.end() && nodes_[*iter].hash == hash) {
+            return *iter;
+        }
+        const NodeIndex next_node = nodes_.Allocate();
+        nodes_[next_node].hash = hash;
+        node.next_nodes.insert(iter, next_node);
+        return next_node;
+    }
+
+    void MoveFiles(MovingFiles& moving_files, TaskGroup& task_group) {
+        auto& node = nodes_[moving_files.node];
+        // equal hashes are grouped by sorting, files keep their order within a group
+        std::vector<size_t> order(moving_files.files.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&moving_files](size_t lhs, size_t rhs) {
+            return moving_files.hashes[lhs] < moving_files.hashes[rhs];
+        });
+        if (node.next_nodes.empty() && moving_files.hashes[order.front()] == moving_files.hashes[order.back()]) {
+            // the files are still equal, so the node stands for one more block instead of getting a single
+            // next node: chains of equal blocks don't cost a node per block
+            node.files = std::move(moving_files.files);
+            node.needs_refinement = true;
+            task_group.Run([this, node_index = moving_files.node, &task_group] {
+                RefineNode(node_index, task_group);
+            });
+            return;
+        }
+        std::vector<NodeIndex> changed_nodes;
+        for (size_t begin = 0; begin < order.size();) {
+            const auto& hash = moving_files.hashes[order[begin]];
+            size_t end = begin + 1;
+            while (end < order.size() && moving_files.hashes[order[end]] == hash) {
+                ++end;
+            }
+            const NodeIndex next_node_index = GetNextNode(node, hash);
+            auto& next_node = nodes_[next_node_index];
+            for (size_t i = begin; i < end; ++i) {
+                next_node.files.push_back(moving_files.files[order[i]]);
+            }
+            if (!next_node.needs_refinement) {
+                next_node.needs_refinement = true;
+                changed_nodes.push_back(next_node_index);
+            }
+            begin = end;
+        }
+        for (const auto next_node : changed_nodes) {
+            task_group.Run([this, next_node, &task_group] { RefineNode(next_node, task_group); });
         }
     }
 
     size_t block_size_;
-    std::shared_ptr<Node> head_;
+    size_t max_block_size_;
+    size_t probe_count_;
+    std::vector<uintmax_t> probe_offsets_;
     HashStrategy hash_strategy_;
-    std::stack<std::pair<std::shared_ptr<Node>, std::shared_ptr<FileData>>> files_to_handle_;
+    BatchHashStrategy batch_hash_strategy_;
+    size_t hash_batch_size_;
+    size_t digest_size_;
+    ReadMode read_mode_;
+    GroupingEngine grouping_engine_;
+    ReaderPool& reader_pool_;
+    ThreadPool& thread_pool_;
+    HashCache* hash_cache_;
+    IoRingPool* io_ring_pool_;
+    bool verify_groups_;
+    ScanCounters& counters_;
+    FileGroupCallback on_group_;
+    // only appended to before the refinement starts
+    std::deque<FileData> file_data_;
+    Arena<Node> nodes_;
+    NodeIndex head_;
 };
 
+// Collapses the paths of one inode into one file, its contents don't have to be read more than once.
+std::vector<LinkedFile> GroupHardLinks(std::vector<FileInfo> file_infos) {
+    std::vector<LinkedFile> result;
+    std::unordered_map<std::pair<uint64_t, uint64_t>, size_t, boost::hash<std::pair<uint64_t, uint64_t>>> indices;
+    for (auto& file_info : file_infos) {
+        const auto [iter, inserted] = indices.try_emplace({file_info.device, file_info.inode}, result.size());
+        if (inserted) {
+            auto path = file_info.path;
+            result.push_back({std::move(file_info), {std::move(path)}});
+        } else {
+            result[iter->second].paths.push_back(std::move(file_info.path));
+        }
+    }
+    return result;
+}
+
+size_t CountPaths(const std::vector<LinkedFile>& linked_files) {
+    size_t result = 0;
+    for (const auto& linked_file : linked_files) {
+        result += linked_file.paths.size();
+    }
+    return result;
+}
+
+// Buckets files by size and drops the buckets with a single path, they have no candidates to be compared with.
+std::map<uintmax_t, std::vector<LinkedFile>> GroupFilesBySize(std::vector<LinkedFile> linked_files) {
+    std::map<uintmax_t, std::vector<LinkedFile>> result;
+    for (auto& linked_file : linked_files) {
+        result[linked_file.file_info.size].push_back(std::move(linked_file));
+    }
+    for (auto iter = result.begin(); iter != result.end();) {
+        if (CountPaths(iter->second) < 2) {
+            iter = result.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    return result;
+}
+
+// Memory taken by a file from its listing to the end of its refinement, roughly: the file info, the file data
+// and the reader in the trie, without the block buffers of the open readers which are capped separately.
+static size_t EstimateMemory(const std::vector<LinkedFile>& linked_files) {
+    static constexpr size_t kFileMemory = 512;
+    size_t result = 0;
+    for (const auto& linked_file : linked_files) {
+        result += kFileMemory;
+        for (const auto& path : linked_file.paths) {
+            result += 2 * path.native().size();
+        }
+    }
+    return result;
+}
+
+// Streams the sorted records as groups of candidate files: of one size and key, with the hard links collapsed
+// and at least two paths. Files and paths are in the order GroupHardLinks gives them, so the groups found
+// are the same as in memory. Returns the number of distinct paths.
+static size_t ForEachCandidateGroup(ExternalSorter& sorter,
+                                    const std::function<void(std::vector<LinkedFile>)>& on_group) {
+    size_t path_count = 0;
+    std::vector<LinkedFile> group;
+    std::string group_key;
+    size_t group_path_count = 0;
+    const auto finish_group = [&group, &group_path_count, &on_group] {
+        if (group_path_count > 1) {
+            std::sort(group.begin(), group.end(), [](const LinkedFile& lhs, const LinkedFile& rhs) {
+                return lhs.paths.front() < rhs.paths.front();
+            });
+            on_group(std::move(group));
+        }
+        group.clear();
+        group_path_count = 0;
+    };
+    sorter.Merge([&](SpillRecord record) {
+        auto& file_info = record.file_info;
+        if (!group.empty() && (file_info.size != group.front().file_info.size || record.key != group_key)) {
+            finish_group();
+        }
+        if (!group.empty() && group.back().file_info.device == file_info.device
+                && group.back().file_info.inode == file_info.inode) {
+            // a file reached through several include directories or symlinks comes several times
+            if (group.back().paths.back() == file_info.path) {
+                return;
+            }
+            group.back().paths.push_back(std::move(file_info.path));
+        } else {
+            if (group.empty()) {
+                group_key = std::move(record.key);
+            }
+            auto path = file_info.path;
+            group.push_back({std::move(file_info), {std::move(path)}});
+        }
+        ++path_count;
+        ++group_path_count;
+    });
+    finish_group();
+    return path_count;
+}
+
+// Throws std::invalid_argument for the options the scanner can't work with.
+static ScannerOptions CheckOptions(ScannerOptions options) {
+    if (options.max_open_files == 0) {
+        throw std::invalid_argument("max_open_files must be positive");
+    }
+    return options;
+}
+
+// Sizes are mixed before taking the remainder, so that sizes which are multiples of a block spread evenly.
+static bool IsInShard(uintmax_t size, const ScannerOptions& options) {
+    uint64_t mixed = size;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    mixed ^= mixed >> 31;
+    return mixed % options.shard_count == options.shard_index;
+}
 
 class ScannerImpl {
 public:
@@ -108,7 +966,8 @@ public:
             int min_file_size,
             std::vector<std::string> file_masks,
             int block_size,
-            std::string hash_algorithm)
+            std::string hash_algorithm,
+            ScannerOptions options)
             : file_filter_(
                     std::move(include_directories),
                     std::move(exclude_directories),
@@ -116,22 +975,497 @@ public:
                     min_file_size,
                     std::move(file_masks))
             , block_size_(block_size)
-            , hash_algorithm_(std::move(hash_algorithm)) {
+            , hash_algorithm_(std::move(hash_algorithm))
+            , options_(CheckOptions(std::move(options)))
+            , reader_pool_(options_.max_open_files)
+            , thread_pool_(options_.thread_count) {
         std::ignore = std::make_tuple(block_size_);
+        assert(options_.shard_index < options_.shard_count);
+        if (!options_.trace_path.empty()) {
+            tracer_ = std::make_unique<Tracer>();
+        }
+        for (const auto& directory : options_.physical_order_directories) {
+            // the same form as the paths of the files found by the filter
+            physical_order_directories_.push_back(fs::canonical(fs::absolute(directory)));
+        }
+        if (options_.read_mode == ReadMode::kIoUring) {
+            if (IsIoRingSupported()) {
+                // every lease of a read in flight keeps a file open, and every thread has a ring of its own
+                const size_t queue_depth = std::clamp<size_t>(options_.queue_depth, 1, GetOpenFilesPerThread());
+                io_ring_pool_ = std::make_unique<IoRingPool>(
+                        queue_depth, std::max<size_t>(block_size_, options_.max_block_size));
+            } else {
+                // the blocks are read by pread, in parallel if there are several threads
+                options_.read_mode = ReadMode::kPread;
+            }
+        }
+        if (!options_.hash_cache_path.empty()) {
+            hash_cache_ = std::make_unique<HashCache>(options_.hash_cache_path, block_size_,
+                                                      std::max<size_t>(block_size_, options_.max_block_size),
+                                                      options_.probe_count,
+                                                      ResolveHashAlgorithm(hash_algorithm_),
+                                                      options_.hash_cache_max_size);
+        }
     }
 
-    [[nodiscard]] std::vector<std::vector<fs::path>> FindEqualFileGroups() const {
-        FileTrie file_trie(block_size_, GetHashStrategy(hash_algorithm_));
-        for (const auto& file_path : file_filter_.FilterFiles()) {
-            file_trie.AddFile(file_path);
+    void FindEqualFileGroups(const FileGroupCallback& on_group) const {
+        ScanStats stats;
+        ScanCounters counters;
+        counters.measure_block_times = options_.measure_block_times;
+        counters.measure_page_cache = options_.measure_page_cache;
+        std::mutex on_group_mutex;
+        const FileGroupCallback on_group_locked = [&on_group, &on_group_mutex](FileGroup file_group) {
+            std::lock_guard lock(on_group_mutex);
+            on_group(std::move(file_group));
+        };
+        if (options_.memory_budget > 0) {
+            FindGroupsExternally(on_group_locked, counters, stats);
+        } else {
+            FindGroupsInMemory(on_group_locked, counters, stats);
+        }
+        AddCounters(counters, stats);
+
+        if (hash_cache_ != nullptr) {
+            const auto phase_start = std::chrono::steady_clock::now();
+            TraceSpan span(tracer_.get(), "save hash cache");
+            hash_cache_->Save();
+            stats.save_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
         }
-        return file_trie.GetEqualFileGroups();
+        AddScanStats(stats);
+        WriteTrace();
+    }
+
+    [[nodiscard]] ReaderPoolStats GetReaderPoolStats() const {
+        return reader_pool_.GetStats();
+    }
+
+    [[nodiscard]] ScanStats GetScanStats() const {
+        std::lock_guard lock(stats_mutex_);
+        return stats_;
+    }
+
+    [[nodiscard]] HashCacheStats GetHashCacheStats() const {
+        return hash_cache_ != nullptr ? hash_cache_->GetStats() : HashCacheStats{};
+    }
+
+    void BuildIndex() {
+        if (hash_cache_ == nullptr) {
+            // keeps the digests of the unchanged files while their sizes are refined again
+            hash_cache_ = std::make_unique<HashCache>(fs::path(), block_size_,
+                                                      std::max<size_t>(block_size_, options_.max_block_size),
+                                                      options_.probe_count, ResolveHashAlgorithm(hash_algorithm_),
+                                                      options_.hash_cache_max_size);
+        }
+        indexed_files_.clear();
+        indexed_sizes_.clear();
+        indexed_inodes_.clear();
+        indexed_groups_.clear();
+        changed_sizes_.clear();
+        const auto phase_start = std::chrono::steady_clock::now();
+        std::vector<FileInfo> file_infos;
+        {
+            TraceSpan span(tracer_.get(), "list files");
+            file_infos = file_filter_.FilterFileInfos(thread_pool_);
+        }
+        ScanStats stats;
+        stats.files_listed = file_infos.size();
+        stats.list_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
+        AddScanStats(stats);
+        for (auto& file_info : file_infos) {
+            IndexFile(std::move(file_info));
+        }
+        RefineChangedSizes();
+        if (!options_.hash_cache_path.empty()) {
+            TraceSpan span(tracer_.get(), "save hash cache");
+            hash_cache_->Save();
+        }
+    }
+
+    void AddFile(const fs::path& path) {
+        auto file_info = file_filter_.CheckFile(path);
+        // a write through one path changes the file under all of its hard links, but only that path has an event
+        std::set<fs::path> linked_paths;
+        if (const auto iter = indexed_files_.find(path); iter != indexed_files_.end()) {
+            const auto& paths = indexed_inodes_[{iter->second.device, iter->second.inode}];
+            linked_paths.insert(paths.begin(), paths.end());
+        }
+        if (file_info) {
+            if (const auto iter = indexed_inodes_.find({file_info->device, file_info->inode});
+                    iter != indexed_inodes_.end()) {
+                linked_paths.insert(iter->second.begin(), iter->second.end());
+            }
+        }
+        linked_paths.erase(path);
+        UpdateFile(path, std::move(file_info));
+        for (const auto& linked_path : linked_paths) {
+            UpdateFile(linked_path, file_filter_.CheckFile(linked_path));
+        }
+    }
+
+    void RemoveFile(const fs::path& path) {
+        if (const auto iter = indexed_files_.find(path); iter != indexed_files_.end()) {
+            UnindexFile(iter);
+        }
+    }
+
+    void RemoveDirectory(const fs::path& directory) {
+        // paths compare by their elements, so the ones under the directory come right after it
+        for (auto iter = indexed_files_.upper_bound(directory);
+             iter != indexed_files_.end() && IsInDirectory(directory, iter->first);) {
+            iter = UnindexFile(iter);
+        }
+    }
+
+    [[nodiscard]] std::vector<FileGroup> GetIndexedGroups() {
+        RefineChangedSizes();
+        WriteTrace();
+        std::vector<FileGroup> result;
+        for (const auto& [_, file_groups] : indexed_groups_) {
+            result.insert(result.end(), file_groups.begin(), file_groups.end());
+        }
+        return result;
     }
 
 private:
+    // writes the spans since the previous write and drops them, so watch mode keeps a bounded trace
+    void WriteTrace() const {
+        if (tracer_ != nullptr) {
+            tracer_->Write(options_.trace_path);
+            tracer_->Clear();
+        }
+    }
+
+    void FindGroupsInMemory(const FileGroupCallback& on_group, ScanCounters& counters, ScanStats& stats) const {
+        auto phase_start = std::chrono::steady_clock::now();
+        std::vector<FileInfo> file_infos;
+        {
+            TraceSpan span(tracer_.get(), "list files");
+            file_infos = file_filter_.FilterFileInfos(thread_pool_);
+        }
+        stats.files_listed = file_infos.size();
+        if (options_.shard_count > 1) {
+            file_infos.erase(std::remove_if(file_infos.begin(), file_infos.end(), [this](const FileInfo& file_info) {
+                return !IsInShard(file_info.size, options_);
+            }), file_infos.end());
+        }
+        std::map<uintmax_t, std::vector<LinkedFile>> size_buckets;
+        {
+            TraceSpan span(tracer_.get(), "group by size");
+            size_buckets = GroupFilesBySize(GroupHardLinks(std::move(file_infos)));
+        }
+        stats.size_buckets = size_buckets.size();
+        for (const auto& [_, linked_files] : size_buckets) {
+            stats.candidate_files += linked_files.size();
+        }
+        stats.list_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
+
+        phase_start = std::chrono::steady_clock::now();
+        TaskGroup task_group(thread_pool_);
+        for (const auto& [_, linked_files] : size_buckets) {
+            // files of different sizes can't be equal, so every size bucket is scanned by its own trie
+            task_group.Run([this, &linked_files = linked_files, &on_group, &counters] {
+                RefineFiles(linked_files, on_group, counters);
+            });
+        }
+        task_group.Wait();
+        stats.refine_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
+    }
+
+    // The listed files are sorted by size on the disk, and the candidate groups are refined in batches fitting
+    // in a quarter of the memory budget, while half of it is left to the sorters. Sizes with more files than
+    // a batch takes are split by the digests of their first blocks, which are sorted on the disk again. A
+    // group of files sharing the size and the first block is refined at once however large it is.
+    void FindGroupsExternally(const FileGroupCallback& on_group, ScanCounters& counters, ScanStats& stats) const {
+        auto phase_start = std::chrono::steady_clock::now();
+        const auto spill_directory = options_.spill_directory.empty() ? fs::temp_directory_path()
+                                                                      : options_.spill_directory;
+        const size_t batch_budget = std::max<size_t>(options_.memory_budget / 4, 1);
+        ExternalSorter size_sorter(spill_directory, std::max<size_t>(options_.memory_budget / 2, 1));
+        ExternalSorter digest_sorter(spill_directory, batch_budget);
+        {
+            TraceSpan span(tracer_.get(), "list files");
+            file_filter_.FilterFileInfos(thread_pool_, [this, &size_sorter, &stats](FileInfo file_info) {
+                if (IsInShard(file_info.size, options_)) {
+                    size_sorter.Add({std::move(file_info), {}});
+                } else {
+                    ++stats.files_listed;
+                }
+            });
+        }
+        stats.list_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
+
+        phase_start = std::chrono::steady_clock::now();
+        std::vector<std::vector<LinkedFile>> batch;
+        size_t batch_memory = 0;
+        const auto refine_batch = [this, &batch, &batch_memory, &on_group, &counters] {
+            TaskGroup task_group(thread_pool_);
+            for (const auto& linked_files : batch) {
+                task_group.Run([this, &linked_files, &on_group, &counters] {
+                    RefineFiles(linked_files, on_group, counters);
+                });
+            }
+            task_group.Wait();
+            batch.clear();
+            batch_memory = 0;
+        };
+        const auto add_to_batch = [&](std::vector<LinkedFile> linked_files, size_t memory) {
+            if (!batch.empty() && batch_memory + memory > batch_budget) {
+                refine_batch();
+            }
+            batch.push_back(std::move(linked_files));
+            batch_memory += memory;
+        };
+        bool has_digests = false;
+        stats.files_listed += ForEachCandidateGroup(size_sorter, [&](std::vector<LinkedFile> linked_files) {
+            ++stats.size_buckets;
+            stats.candidate_files += linked_files.size();
+            const size_t memory = EstimateMemory(linked_files);
+            if (memory <= batch_budget) {
+                add_to_batch(std::move(linked_files), memory);
+            } else {
+                SpillFirstBlockDigests(linked_files, digest_sorter, counters);
+                has_digests = true;
+            }
+        });
+        if (has_digests) {
+            ForEachCandidateGroup(digest_sorter, [&](std::vector<LinkedFile> linked_files) {
+                const size_t memory = EstimateMemory(linked_files);
+                add_to_batch(std::move(linked_files), memory);
+            });
+        }
+        refine_batch();
+        stats.spill_runs = size_sorter.GetRunCount() + digest_sorter.GetRunCount();
+        stats.refine_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
+    }
+
+    // The share of max_open_files each thread may keep open at once, at least 1.
+    [[nodiscard]] size_t GetOpenFilesPerThread() const {
+        return std::max<size_t>(options_.max_open_files / std::max<size_t>(options_.thread_count, 1), 1);
+    }
+
+    // Every thread hashing a batch holds a lease per file of it, so the batch is cut down for all the threads to
+    // stay within max_open_files.
+    [[nodiscard]] size_t GetClampedHashBatchSize() const {
+        return std::min(GetOpenFilesPerThread(), GetHashBatchSize(hash_algorithm_));
+    }
+
+    // Scans the files of one size by their own trie: files of different sizes can't be equal.
+    void RefineFiles(const std::vector<LinkedFile>& linked_files, const FileGroupCallback& on_group,
+                     ScanCounters& counters) const {
+        TraceSpan span(tracer_.get(), "refine size bucket", tracer_ == nullptr ? std::string() : (
+                boost::format("\"size\":%1%,\"files\":%2%")
+                        % linked_files.front().file_info.size % linked_files.size()).str());
+        FileTrie file_trie(block_size_, options_.max_block_size, options_.probe_count,
+                           GetHashStrategy(hash_algorithm_), GetBatchHashStrategy(hash_algorithm_),
+                           GetClampedHashBatchSize(), options_.read_mode, options_.grouping_engine,
+                           reader_pool_, thread_pool_, hash_cache_.get(), io_ring_pool_.get(),
+                           options_.verify_groups, counters, on_group);
+        for (const auto& linked_file : linked_files) {
+            file_trie.AddFile(linked_file, IsInPhysicalOrderDirectory(linked_file.file_info.path)
+                    ? GetPhysicalOffset(linked_file.file_info)
+                    : 0);
+        }
+        file_trie.Refine();
+    }
+
+    // Keys every path of the files with the digest of the first block. Files differing there can't be equal,
+    // so a size too crowded to be refined at once falls apart into smaller groups.
+    void SpillFirstBlockDigests(const std::vector<LinkedFile>& linked_files, ExternalSorter& sorter,
+                                ScanCounters& counters) const {
+        TraceSpan span(tracer_.get(), "spill first block digests", tracer_ == nullptr ? std::string() : (
+                boost::format("\"size\":%1%,\"files\":%2%")
+                        % linked_files.front().file_info.size % linked_files.size()).str());
+        const auto hash_strategy = GetHashStrategy(hash_algorithm_);
+        const size_t block_size = std::min<uintmax_t>(block_size_, linked_files.front().file_info.size);
+        const size_t files_per_task = std::max<size_t>(kBytesPerTask / std::max<size_t>(block_size, 1), 1);
+        std::mutex sorter_mutex;
+        TaskGroup task_group(thread_pool_);
+        for (size_t begin = 0; begin < linked_files.size(); begin += files_per_task) {
+            const size_t end = std::min(begin + files_per_task, linked_files.size());
+            task_group.Run([&, begin, end] {
+                for (size_t i = begin; i < end; ++i) {
+                    const auto& file_info = linked_files[i].file_info;
+                    FileBlockReader reader(file_info.path, block_size_, GetSingleReadMode(options_.read_mode),
+                                           file_info.size);
+                    const auto block = reader.ReadBlockView(0, block_size);
+                    counters.blocks_read.fetch_add(1, std::memory_order_relaxed);
+                    counters.bytes_read.fetch_add(block.size(), std::memory_order_relaxed);
+                    const auto hash = hash_strategy(block);
+                    std::string key(reinterpret_cast<const char*>(hash.bytes.data()), hash.size);
+                    std::lock_guard lock(sorter_mutex);
+                    for (const auto& path : linked_files[i].paths) {
+                        auto path_info = file_info;
+                        path_info.path = path;
+                        sorter.Add({std::move(path_info), key});
+                    }
+                }
+            });
+        }
+        task_group.Wait();
+    }
+
+    // The file is kept if it's unchanged.
+    void UpdateFile(const fs::path& path, std::optional<FileInfo> file_info) {
+        if (const auto iter = indexed_files_.find(path); iter != indexed_files_.end()) {
+            const auto& indexed_file_info = iter->second;
+            if (file_info && file_info->device == indexed_file_info.device
+                    && file_info->inode == indexed_file_info.inode && file_info->size == indexed_file_info.size
+                    && file_info->mtime_ns == indexed_file_info.mtime_ns) {
+                return;
+            }
+            UnindexFile(iter);
+        }
+        if (file_info) {
+            IndexFile(std::move(*file_info));
+        }
+    }
+
+    void IndexFile(FileInfo file_info) {
+        changed_sizes_.insert(file_info.size);
+        indexed_sizes_[file_info.size].insert(file_info.path);
+        indexed_inodes_[{file_info.device, file_info.inode}].insert(file_info.path);
+        auto path = file_info.path;
+        indexed_files_.insert_or_assign(std::move(path), std::move(file_info));
+    }
+
+    std::map<fs::path, FileInfo>::iterator UnindexFile(std::map<fs::path, FileInfo>::iterator iter) {
+        const auto& [path, file_info] = *iter;
+        changed_sizes_.insert(file_info.size);
+        const auto size_iter = indexed_sizes_.find(file_info.size);
+        size_iter->second.erase(path);
+        if (size_iter->second.empty()) {
+            indexed_sizes_.erase(size_iter);
+        }
+        const auto inode_iter = indexed_inodes_.find({file_info.device, file_info.inode});
+        inode_iter->second.erase(path);
+        // the digests stay while another path still sees this version of the file
+        const bool is_version_indexed = std::any_of(inode_iter->second.begin(), inode_iter->second.end(),
+                [this, &file_info = file_info](const fs::path& linked_path) {
+                    const auto& linked_file_info = indexed_files_.at(linked_path);
+                    return linked_file_info.size == file_info.size && linked_file_info.mtime_ns == file_info.mtime_ns;
+                });
+        if (!is_version_indexed && hash_cache_ != nullptr) {
+            hash_cache_->Erase(file_info);
+        }
+        if (inode_iter->second.empty()) {
+            indexed_inodes_.erase(inode_iter);
+        }
+        return indexed_files_.erase(iter);
+    }
+
+    // Refines every changed size by its own trie, the files of the other sizes are not read.
+    void RefineChangedSizes() {
+        const auto phase_start = std::chrono::steady_clock::now();
+        ScanStats stats;
+        ScanCounters counters;
+        counters.measure_block_times = options_.measure_block_times;
+        counters.measure_page_cache = options_.measure_page_cache;
+        std::vector<std::vector<LinkedFile>> size_buckets;
+        for (const auto size : changed_sizes_) {
+            indexed_groups_.erase(size);
+            const auto iter = indexed_sizes_.find(size);
+            if (iter == indexed_sizes_.end() || iter->second.size() < 2) {
+                continue;
+            }
+            std::vector<FileInfo> file_infos;
+            for (const auto& path : iter->second) {
+                file_infos.push_back(indexed_files_.at(path));
+            }
+            size_buckets.push_back(GroupHardLinks(std::move(file_infos)));
+            stats.candidate_files += size_buckets.back().size();
+        }
+        changed_sizes_.clear();
+        stats.size_buckets = size_buckets.size();
+
+        std::mutex file_groups_mutex;
+        const FileGroupCallback on_group = [this, &file_groups_mutex](FileGroup file_group) {
+            std::lock_guard lock(file_groups_mutex);
+            indexed_groups_[file_group.file_size].push_back(std::move(file_group));
+        };
+        TaskGroup task_group(thread_pool_);
+        for (const auto& linked_files : size_buckets) {
+            task_group.Run([this, &linked_files, &on_group, &counters] {
+                RefineFiles(linked_files, on_group, counters);
+            });
+        }
+        task_group.Wait();
+        for (const auto& linked_files : size_buckets) {
+            auto& file_groups = indexed_groups_[linked_files.front().file_info.size];
+            std::sort(file_groups.begin(), file_groups.end(), [](const auto& lhs, const auto& rhs) {
+                return lhs.paths < rhs.paths;
+            });
+        }
+        stats.refine_seconds = ToSeconds(std::chrono::steady_clock::now() - phase_start);
+        AddCounters(counters, stats);
+        AddScanStats(stats);
+    }
+
+    static void AddCounters(const ScanCounters& counters, ScanStats& stats) {
+        stats.blocks_read = counters.blocks_read;
+        stats.bytes_read = counters.bytes_read;
+        stats.cached_blocks = counters.cached_blocks;
+        stats.trie_nodes = counters.trie_nodes;
+        stats.refine_rounds = counters.refine_rounds;
+        stats.groups = counters.groups;
+        stats.verified_bytes = counters.verified_bytes;
+        stats.split_groups = counters.split_groups;
+        stats.resident_bytes = counters.resident_bytes;
+        stats.verify_seconds = static_cast<double>(counters.verify_nanoseconds) / 1e9;
+        stats.read_seconds = static_cast<double>(counters.read_nanoseconds) / 1e9;
+        stats.hash_seconds = static_cast<double>(counters.hash_nanoseconds) / 1e9;
+    }
+
+    void AddScanStats(const ScanStats& stats) const {
+        std::lock_guard lock(stats_mutex_);
+        stats_.files_listed += stats.files_listed;
+        stats_.candidate_files += stats.candidate_files;
+        stats_.size_buckets += stats.size_buckets;
+        stats_.blocks_read += stats.blocks_read;
+        stats_.bytes_read += stats.bytes_read;
+        stats_.cached_blocks += stats.cached_blocks;
+        stats_.trie_nodes += stats.trie_nodes;
+        stats_.refine_rounds += stats.refine_rounds;
+        stats_.groups += stats.groups;
+        stats_.verified_bytes += stats.verified_bytes;
+        stats_.split_groups += stats.split_groups;
+        stats_.resident_bytes += stats.resident_bytes;
+        stats_.spill_runs += stats.spill_runs;
+        stats_.list_seconds += stats.list_seconds;
+        stats_.refine_seconds += stats.refine_seconds;
+        stats_.save_seconds += stats.save_seconds;
+        stats_.read_seconds += stats.read_seconds;
+        stats_.hash_seconds += stats.hash_seconds;
+        stats_.verify_seconds += stats.verify_seconds;
+    }
+
+    static bool IsInDirectory(const fs::path& directory, const fs::path& path) {
+        return std::mismatch(directory.begin(), directory.end(), path.begin(), path.end()).first == directory.end();
+    }
+
+    bool IsInPhysicalOrderDirectory(const fs::path& path) const {
+        return std::any_of(physical_order_directories_.begin(), physical_order_directories_.end(),
+                [&path](const fs::path& directory) { return IsInDirectory(directory, path); });
+    }
+
     FileFilter file_filter_;
     int block_size_;
     std::string hash_algorithm_;
+    ScannerOptions options_;
+    mutable ReaderPool reader_pool_;
+    mutable ThreadPool thread_pool_;
+    std::unique_ptr<HashCache> hash_cache_;
+    std::unique_ptr<IoRingPool> io_ring_pool_;
+    std::vector<fs::path> physical_order_directories_;
+    // null unless a trace is written
+    std::unique_ptr<Tracer> tracer_;
+    mutable std::mutex stats_mutex_;
+    mutable ScanStats stats_;
+    // the index of the incremental scanning: files by path, their paths by size and by inode, the groups by size
+    std::map<fs::path, FileInfo> indexed_files_;
+    std::map<uintmax_t, std::set<fs::path>> indexed_sizes_;
+    std::map<std::pair<uint64_t, uint64_t>, std::set<fs::path>> indexed_inodes_;
+    std::map<uintmax_t, std::vector<FileGroup>> indexed_groups_;
+    std::set<uintmax_t> changed_sizes_;
 };
 
 Scanner::Scanner(
@@ -141,7 +1475,8 @@ Scanner::Scanner(
         int min_file_size,
         std::vector<std::string> file_masks,
         int block_size,
-        std::string hash_algorithm)
+        std::string hash_algorithm,
+        ScannerOptions options)
         : impl_(std::make_unique<ScannerImpl>(
                 std::move(include_directories),
                 std::move(exclude_directories),
@@ -149,11 +1484,59 @@ Scanner::Scanner(
                 min_file_size,
                 std::move(file_masks),
                 block_size,
-                std::move(hash_algorithm))) {
+                std::move(hash_algorithm),
+                options)) {
 }
 
 Scanner::~Scanner() = default;
 
 std::vector<std::vector<fs::path>> Scanner::FindEqualFileGroups() const {
-    return impl_->FindEqualFileGroups();
+    std::vector<FileGroup> file_groups;
+    FindEqualFileGroups([&file_groups](FileGroup file_group) { file_groups.push_back(std::move(file_group)); });
+    // groups are reported in the order they are found, which depends on the scheduling
+    std::sort(file_groups.begin(), file_groups.end(), [](const auto& lhs, const auto& rhs) {
+        return std::tie(lhs.file_size, lhs.paths) < std::tie(rhs.file_size, rhs.paths);
+    });
+    std::vector<std::vector<fs::path>> result;
+    result.reserve(file_groups.size());
+    for (auto& file_group : file_groups) {
+        result.push_back(std::move(file_group.paths));
+    }
+    return result;
+}
+
+void Scanner::FindEqualFileGroups(const FileGroupCallback& on_group) const {
+    impl_->FindEqualFileGroups(on_group);
+}
+
+ReaderPoolStats Scanner::GetReaderPoolStats() const {
+    return impl_->GetReaderPoolStats();
+}
+
+ScanStats Scanner::GetScanStats() const {
+    return impl_->GetScanStats();
+}
+
+HashCacheStats Scanner::GetHashCacheStats() const {
+    return impl_->GetHashCacheStats();
+}
+
+void Scanner::BuildIndex() {
+    impl_->BuildIndex();
+}
+
+void Scanner::AddFile(const fs::path& path) {
+    impl_->AddFile(path);
+}
+
+void Scanner::RemoveFile(const fs::path& path) {
+    impl_->RemoveFile(path);
+}
+
+void Scanner::RemoveDirectory(const fs::path& directory) {
+    impl_->RemoveDirectory(directory);
+}
+
+std::vector<FileGroup> Scanner::GetIndexedGroups() {
+    return impl_->GetIndexedGroups();
 }
@@ -1,13 +1,106 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <functional>
 #include <memory>
 #include <boost/filesystem.hpp>
+#include "hash_cache.h"
+#include "reader.h"
+#include "reader_pool.h"
 
 namespace fs = boost::filesystem;
 
 class ScannerImpl;
 
+struct FileGroup {
+    uintmax_t file_size;
+    std::vector<fs::path> paths;
+    // paths with equal link ids are hard links to one file
+    std::vector<size_t> link_ids;
+};
+
+using FileGroupCallback = std::function<void(FileGroup)>;
+
+// How the files of one size are told apart, the groups found are the same.
+enum class GroupingEngine {
+    kTrie,    // files descend a trie node by node, every node is refined by its own task as soon as it's ready
+    kRounds,  // level-synchronous: every round reads the next block of all the files left, then splits the groups
+};
+
+GroupingEngine GetGroupingEngine(const std::string& grouping_engine);
+
+std::vector<std::string> GetPossibleGroupingEngines();
+
+struct ScanStats {
+    size_t files_listed = 0;     // paths found by the file filter
+    size_t candidate_files = 0;  // files sharing their size with another path, hard links counted once
+    size_t size_buckets = 0;
+    uintmax_t blocks_read = 0;   // blocks read and hashed, probes included
+    uintmax_t bytes_read = 0;
+    uintmax_t cached_blocks = 0; // blocks whose digests were taken from the hash cache
+    size_t trie_nodes = 0;       // nodes of the tries, 0 with the rounds engine
+    size_t refine_rounds = 0;    // rounds of the rounds engine over all the size buckets, 0 with the trie
+    size_t groups = 0;
+    size_t spill_runs = 0;       // sorted runs written to the disk with a memory budget
+    uintmax_t verified_bytes = 0; // bytes compared to confirm the groups with verify_groups
+    size_t split_groups = 0;     // groups of equal digests whose files turned out to differ
+    uintmax_t resident_bytes = 0; // bytes of the files read left in the page cache, with measure_page_cache
+    // wall time of the phases: listing and bucketing the files, reading them, saving the hash cache
+    double list_seconds = 0;
+    double refine_seconds = 0;
+    double save_seconds = 0;
+    // time spent in reads and hashes summed over the threads, only measured with measure_block_times
+    double read_seconds = 0;
+    double hash_seconds = 0;
+    // time spent comparing the files of the groups summed over the threads
+    double verify_seconds = 0;
+};
+
+// Tuning knobs which don't change the scan result.
+struct ScannerOptions {
+    ReadMode read_mode = ReadMode::kPread;
+    GroupingEngine grouping_engine = GroupingEngine::kTrie;
+    // blocks double in size from the block size up to this one, which spends few reads on long equal
+    // files and little I/O on files differing early; 0 keeps the block size fixed
+    size_t max_block_size = 0;
+    // blocks compared before the sequential reading: the last one, then evenly spaced ones in the middle,
+    // files differing only near their ends are told apart without reading them in full
+    size_t probe_count = 1;
+    // reads in flight at once per thread with the io_uring read mode, capped by the threads' shares of
+    // max_open_files
+    size_t queue_depth = 32;
+    // files under these directories are read in the order of their blocks on the disk instead of the order
+    // of their paths, which saves seeks on spinning disks
+    std::vector<fs::path> physical_order_directories;
+    // with a memory budget in bytes the listed files are sorted by size in runs on the disk, and the groups
+    // of candidate files are loaded a few at a time, so scans of tens of millions of files fit in memory;
+    // 0 keeps all the files in memory, which is faster
+    uintmax_t memory_budget = 0;
+    // directory of the runs, the temporary directory if empty
+    fs::path spill_directory;
+    // cap on the number of files kept open at the same time, at least 1
+    size_t max_open_files = 512;
+    // threads reading and hashing blocks, the results don't depend on it
+    size_t thread_count = 1;
+    // file keeping block digests between runs, no cache is used if empty
+    fs::path hash_cache_path;
+    uintmax_t hash_cache_max_size = 256 << 20;
+    // times every read and hash for ScanStats
+    bool measure_block_times = false;
+    // counts the pages of every file read left in the page cache once its size is refined, a mapping per file
+    bool measure_page_cache = false;
+    // the files of every group found are compared byte by byte, and the group is split if they differ, so
+    // that a weak hash such as crc32 can't put different files together; equal files are read once more
+    bool verify_groups = false;
+    // Chrome trace events of the scan phases are written here after every scan and every GetIndexedGroups if it's
+    // not empty, each write holds the spans since the previous one
+    fs::path trace_path;
+    // FindEqualFileGroups refines only the sizes falling into this shard out of shard_count, so that several
+    // processes can split a scan without talking to each other: equal files always have equal sizes
+    size_t shard_count = 1;
+    size_t shard_index = 0;
+};
+
 class Scanner {
 public:
     Scanner(
@@ -17,10 +110,33 @@ public:
             int min_file_size,
             std::vector<std::string> file_masks,
             int block_size,
-            std::string hash_algorithm);
+            std::string hash_algorithm,
+            ScannerOptions options = {});
     ~Scanner();
 
+    // Groups are ordered by file size, then by paths.
     [[nodiscard]] std::vector<std::vector<fs::path>> FindEqualFileGroups() const;
+    // Streams the groups: on_group is called as soon as a group is final, by one thread at a time.
+    void FindEqualFileGroups(const FileGroupCallback& on_group) const;
+    // Reader pool counters accumulated over all the scans made by this scanner.
+    [[nodiscard]] ReaderPoolStats GetReaderPoolStats() const;
+    [[nodiscard]] HashCacheStats GetHashCacheStats() const;
+    // Counters and phase times summed over all the scans made by this scanner.
+    [[nodiscard]] ScanStats GetScanStats() const;
+
+    // Incremental scanning for long-running processes. The index keeps the files and the groups of a scan and
+    // is updated file by file, only the sizes touched by the changes are refined again, and the digests of
+    // the unchanged files are kept in the hash cache (in memory if no cache file is given). Paths are
+    // absolute and canonical, as in the groups. The index is not thread-safe.
+    // Lists the files and finds the groups, replacing the index.
+    void BuildIndex();
+    // Adds a new file or updates a changed one with its hard links; a file the filter rejects is removed.
+    void AddFile(const fs::path& path);
+    void RemoveFile(const fs::path& path);
+    // Removes all the files under the directory.
+    void RemoveDirectory(const fs::path& directory);
+    // Refines the sizes changed since the last call. Groups are ordered by file size, then by paths.
+    [[nodiscard]] std::vector<FileGroup> GetIndexedGroups();
 
 private:
     std::unique_ptr<ScannerImpl> impl_;
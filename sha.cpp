@@ -0,0 +1,270 @@
+#include "hash_kernels.h"
+#include "cpu_features.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static constexpr size_t kShaBlockSize = 64;
+
+static constexpr Sha1State kSha1InitialState = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+static constexpr Sha256State kSha256InitialState = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+alignas(16) static constexpr uint32_t kSha256RoundConstants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t LoadBigEndian32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 |
+           static_cast<uint32_t>(data[2]) << 8 | data[3];
+}
+
+static uint32_t RotateLeft(uint32_t value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static uint32_t RotateRight(uint32_t value, int shift) {
+    return (value >> shift) | (value << (32 - shift));
+}
+
+// Compresses the message followed by the standard padding: 0x80, zeros and the bit length.
+template <typename State, typename Compress>
+static State CalcMerkleDamgard(const void* data, size_t size, State state, Compress compress) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    const size_t whole_blocks = size / kShaBlockSize;
+    compress(state, bytes, whole_blocks);
+
+    uint8_t tail[2 * kShaBlockSize]{};
+    const size_t tail_size = size % kShaBlockSize;
+    std::memcpy(tail, bytes + whole_blocks * kShaBlockSize, tail_size);
+    tail[tail_size] = 0x80;
+    const size_t tail_blocks = tail_size + 1 + 8 <= kShaBlockSize ? 1 : 2;
+    const uint64_t bit_size = static_cast<uint64_t>(size) * 8;
+    for (size_t i = 0; i < 8; ++i) {
+        tail[tail_blocks * kShaBlockSize - 1 - i] = static_cast<uint8_t>(bit_size >> (8 * i));
+    }
+    compress(state, tail, tail_blocks);
+    return state;
+}
+
+void Sha1CompressScalar(Sha1State& state, const uint8_t* data, size_t block_count) {
+    for (; block_count > 0; --block_count, data += kShaBlockSize) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = LoadBigEndian32(data + 4 * i);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+#pragma GCC unroll 80
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            const uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+void Sha256CompressScalar(Sha256State& state, const uint8_t* data, size_t block_count) {
+    for (; block_count > 0; --block_count, data += kShaBlockSize) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = LoadBigEndian32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            const uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 64
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+            const uint32_t choice = (e & f) ^ (~e & g);
+            const uint32_t temp1 = h + s1 + choice + kSha256RoundConstants[i] + w[i];
+            const uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+            const uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            const uint32_t temp2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+
+SHA_NI_TARGET
+static __m128i Sha1Rounds(__m128i abcd, __m128i e, int group) {
+    // the round function selector has to be an immediate
+    switch (group / 5) {
+        case 0:
+            return _mm_sha1rnds4_epu32(abcd, e, 0);
+        case 1:
+            return _mm_sha1rnds4_epu32(abcd, e, 1);
+        case 2:
+            return _mm_sha1rnds4_epu32(abcd, e, 2);
+        default:
+            return _mm_sha1rnds4_epu32(abcd, e, 3);
+    }
+}
+
+SHA_NI_TARGET
+void Sha1CompressShaNi(Sha1State& state, const uint8_t* data, size_t block_count) {
+    const __m128i byte_swap_mask = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state.data())), 0x1b);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; block_count > 0; --block_count, data += kShaBlockSize) {
+        const __m128i abcd_save = abcd;
+        const __m128i e0_save = e0;
+        __m128i e1 = _mm_setzero_si128();
+        __m128i messages[4];
+        // every group of four rounds schedules the message words of the following groups
+#pragma GCC unroll 20
+        for (int group = 0; group < 20; ++group) {
+            __m128i& message = messages[group % 4];
+            if (group < 4) {
+                message = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * group)), byte_swap_mask);
+            }
+            __m128i& e = group % 2 == 0 ? e0 : e1;
+            __m128i& next_e = group % 2 == 0 ? e1 : e0;
+            e = group == 0 ? _mm_add_epi32(e, message) : _mm_sha1nexte_epu32(e, message);
+            next_e = abcd;
+            if (group >= 3 && group <= 18) {
+                messages[(group + 1) % 4] = _mm_sha1msg2_epu32(messages[(group + 1) % 4], message);
+            }
+            abcd = Sha1Rounds(abcd, e, group);
+            if (group >= 1 && group <= 16) {
+                messages[(group + 3) % 4] = _mm_sha1msg1_epu32(messages[(group + 3) % 4], message);
+            }
+            if (group >= 2 && group <= 17) {
+                messages[(group + 2) % 4] = _mm_xor_si128(messages[(group + 2) % 4], message);
+            }
+        }
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state.data()), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+SHA_NI_TARGET
+void Sha256CompressShaNi(Sha256State& state, const uint8_t* data, size_t block_count) {
+    const __m128i byte_swap_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    __m128i temp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(temp, state1, 8);  // ABEF
+    state1 = _mm_blend_epi16(state1, temp, 0xf0);       // CDGH
+
+    for (; block_count > 0; --block_count, data += kShaBlockSize) {
+        const __m128i abef_save = state0;
+        const __m128i cdgh_save = state1;
+        __m128i messages[4];
+#pragma GCC unroll 16
+        for (int group = 0; group < 16; ++group) {
+            __m128i& message = messages[group % 4];
+            if (group < 4) {
+                message = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * group)), byte_swap_mask);
+            }
+            __m128i keyed_message = _mm_add_epi32(
+                    message, _mm_load_si128(reinterpret_cast<const __m128i*>(kSha256RoundConstants + 4 * group)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, keyed_message);
+            if (group >= 3 && group <= 14) {
+                __m128i& next_message = messages[(group + 1) % 4];
+                next_message = _mm_add_epi32(next_message, _mm_alignr_epi8(message, messages[(group + 3) % 4], 4));
+                next_message = _mm_sha256msg2_epu32(next_message, message);
+            }
+            keyed_message = _mm_shuffle_epi32(keyed_message, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, keyed_message);
+            if (group >= 1 && group <= 12) {
+                messages[(group + 3) % 4] = _mm_sha256msg1_epu32(messages[(group + 3) % 4], message);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    temp = _mm_shuffle_epi32(state0, 0x1b);    // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xb1);  // DCHG
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(temp, state1, 0xf0));  // DCBA
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(state1, temp, 8));     // HGFE
+}
+#else
+void Sha1CompressShaNi(Sha1State& state, const uint8_t* data, size_t block_count) {
+    Sha1CompressScalar(state, data, block_count);
+}
+
+void Sha256CompressShaNi(Sha256State& state, const uint8_t* data, size_t block_count) {
+    Sha256CompressScalar(state, data, block_count);
+}
+#endif
+
+Sha1State CalcSha1(const void* data, size_t size, Sha1Compress compress) {
+    return CalcMerkleDamgard(data, size, kSha1InitialState, compress);
+}
+
+Sha1State CalcSha1(const void* data, size_t size) {
+    static const Sha1Compress kCompress = GetCpuFeatures().sha ? Sha1CompressShaNi : Sha1CompressScalar;
+    return CalcSha1(data, size, kCompress);
+}
+
+Sha256State CalcSha256(const void* data, size_t size, Sha256Compress compress) {
+    return CalcMerkleDamgard(data, size, kSha256InitialState, compress);
+}
+
+Sha256State CalcSha256(const void* data, size_t size) {
+    static const Sha256Compress kCompress = GetCpuFeatures().sha ? Sha256CompressShaNi : Sha256CompressScalar;
+    return CalcSha256(data, size, kCompress);
+}
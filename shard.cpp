@@ -0,0 +1,321 @@
+#include "shard.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/format.hpp>
+#include "output_format.h"
+
+[[noreturn]] static void ThrowSystemError(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error(what, path, boost::system::error_code(errno, boost::system::system_category()));
+}
+
+static bool IsLess(const FileGroup& lhs, const FileGroup& rhs) {
+    return std::tie(lhs.file_size, lhs.paths) < std::tie(rhs.file_size, rhs.paths);
+}
+
+fs::path GetShardPath(const fs::path& shard_directory, size_t shard_index) {
+    return shard_directory / ("shard-" + std::to_string(shard_index) + ".json");
+}
+
+void WriteShard(const fs::path& shard_path, std::vector<FileGroup> file_groups) {
+    std::sort(file_groups.begin(), file_groups.end(), IsLess);
+    const fs::path temporary_path = shard_path.string() + ".tmp";
+    {
+        fs::ofstream out{temporary_path};
+        for (const auto& file_group : file_groups) {
+            WriteFileGroup(out, file_group, OutputFormat::kJsonLines, true);
+        }
+        if (!out) {
+            ThrowSystemError("write", temporary_path);
+        }
+    }
+    fs::rename(temporary_path, shard_path);
+}
+
+void CheckShardManifest(const fs::path& shard_directory, const ShardManifest& manifest) {
+    std::string content;
+    for (const auto& [name, value] : manifest) {
+        content += name + '=' + value + '\n';
+    }
+    const auto manifest_path = shard_directory / "manifest";
+    if (!fs::exists(manifest_path)) {
+        const fs::path temporary_path = manifest_path.string() + ".tmp";
+        {
+            fs::ofstream out{temporary_path};
+            out << content;
+            if (!out) {
+                ThrowSystemError("write", temporary_path);
+            }
+        }
+        fs::rename(temporary_path, manifest_path);
+        return;
+    }
+    fs::ifstream in{manifest_path};
+    const std::string existing_content(std::istreambuf_iterator<char>(in), {});
+    if (in.bad()) {
+        ThrowSystemError("read", manifest_path);
+    }
+    if (existing_content != content) {
+        throw fs::filesystem_error("the shard directory holds shards of a scan with other options", manifest_path,
+                                   boost::system::errc::make_error_code(boost::system::errc::invalid_argument));
+    }
+}
+
+// Parses the json lines written by WriteFileGroup, nothing more.
+class FileGroupParser {
+public:
+    FileGroupParser(std::string_view line, const fs::path& shard_path)
+            : line_(line)
+            , shard_path_(shard_path) {
+    }
+
+    FileGroup Parse() {
+        FileGroup file_group;
+        Expect("{\"size\":");
+        file_group.file_size = ParseNumber();
+        Expect(",\"paths\":[");
+        if (!Consume(']')) {
+            do {
+                file_group.paths.emplace_back(ParseString());
+            } while (Consume(','));
+            Expect("]");
+        }
+        if (Consume(',')) {
+            Expect("\"links\":[");
+            if (!Consume(']')) {
+                do {
+                    file_group.link_ids.push_back(ParseNumber());
+                } while (Consume(','));
+                Expect("]");
+            }
+        }
+        Expect("}");
+        if (!line_.empty() || (!file_group.link_ids.empty()
+                               && file_group.link_ids.size() != file_group.paths.size())) {
+            Fail();
+        }
+        return file_group;
+    }
+
+private:
+    void Expect(std::string_view token) {
+        if (line_.substr(0, token.size()) != token) {
+            Fail();
+        }
+        line_.remove_prefix(token.size());
+    }
+
+    bool Consume(char c) {
+        if (line_.empty() || line_.front() != c) {
+            return false;
+        }
+        line_.remove_prefix(1);
+        return true;
+    }
+
+    uintmax_t ParseNumber() {
+        uintmax_t result = 0;
+        size_t length = 0;
+        for (; length < line_.size() && line_[length] >= '0' && line_[length] <= '9'; ++length) {
+            result = result * 10 + (line_[length] - '0');
+        }
+        if (length == 0) {
+            Fail();
+        }
+        line_.remove_prefix(length);
+        return result;
+    }
+
+    std::string ParseString() {
+        Expect("\"");
+        std::string result;
+        while (!Consume('"')) {
+            if (line_.empty()) {
+                Fail();
+            }
+            const char c = line_.front();
+            line_.remove_prefix(1);
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (line_.empty()) {
+                Fail();
+            }
+            const char escaped = line_.front();
+            line_.remove_prefix(1);
+            switch (escaped) {
+                case 'n':
+                    result += '\n';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'u': {
+                    // only control characters are written this way
+                    unsigned value = 0;
+                    for (int i = 0; i < 4; ++i) {
+                        if (line_.empty() || !std::isxdigit(static_cast<unsigned char>(line_.front()))) {
+                            Fail();
+                        }
+                        const char digit = line_.front();
+                        line_.remove_prefix(1);
+                        value = value * 16 + (std::isdigit(static_cast<unsigned char>(digit))
+                                ? digit - '0' : std::tolower(static_cast<unsigned char>(digit)) - 'a' + 10);
+                    }
+                    if (value > 0xff) {
+                        Fail();
+                    }
+                    result += static_cast<char>(value);
+                    break;
+                }
+                default:
+                    result += escaped;
+            }
+        }
+        return result;
+    }
+
+    [[noreturn]] void Fail() const {
+        throw fs::filesystem_error("malformed shard file", shard_path_,
+                                   boost::system::errc::make_error_code(boost::system::errc::invalid_argument));
+    }
+
+    std::string_view line_;
+    const fs::path& shard_path_;
+};
+
+class ShardReader {
+public:
+    explicit ShardReader(fs::path shard_path)
+            : shard_path_(std::move(shard_path))
+            , in_(shard_path_) {
+        if (!in_) {
+            ThrowSystemError("open", shard_path_);
+        }
+    }
+
+    // Returns nothing at the end of the file.
+    std::optional<FileGroup> Next() {
+        std::string line;
+        while (std::getline(in_, line)) {
+            if (!line.empty()) {
+                return FileGroupParser(line, shard_path_).Parse();
+            }
+        }
+        if (in_.bad()) {
+            ThrowSystemError("read", shard_path_);
+        }
+        return std::nullopt;
+    }
+
+private:
+    fs::path shard_path_;
+    fs::ifstream in_;
+};
+
+void MergeShards(const std::vector<fs::path>& shard_paths, const FileGroupCallback& on_group) {
+    std::deque<ShardReader> readers;
+    std::vector<std::pair<FileGroup, size_t>> heap;
+    const auto greater = [](const auto& lhs, const auto& rhs) { return IsLess(rhs.first, lhs.first); };
+    for (const auto& shard_path : shard_paths) {
+        auto& reader = readers.emplace_back(shard_path);
+        if (auto file_group = reader.Next()) {
+            heap.emplace_back(std::move(*file_group), readers.size() - 1);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), greater);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        auto [file_group, reader_index] = std::move(heap.back());
+        heap.pop_back();
+        if (auto next_file_group = readers[reader_index].Next()) {
+            heap.emplace_back(std::move(*next_file_group), reader_index);
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+        on_group(std::move(file_group));
+    }
+}
+
+void RunShards(size_t shard_count, size_t job_count, const fs::path& shard_directory,
+               const std::function<void(size_t)>& run_shard) {
+    assert(job_count > 0);
+    std::deque<size_t> pending_shards;
+    for (size_t shard_index = 0; shard_index < shard_count; ++shard_index) {
+        if (!fs::exists(GetShardPath(shard_directory, shard_index))) {
+            pending_shards.push_back(shard_index);
+        }
+    }
+    std::map<pid_t, size_t> running_shards;
+    std::optional<size_t> failed_shard;
+    int fork_errno = 0;
+    while (!pending_shards.empty() || !running_shards.empty()) {
+        while (!pending_shards.empty() && running_shards.size() < job_count) {
+            const size_t shard_index = pending_shards.front();
+            pending_shards.pop_front();
+            // buffered output would be written by the child as well
+            std::cout.flush();
+            std::cerr.flush();
+            const pid_t pid = fork();
+            if (pid == -1) {
+                // the running shards are waited for, the others are left for the next run
+                fork_errno = errno;
+                pending_shards.clear();
+                break;
+            }
+            if (pid == 0) {
+                int status = 0;
+                try {
+                    run_shard(shard_index);
+                } catch (const std::exception& error) {
+                    std::cerr << boost::format("shard %1%: %2%\n") % shard_index % error.what();
+                    status = 1;
+                } catch (...) {
+                    status = 1;
+                }
+                std::cout.flush();
+                std::cerr.flush();
+                _exit(status);
+            }
+            running_shards[pid] = shard_index;
+        }
+        if (running_shards.empty()) {
+            break;
+        }
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("waitpid", {});
+        }
+        const auto iter = running_shards.find(pid);
+        if (iter == running_shards.end()) {
+            continue;
+        }
+        const bool is_complete = WIFEXITED(status) && WEXITSTATUS(status) == 0
+                                 && fs::exists(GetShardPath(shard_directory, iter->second));
+        if (!is_complete && !failed_shard) {
+            failed_shard = iter->second;
+        }
+        running_shards.erase(iter);
+    }
+    if (fork_errno != 0) {
+        errno = fork_errno;
+        ThrowSystemError("fork", {});
+    }
+    if (failed_shard) {
+        throw std::runtime_error((boost::format("shard %1% failed") % *failed_shard).str());
+    }
+}
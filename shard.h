@@ -0,0 +1,36 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "scanner.h"
+
+namespace fs = boost::filesystem;
+
+// A scan split into shards by file size (see ScannerOptions::shard_count) leaves one file of groups per shard.
+// A shard file holds json lines with the hard link ids, ordered by file size, then by paths, and it only
+// exists once the shard is complete, so an interrupted scan is resumed by running the missing shards.
+
+[[nodiscard]] fs::path GetShardPath(const fs::path& shard_directory, size_t shard_index);
+
+// Writes the file aside and renames it into place.
+void WriteShard(const fs::path& shard_path, std::vector<FileGroup> file_groups);
+
+// Calls on_group for the groups of all the shard files, ordered by file size, then by paths. Only one group
+// of every file is kept in memory.
+void MergeShards(const std::vector<fs::path>& shard_paths, const FileGroupCallback& on_group);
+
+// Names and values of the shard count and of the options affecting the groups.
+using ShardManifest = std::vector<std::pair<std::string, std::string>>;
+
+// Shard files of different scans must not be merged, so the shard directory keeps the manifest of its scan,
+// one "name=value" line each. The first call writes it, the next ones throw fs::filesystem_error if it
+// differs: a rerun with other options needs a new directory.
+void CheckShardManifest(const fs::path& shard_directory, const ShardManifest& manifest);
+
+// Calls run_shard for every shard whose file is missing in the shard directory, each in its own forked
+// process, with at most job_count of them running at a time. Throws if a process fails; the shards completed
+// so far are kept. Must be called before the process starts any threads.
+void RunShards(size_t shard_count, size_t job_count, const fs::path& shard_directory,
+               const std::function<void(size_t)>& run_shard);
@@ -0,0 +1,49 @@
+#define BOOST_TEST_MODULE test_arena
+
+#include "arena.h"
+#include "thread_pool.h"
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_arena)
+
+BOOST_AUTO_TEST_CASE(test_allocate) {
+    Arena<std::vector<int>> arena;
+    std::vector<std::vector<int>*> addresses;
+    for (int i = 0; i < 10000; ++i) {
+        const auto index = arena.Allocate();
+        BOOST_REQUIRE_EQUAL(static_cast<size_t>(i), index);
+        BOOST_CHECK(arena[index].empty());
+        arena[index].push_back(i);
+        addresses.push_back(&arena[index]);
+    }
+    BOOST_CHECK_EQUAL(10000, arena.Size());
+    for (int i = 0; i < 10000; ++i) {
+        // objects don't move when the arena grows
+        BOOST_CHECK_EQUAL(addresses[i], &arena[i]);
+        BOOST_CHECK_EQUAL(i, arena[i].front());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_allocate) {
+    Arena<size_t> arena;
+    ThreadPool thread_pool(4);
+    TaskGroup task_group(thread_pool);
+    for (size_t task = 0; task < 16; ++task) {
+        task_group.Run([&arena, task] {
+            for (size_t i = 0; i < 1000; ++i) {
+                arena[arena.Allocate()] = task;
+            }
+        });
+    }
+    task_group.Wait();
+    BOOST_REQUIRE_EQUAL(16000, arena.Size());
+    std::vector<size_t> counts(16);
+    for (uint32_t i = 0; i < 16000; ++i) {
+        ++counts[arena[i]];
+    }
+    BOOST_CHECK(std::vector<size_t>(16, 1000) == counts);
+}
+
+}
@@ -0,0 +1,85 @@
+#define BOOST_TEST_MODULE test_external_sort
+
+#include "external_sort.h"
+#include <random>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_external_sort)
+
+fs::path CreateSpillDirectory() {
+    const auto directory = fs::temp_directory_path() / "test_external_sort_dir";
+    fs::remove_all(directory);
+    fs::create_directory(directory);
+    return directory;
+}
+
+std::vector<SpillRecord> GenerateRecords(size_t count) {
+    std::mt19937 random(1);
+    std::vector<SpillRecord> result;
+    for (size_t i = 0; i < count; ++i) {
+        SpillRecord record;
+        record.file_info.path = "dir" + std::to_string(random() % 10) + "/" + std::to_string(i);
+        record.file_info.size = random() % 10;
+        record.file_info.device = random() % 2;
+        record.file_info.inode = random() % 100;
+        record.file_info.mtime_ns = -static_cast<int64_t>(random());
+        record.key = std::string(random() % 3, static_cast<char>(random() % 256));
+        result.push_back(record);
+    }
+    return result;
+}
+
+std::vector<SpillRecord> SortExternally(const std::vector<SpillRecord>& records, ExternalSorter& sorter) {
+    for (const auto& record : records) {
+        sorter.Add(record);
+    }
+    std::vector<SpillRecord> result;
+    sorter.Merge([&result](SpillRecord record) { result.push_back(std::move(record)); });
+    return result;
+}
+
+void CheckEqual(const std::vector<SpillRecord>& expected, const std::vector<SpillRecord>& records) {
+    BOOST_REQUIRE_EQUAL(expected.size(), records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        BOOST_CHECK_EQUAL(expected[i].file_info.path, records[i].file_info.path);
+        BOOST_CHECK_EQUAL(expected[i].file_info.mtime_ns, records[i].file_info.mtime_ns);
+        BOOST_CHECK(expected[i].key == records[i].key);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_in_memory) {
+    const auto directory = CreateSpillDirectory();
+    auto records = GenerateRecords(1000);
+    ExternalSorter sorter(directory, 1 << 30);
+    const auto sorted_records = SortExternally(records, sorter);
+    std::sort(records.begin(), records.end());
+    CheckEqual(records, sorted_records);
+    BOOST_CHECK_EQUAL(0, sorter.GetRunCount());
+    BOOST_CHECK(fs::is_empty(directory));
+}
+
+BOOST_AUTO_TEST_CASE(test_runs) {
+    const auto directory = CreateSpillDirectory();
+    auto records = GenerateRecords(2000);
+    auto expected_records = records;
+    std::sort(expected_records.begin(), expected_records.end());
+    // from one record per run to about 50 runs
+    for (size_t memory_budget : {1, 5000, 10000}) {
+        ExternalSorter sorter(directory, memory_budget);
+        CheckEqual(expected_records, SortExternally(records, sorter));
+        BOOST_CHECK_GT(sorter.GetRunCount(), 1);
+        BOOST_CHECK(fs::is_empty(directory));
+    }
+    {
+        // runs left by an interrupted merge are removed by the destructor
+        ExternalSorter sorter(directory, 5000);
+        for (const auto& record : records) {
+            sorter.Add(record);
+        }
+        BOOST_CHECK(!fs::is_empty(directory));
+    }
+    BOOST_CHECK(fs::is_empty(directory));
+}
+
+}
@@ -1,6 +1,7 @@
 #define BOOST_TEST_MODULE test_file_filter
 
 #include "file_filter.h"
+#include "thread_pool.h"
 #include <set>
 #include <iostream>
 #include <boost/test/unit_test.hpp>
@@ -88,4 +89,65 @@ BOOST_AUTO_TEST_CASE(test_file_masks) {
     TestFileFilter({"."}, {}, 1, 0, {"\\d+"}, {"a", "1", "d1/a", "d1/22"}, {"1", "d1/22"});
 }
 
+BOOST_AUTO_TEST_CASE(test_file_infos) {
+    ResetRootDirectory();
+    CreateFiles({"b", "a", "d1/c"});
+    FileFilter file_filter({"."}, {}, 1, 0, {".*"});
+    const auto file_infos = file_filter.FilterFileInfos();
+    BOOST_REQUIRE_EQUAL(3, file_infos.size());
+    BOOST_CHECK_EQUAL(fs::absolute("a"), file_infos[0].path);
+    BOOST_CHECK_EQUAL(fs::absolute("b"), file_infos[1].path);
+    BOOST_CHECK_EQUAL(fs::absolute("d1/c"), file_infos[2].path);
+    for (const auto& file_info : file_infos) {
+        BOOST_CHECK_EQUAL(kFileSize, file_info.size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_symlinks) {
+    ResetRootDirectory();
+    CreateFiles({"d1/a", "d2/b"});
+    fs::create_symlink(GetRootPath() / "d1/a", GetRootPath() / "c");
+    fs::create_symlink(GetRootPath() / "d2", GetRootPath() / "d3");
+    fs::create_symlink(GetRootPath() / "missing", GetRootPath() / "e");
+    FileFilter file_filter({"."}, {"d3"}, 1, 0, {".*"});
+    BOOST_CHECK(std::set<fs::path>{fs::absolute("d1/a")} == file_filter.FilterFiles());
+}
+
+BOOST_AUTO_TEST_CASE(test_threads) {
+    ResetRootDirectory();
+    std::vector<std::string> files;
+    for (int i = 0; i < 100; ++i) {
+        files.push_back("d" + std::to_string(i % 7) + "/dd" + std::to_string(i % 3) + "/" + std::to_string(i));
+    }
+    CreateFiles(files);
+    FileFilter file_filter({".", "d1"}, {"d2/dd0"}, 2, 0, {".*"});
+    const auto expected_file_infos = file_filter.FilterFileInfos();
+    BOOST_CHECK_EQUAL(100 - 5, expected_file_infos.size());
+    ThreadPool thread_pool(4);
+    const auto file_infos = file_filter.FilterFileInfos(thread_pool);
+    BOOST_REQUIRE_EQUAL(expected_file_infos.size(), file_infos.size());
+    for (size_t i = 0; i < file_infos.size(); ++i) {
+        BOOST_CHECK_EQUAL(expected_file_infos[i].path, file_infos[i].path);
+        BOOST_CHECK_EQUAL(expected_file_infos[i].size, file_infos[i].size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_physical_offset) {
+    ResetRootDirectory();
+    CreateFiles({"a", "b"});
+    FileFilter file_filter({"."}, {}, 0, 0, {".*"});
+    const auto file_infos = file_filter.FilterFileInfos();
+    BOOST_REQUIRE_EQUAL(2, file_infos.size());
+    for (const auto& file_info : file_infos) {
+        BOOST_CHECK_EQUAL(GetPhysicalOffset(file_info), GetPhysicalOffset(file_info));
+    }
+    // the inode number is used for the files without extents
+    fs::ofstream{GetRootPath() / "c"};
+    const auto empty_file_info = FileFilter({"."}, {}, 0, 0, {"c"}).FilterFileInfos().at(0);
+    BOOST_CHECK_EQUAL(empty_file_info.inode, GetPhysicalOffset(empty_file_info));
+    auto missing_file_info = empty_file_info;
+    missing_file_info.path = GetRootPath() / "missing";
+    BOOST_CHECK_EQUAL(empty_file_info.inode, GetPhysicalOffset(missing_file_info));
+}
+
 }
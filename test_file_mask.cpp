@@ -0,0 +1,85 @@
+#define BOOST_TEST_MODULE test_file_mask
+
+#include "file_mask.h"
+#include <boost/regex.hpp>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_file_mask)
+
+const std::vector<std::string> kNames = {
+    "", "a", "ab", "abc", "aaa", "abab", "file.txt", "file.TXT", "archive.tar.gz", ".hidden", "a.b.c", "x-1_2",
+    "123", "a1b2", "tab\tname", "new\nline", "[x]", "a+b", "a{2}", "a|b", "\xd0\xb0\xd0\xb1.txt", "z",
+};
+
+// Every mask the DFA takes has to agree with boost::regex on every name.
+BOOST_AUTO_TEST_CASE(test_same_as_regex) {
+    const std::vector<std::string> masks = {
+        "a", "abc", "a*", "a+b*", "(ab)*", "(?:ab)+", "a|b|abc", "a?b?c?", "a{2}", "a{1,2}", "a{2,}b?", ".",
+        ".*", ".+\\.txt", ".*\\.txt", ".*\\.(txt|gz)", "[a-c]+", "[^a]*", "[]x]+", "[-a]*", "\\[x\\]", "a\\+b",
+        "\\d+", "\\w+", "[\\w.]+", "\\S+\\s\\S+", "\\D*", "a.*?b", "x-1_2", ".*\\.TXT", "(a|ab)(c|bcd)?",
+        "[a-z0-9]{1,4}", "\\.hidden", "a\\{2\\}", "a\\|b", "tab\\tname", "new\\nline", "..\\..*",
+    };
+    for (const auto& mask : masks) {
+        const FileMaskMatcher matcher({mask});
+        BOOST_CHECK_MESSAGE(matcher.GetFallbackMaskCount() == 0, mask);
+        const boost::regex regex(mask);
+        for (const auto& name : kNames) {
+            BOOST_CHECK_MESSAGE(matcher.Matches(name) == boost::regex_match(name, regex), mask + " on " + name);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_fallback) {
+    const std::vector<std::string> masks = {"^abc$", "(a)\\1", "a(?=b).*", "(?i)ABC", "[[:digit:]]+", "a{100}"};
+    for (const auto& mask : masks) {
+        const FileMaskMatcher matcher({mask, "glob:*.txt"});
+        BOOST_CHECK_EQUAL(1, matcher.GetFallbackMaskCount());
+        const boost::regex regex(mask);
+        for (const auto& name : kNames) {
+            const bool expected = boost::regex_match(name, regex)
+                                  || (name.size() > 4 && name.substr(name.size() - 4) == ".txt");
+            BOOST_CHECK_MESSAGE(matcher.Matches(name) == expected, mask + " on " + name);
+        }
+    }
+    BOOST_CHECK_THROW(FileMaskMatcher({"a("}), boost::regex_error);
+    BOOST_CHECK_THROW(FileMaskMatcher({"*a"}), boost::regex_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_glob) {
+    const FileMaskMatcher matcher({"glob:*.txt", "glob:*.tar.gz", "glob:a?c", "glob:[!a-z]*", "glob:\\*", "glob:[x"});
+    BOOST_CHECK_EQUAL(0, matcher.GetFallbackMaskCount());
+    for (const std::string name : {"file.txt", ".txt", "a.b.txt", "archive.tar.gz", "abc", "a.c", "123", "Z", "*",
+                                   "[x", "\xd0\xb0.txt"}) {
+        BOOST_CHECK_MESSAGE(matcher.Matches(name), name);
+    }
+    for (const std::string name : {"file.TXT", "file.txt.bak", "txt", "archive.gz", "ac", "abcd", "x", "a*", "a[",
+                                   "x.tar"}) {
+        BOOST_CHECK_MESSAGE(!matcher.Matches(name), name);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_match_all) {
+    for (const std::string mask : {".*", "glob:*", "regex:.*"}) {
+        const FileMaskMatcher matcher({mask});
+        for (const auto& name : kNames) {
+            BOOST_CHECK(matcher.Matches(name));
+        }
+    }
+    const FileMaskMatcher matcher(std::vector<std::string>{});
+    BOOST_CHECK(!matcher.Matches("a"));
+}
+
+// Far more states than the DFA may have, matched on the NFA.
+BOOST_AUTO_TEST_CASE(test_large_automaton) {
+    const std::string mask = "[ab]*a[ab]{20}";
+    const FileMaskMatcher matcher({mask});
+    BOOST_CHECK_EQUAL(0, matcher.GetFallbackMaskCount());
+    const boost::regex regex(mask);
+    for (const auto& name : {std::string(21, 'a'), "b" + std::string(20, 'a'), "a" + std::string(20, 'b'),
+                                   "ab" + std::string(20, 'b'), std::string(20, 'a')}) {
+        BOOST_CHECK_EQUAL(boost::regex_match(name, regex), matcher.Matches(name));
+    }
+}
+
+}
@@ -1,6 +1,8 @@
 #define BOOST_TEST_MODULE test_hash
 
 #include "hash.h"
+#include "hash_kernels.h"
+#include "cpu_features.h"
 #include <iostream>
 #include <iomanip>
 #include <boost/test/unit_test.hpp>
@@ -11,12 +13,14 @@ BOOST_AUTO_TEST_SUITE(test_hash)
 void TestHashAlgorithm(const std::string& hash_algorithm, const std::string& block,
                        const std::string& expected_hash_hex, const size_t expected_result_size) {
     const auto result = GetHashStrategy(hash_algorithm)(block);
-    BOOST_CHECK_EQUAL(expected_hash_hex, result);
-    BOOST_CHECK_EQUAL(expected_result_size, result.size());
+    BOOST_CHECK_EQUAL(expected_hash_hex, GetHexHashRepresentation(result));
+    BOOST_CHECK_EQUAL(expected_result_size, GetHexHashRepresentation(result).size());
+    BOOST_CHECK_EQUAL(expected_result_size, 2 * result.size);
 }
 
 BOOST_AUTO_TEST_CASE(test_possible_hash_algorithms) {
-    BOOST_CHECK(GetPossibleHashAlgorithms() == std::vector<std::string>({"crc32", "hash_combine", "md5", "sha1"}));
+    BOOST_CHECK(GetPossibleHashAlgorithms() == std::vector<std::string>(
+            {"auto", "crc32", "crc32c", "hash_combine", "md5", "sha1", "sha256", "xxh128", "xxh3"}));
 }
 
 BOOST_AUTO_TEST_CASE(test_hash_algorithms) {
@@ -25,6 +29,121 @@ BOOST_AUTO_TEST_CASE(test_hash_algorithms) {
     TestHashAlgorithm("hash_combine", block, "501f002eee0fa5c7", 16);
     TestHashAlgorithm("md5", block, "552e21cd4cd9918678e3c1a0df491bc3", 32);
     TestHashAlgorithm("sha1", block, "c763aa3754d99873e16232471e7c05a077da2e63", 40);
+    TestHashAlgorithm("crc32c", block, "2d7d20e7", 8);
+    TestHashAlgorithm("sha256", block, "b94f6f125c79e3a5ffaa826f584c10d52ada669e6762051b826b55776d05aed2", 64);
+    TestHashAlgorithm("xxh3", block, "9adb6b467fc89847", 16);
+    TestHashAlgorithm("xxh128", block, "af39b609db8d13d04f31bb282b151b71", 32);
+    TestHashAlgorithm("auto", block, "af39b609db8d13d04f31bb282b151b71", 32);
+}
+
+BOOST_AUTO_TEST_CASE(test_resolve_hash_algorithm) {
+    BOOST_CHECK_EQUAL("xxh128", ResolveHashAlgorithm("auto"));
+    BOOST_CHECK_EQUAL("md5", ResolveHashAlgorithm("md5"));
+}
+
+std::string MakeTestData(size_t size) {
+    std::string result(size, 0);
+    uint32_t state = 1;
+    for (auto& c : result) {
+        state = state * 1103515245 + 12345;
+        c = static_cast<char>(state >> 16);
+    }
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_accelerated_kernels) {
+    // sizes cover every length class of xxh3, sha padding with one and two blocks and the crc32c streams
+    const std::vector<size_t> sizes{0, 1, 3, 4, 8, 9, 16, 17, 55, 56, 64, 100, 128, 129, 240, 241, 1024, 1025,
+                                    4096, 24577, 100000};
+    const auto& cpu_features = GetCpuFeatures();
+    for (const size_t size : sizes) {
+        const auto data = MakeTestData(size);
+        if (cpu_features.sse42) {
+            BOOST_CHECK_EQUAL(Crc32cScalar(0, data.data(), size), Crc32cSse42(0, data.data(), size));
+        }
+        if (cpu_features.sha) {
+            BOOST_CHECK(CalcSha1(data.data(), size, Sha1CompressScalar) == CalcSha1(data.data(), size, Sha1CompressShaNi));
+            BOOST_CHECK(CalcSha256(data.data(), size, Sha256CompressScalar) ==
+                        CalcSha256(data.data(), size, Sha256CompressShaNi));
+        }
+        std::vector<Xxh3Kernel> kernels{Xxh3Kernel::kSse2};
+        if (cpu_features.avx2) {
+            kernels.push_back(Xxh3Kernel::kAvx2);
+        }
+        for (const auto kernel : kernels) {
+            BOOST_CHECK_EQUAL(Xxh3_64(data.data(), size, Xxh3Kernel::kScalar), Xxh3_64(data.data(), size, kernel));
+            const auto expected = Xxh3_128(data.data(), size, Xxh3Kernel::kScalar);
+            const auto result = Xxh3_128(data.data(), size, kernel);
+            BOOST_CHECK_EQUAL(expected.low, result.low);
+            BOOST_CHECK_EQUAL(expected.high, result.high);
+        }
+    }
+    BOOST_CHECK_EQUAL(0xe3069283, Crc32c(0, "123456789", 9));
+    BOOST_CHECK_EQUAL(Crc32c(0, "123456789", 9), Crc32c(Crc32c(0, "1234", 4), "56789", 5));
+}
+
+BOOST_AUTO_TEST_CASE(test_multi_buffer_kernels) {
+    const auto& cpu_features = GetCpuFeatures();
+    std::vector<MultiBufferKernel> kernels;
+    if (cpu_features.avx2) {
+        kernels.push_back(MultiBufferKernel::kAvx2);
+    }
+    if (cpu_features.avx512f) {
+        kernels.push_back(MultiBufferKernel::kAvx512);
+    }
+    const auto md5 = GetHashStrategy("md5");
+    for (const auto kernel : kernels) {
+        const size_t lane_count = GetLaneCount(kernel);
+        for (const size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 120, 1000, 4096}) {
+            std::vector<std::string> messages;
+            std::vector<const uint8_t*> pointers;
+            for (size_t lane = 0; lane < lane_count; ++lane) {
+                messages.push_back(MakeTestData(size + lane).substr(lane));
+            }
+            for (const auto& message : messages) {
+                pointers.push_back(reinterpret_cast<const uint8_t*>(message.data()));
+            }
+            for (const size_t count : {size_t(1), lane_count - 1, lane_count}) {
+                std::vector<Md5State> md5_digests(count);
+                std::vector<Sha1State> sha1_digests(count);
+                CalcMd5MultiBuffer(pointers.data(), count, size, md5_digests.data(), kernel);
+                CalcSha1MultiBuffer(pointers.data(), count, size, sha1_digests.data(), kernel);
+                for (size_t lane = 0; lane < count; ++lane) {
+                    BOOST_CHECK(md5(messages[lane]) == HashValue(md5_digests[lane].data(), 16));
+                    BOOST_CHECK(CalcSha1(messages[lane].data(), size, Sha1CompressScalar) == sha1_digests[lane]);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_hash_strategy) {
+    const auto data = MakeTestData(10000);
+    std::vector<std::string_view> blocks;
+    // runs of equal sizes longer and shorter than the lanes
+    for (size_t i = 0; i < 40; ++i) {
+        blocks.push_back(std::string_view(data).substr(i * 7, i < 20 ? 100 : i < 23 ? 4096 : 64 + i % 2));
+    }
+    for (const auto& hash_algorithm : GetPossibleHashAlgorithms()) {
+        const auto hash_strategy = GetHashStrategy(hash_algorithm);
+        std::vector<HashValue> digests(blocks.size());
+        GetBatchHashStrategy(hash_algorithm)(blocks.data(), blocks.size(), digests.data());
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            BOOST_CHECK(hash_strategy(blocks[i]) == digests[i]);
+        }
+        BOOST_CHECK_GE(GetHashBatchSize(hash_algorithm), 1);
+    }
+    BOOST_CHECK_EQUAL(1, GetHashBatchSize("xxh128"));
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_value) {
+    const auto hash_strategy = GetHashStrategy("md5");
+    const auto hash = hash_strategy("some text");
+    BOOST_CHECK(hash == hash_strategy("some text"));
+    BOOST_CHECK(hash != hash_strategy("other text"));
+    BOOST_CHECK(!(hash < hash) && (hash < hash_strategy("other text")) != (hash_strategy("other text") < hash));
+    BOOST_CHECK_EQUAL(std::hash<HashValue>{}(hash), std::hash<HashValue>{}(hash_strategy("some text")));
+    BOOST_CHECK(hash != GetHashStrategy("crc32")("some text"));
 }
 
 }
@@ -0,0 +1,120 @@
+#define BOOST_TEST_MODULE test_hash_cache
+
+#include "hash_cache.h"
+#include <iostream>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_hash_cache)
+
+static const std::string kRootPath = "test_hash_cache_dir";
+static const size_t kBlockSize = 4096;
+
+fs::path GetCachePath() {
+    const fs::path root_path = fs::temp_directory_path() / kRootPath;
+    fs::create_directories(root_path);
+    return root_path / "cache";
+}
+
+void ResetCache() {
+    fs::remove(GetCachePath());
+}
+
+FileInfo MakeFileInfo(uint64_t inode, int64_t mtime_ns = 1) {
+    FileInfo file_info{"file" + std::to_string(inode), 100};
+    file_info.device = 1;
+    file_info.inode = inode;
+    file_info.mtime_ns = mtime_ns;
+    return file_info;
+}
+
+BOOST_AUTO_TEST_CASE(test_save_load) {
+    ResetCache();
+    {
+        HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20);
+        BOOST_CHECK_EQUAL("", hash_cache.Lookup(MakeFileInfo(1)));
+        hash_cache.Store(MakeFileInfo(1), "digests1");
+        hash_cache.Store(MakeFileInfo(2), "digests2");
+        hash_cache.Save();
+    }
+    HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20);
+    BOOST_CHECK_EQUAL("digests1", hash_cache.Lookup(MakeFileInfo(1)));
+    BOOST_CHECK_EQUAL("digests2", hash_cache.Lookup(MakeFileInfo(2)));
+    BOOST_CHECK_EQUAL("", hash_cache.Lookup(MakeFileInfo(2, 2)));
+    BOOST_CHECK_EQUAL("", hash_cache.Lookup(MakeFileInfo(3)));
+    const auto stats = hash_cache.GetStats();
+    BOOST_CHECK_EQUAL(2, stats.hits);
+    BOOST_CHECK_EQUAL(2, stats.misses);
+}
+
+BOOST_AUTO_TEST_CASE(test_longer_digests_win) {
+    ResetCache();
+    HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20);
+    hash_cache.Store(MakeFileInfo(1), "ab");
+    hash_cache.Store(MakeFileInfo(1), "abcd");
+    hash_cache.Store(MakeFileInfo(1), "ab");
+    BOOST_CHECK_EQUAL("abcd", hash_cache.Lookup(MakeFileInfo(1)));
+}
+
+BOOST_AUTO_TEST_CASE(test_other_parameters) {
+    ResetCache();
+    {
+        HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20);
+        hash_cache.Store(MakeFileInfo(1), "digests");
+        hash_cache.Save();
+    }
+    const auto lookup = [](size_t block_size, size_t max_block_size, size_t probe_count,
+                           const std::string& hash_algorithm) {
+        return HashCache(GetCachePath(), block_size, max_block_size, probe_count, hash_algorithm, 1 << 20)
+                .Lookup(MakeFileInfo(1));
+    };
+    BOOST_CHECK_EQUAL("", lookup(kBlockSize * 2, kBlockSize * 2, 1, "md5"));
+    BOOST_CHECK_EQUAL("", lookup(kBlockSize, kBlockSize * 4, 1, "md5"));
+    BOOST_CHECK_EQUAL("", lookup(kBlockSize, kBlockSize, 3, "md5"));
+    BOOST_CHECK_EQUAL("", lookup(kBlockSize, kBlockSize, 1, "sha1"));
+    BOOST_CHECK_EQUAL("digests", lookup(kBlockSize, kBlockSize, 1, "md5"));
+}
+
+BOOST_AUTO_TEST_CASE(test_damaged_file) {
+    ResetCache();
+    {
+        HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20);
+        hash_cache.Store(MakeFileInfo(1), "digests");
+        hash_cache.Save();
+    }
+    const auto file_size = fs::file_size(GetCachePath());
+    fs::resize_file(GetCachePath(), file_size - 1);
+    BOOST_CHECK_EQUAL("", HashCache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20).Lookup(MakeFileInfo(1)));
+
+    {
+        fs::ofstream out(GetCachePath(), std::ios::binary | std::ios::trunc);
+        out << std::string(file_size, 'x');
+    }
+    BOOST_CHECK_EQUAL("", HashCache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", 1 << 20).Lookup(MakeFileInfo(1)));
+}
+
+BOOST_AUTO_TEST_CASE(test_eviction) {
+    ResetCache();
+    const std::string digests(100, 'd');
+    // room for the header and two entries
+    const uintmax_t max_size = 420;
+    {
+        HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", max_size);
+        hash_cache.Store(MakeFileInfo(1), digests);
+        hash_cache.Store(MakeFileInfo(2), digests);
+        hash_cache.Save();
+    }
+    {
+        HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", max_size);
+        BOOST_CHECK_EQUAL(digests, hash_cache.Lookup(MakeFileInfo(2)));
+        hash_cache.Store(MakeFileInfo(3), digests);
+        hash_cache.Save();
+    }
+    BOOST_CHECK_LE(fs::file_size(GetCachePath()), max_size);
+    HashCache hash_cache(GetCachePath(), kBlockSize, kBlockSize, 1, "md5", max_size);
+    BOOST_CHECK_EQUAL("", hash_cache.Lookup(MakeFileInfo(1)));
+    BOOST_CHECK_EQUAL(digests, hash_cache.Lookup(MakeFileInfo(2)));
+    BOOST_CHECK_EQUAL(digests, hash_cache.Lookup(MakeFileInfo(3)));
+}
+
+}
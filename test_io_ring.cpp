@@ -0,0 +1,111 @@
+#define BOOST_TEST_MODULE test_io_ring
+
+#include "io_ring.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_io_ring)
+
+static const std::string kRootPath = "test_io_ring_dir";
+
+fs::path CreateFile(const std::string& file_name, const std::string& content) {
+    fs::path path = fs::temp_directory_path() / kRootPath / file_name;
+    fs::create_directories(path.parent_path());
+    fs::ofstream out{path};
+    out << content;
+    return path;
+}
+
+// Opens the file for the time of a test.
+class Descriptor {
+public:
+    explicit Descriptor(const fs::path& path) : fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+        BOOST_REQUIRE(fd_ != -1);
+    }
+    ~Descriptor() {
+        close(fd_);
+    }
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+BOOST_AUTO_TEST_CASE(test_read) {
+    if (!IsIoRingSupported()) {
+        return;
+    }
+    std::string content;
+    for (int i = 0; i < 1000; ++i) {
+        content += std::to_string(i);
+    }
+    const Descriptor descriptor(CreateFile("a", content));
+    for (const size_t queue_depth : {1, 3, 64}) {
+        IoRing ring(queue_depth, 16);
+        BOOST_CHECK_EQUAL(queue_depth, ring.GetQueueDepth());
+        // more requests than the queue depth, the last one runs past the end of file
+        const size_t request_count = (content.size() + 15) / 16;
+        std::vector<std::string> blocks(request_count);
+        std::vector<bool> requested(request_count);
+        ring.Read(request_count,
+                [&](size_t index) {
+                    BOOST_CHECK(index == 0 || requested[index - 1]);
+                    requested[index] = true;
+                    return ReadRequest{descriptor.Get(), index * 16, 16};
+                },
+                [&](size_t index, int error, std::string_view data) {
+                    BOOST_CHECK_EQUAL(0, error);
+                    BOOST_CHECK(blocks[index].empty());
+                    blocks[index] = data;
+                });
+        for (size_t i = 0; i < request_count; ++i) {
+            BOOST_CHECK_EQUAL(content.substr(i * 16, 16), blocks[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_read_error) {
+    if (!IsIoRingSupported()) {
+        return;
+    }
+    const Descriptor descriptor(CreateFile("b", "0123456789"));
+    IoRing ring(2, 4);
+    std::vector<int> errors(3, -1);
+    ring.Read(3,
+            [&](size_t index) {
+                // an invalid descriptor fails only its own read
+                return ReadRequest{index == 1 ? -1 : descriptor.Get(), 0, 4};
+            },
+            [&](size_t index, int error, std::string_view) { errors[index] = error; });
+    BOOST_CHECK_EQUAL(0, errors[0]);
+    BOOST_CHECK_EQUAL(EBADF, errors[1]);
+    BOOST_CHECK_EQUAL(0, errors[2]);
+}
+
+BOOST_AUTO_TEST_CASE(test_callback_exception) {
+    if (!IsIoRingSupported()) {
+        return;
+    }
+    const Descriptor descriptor(CreateFile("c", "0123456789"));
+    IoRing ring(4, 2);
+    size_t requested = 0;
+    BOOST_CHECK_THROW(ring.Read(5,
+            [&](size_t index) {
+                ++requested;
+                return ReadRequest{descriptor.Get(), index * 2, 2};
+            },
+            [&](size_t, int, std::string_view) { throw std::runtime_error("stop"); }),
+            std::runtime_error);
+    BOOST_CHECK_LE(requested, 5);
+    // the ring is left empty and can be used again
+    std::string data;
+    ring.Read(1, [&](size_t) { return ReadRequest{descriptor.Get(), 8, 2}; },
+            [&](size_t, int, std::string_view block) { data = block; });
+    BOOST_CHECK_EQUAL("89", data);
+}
+
+}
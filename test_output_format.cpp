@@ -0,0 +1,55 @@
+#define BOOST_TEST_MODULE test_output_format
+
+#include "output_format.h"
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_output_format)
+
+static const FileGroup kFileGroup{3, {"/a/b", "/c d/\"e\"\n"}, {0, 1}};
+
+std::string WriteFileGroups(OutputFormat output_format) {
+    std::stringstream ss;
+    WriteFileGroup(ss, kFileGroup, output_format);
+    WriteFileGroup(ss, {5, {"/f", "/g"}, {0, 1}}, output_format);
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE(test_possible_output_formats) {
+    BOOST_CHECK((std::vector<std::string>{"json", "nul", "text"}) == GetPossibleOutputFormats());
+    BOOST_CHECK(OutputFormat::kJsonLines == GetOutputFormat("json"));
+}
+
+BOOST_AUTO_TEST_CASE(test_text) {
+    BOOST_CHECK_EQUAL("\"/a/b\"\n\"/c d/&\"e&\"\n\"\n\n\"/f\"\n\"/g\"\n\n", WriteFileGroups(OutputFormat::kText));
+}
+
+BOOST_AUTO_TEST_CASE(test_nul) {
+    const char expected[] = "/a/b\0/c d/\"e\"\n\0\0/f\0/g\0\0";
+    BOOST_CHECK_EQUAL(std::string(expected, sizeof(expected) - 1), WriteFileGroups(OutputFormat::kNul));
+}
+
+BOOST_AUTO_TEST_CASE(test_json_lines) {
+    BOOST_CHECK_EQUAL("{\"size\":3,\"paths\":[\"/a/b\",\"/c d/\\\"e\\\"\\n\"]}\n"
+                      "{\"size\":5,\"paths\":[\"/f\",\"/g\"]}\n",
+                      WriteFileGroups(OutputFormat::kJsonLines));
+    std::stringstream ss;
+    WriteFileGroup(ss, {1, {std::string("/\x01")}, {0}}, OutputFormat::kJsonLines);
+    BOOST_CHECK_EQUAL("{\"size\":1,\"paths\":[\"/\\u0001\"]}\n", ss.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_hard_links) {
+    const FileGroup file_group{3, {"/a", "/b", "/c"}, {0, 1, 0}};
+    std::stringstream text;
+    WriteFileGroup(text, file_group, OutputFormat::kText, true);
+    BOOST_CHECK_EQUAL("\"/a\"\n\"/b\"\n\"/c\" (hard link)\n\n", text.str());
+    std::stringstream json;
+    WriteFileGroup(json, file_group, OutputFormat::kJsonLines, true);
+    BOOST_CHECK_EQUAL("{\"size\":3,\"paths\":[\"/a\",\"/b\",\"/c\"],\"links\":[0,1,0]}\n", json.str());
+    std::stringstream unmarked;
+    WriteFileGroup(unmarked, file_group, OutputFormat::kJsonLines);
+    BOOST_CHECK_EQUAL("{\"size\":3,\"paths\":[\"/a\",\"/b\",\"/c\"]}\n", unmarked.str());
+}
+
+}
@@ -3,6 +3,10 @@
 #include "hash.h"
 #include "reader.h"
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/magic.h>
+#include <sys/vfs.h>
 #include <boost/test/unit_test.hpp>
 
 
@@ -22,9 +26,9 @@ void CreateFile(const std::string& content) {
 }
 
 
-void TestFileBlockReader(const std::string& content, size_t block_size) {
+void TestFileBlockReader(const std::string& content, size_t block_size, ReadMode read_mode = ReadMode::kPread) {
     CreateFile(content);
-    FileBlockReader reader(GetTestFilePath(), block_size);
+    FileBlockReader reader(GetTestFilePath(), block_size, read_mode);
     for (size_t i = 0; i < content.size(); i += block_size) {
         assert(!reader.IsEnd());
         auto expected_block = content.substr(i, block_size);
@@ -36,6 +40,16 @@ void TestFileBlockReader(const std::string& content, size_t block_size) {
     assert(reader.IsEnd());
 }
 
+void TestFileBlockReaderView(const std::string& content, size_t block_size, ReadMode read_mode) {
+    CreateFile(content);
+    FileBlockReader reader(GetTestFilePath(), block_size, read_mode, content.size());
+    for (size_t i = 0; i < content.size(); i += block_size) {
+        BOOST_REQUIRE(!reader.IsEnd());
+        BOOST_CHECK_EQUAL(content.substr(i, block_size), reader.ReadNextBlockView());
+    }
+    BOOST_CHECK(reader.IsEnd());
+}
+
 BOOST_AUTO_TEST_CASE(test_simple) {
     std::vector<std::string> contents{
         "short",
@@ -50,5 +64,134 @@ BOOST_AUTO_TEST_CASE(test_simple) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_read_modes) {
+    const std::string content = "long1 long2 long3 long4 long5 long6 long7 long8 long9 long10 text";
+    for (const auto& read_mode_name : GetPossibleReadModes()) {
+        const auto read_mode = GetReadMode(read_mode_name);
+        for (const size_t block_size : {1, 3, 10, 64, 1000}) {
+            TestFileBlockReader(content, block_size, read_mode);
+            TestFileBlockReaderView(content, block_size, read_mode);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_growing_blocks) {
+    const std::string content = "0123456789abcdefghijklmnopqrstuvwxyz";
+    for (const auto& read_mode_name : GetPossibleReadModes()) {
+        CreateFile(content);
+        FileBlockReader reader(GetTestFilePath(), 2, GetReadMode(read_mode_name), std::nullopt, 8);
+        BOOST_CHECK_EQUAL("01", reader.ReadNextBlockView());
+        BOOST_CHECK_EQUAL("2345", reader.ReadNextBlockView());
+        // skipped blocks grow as well
+        reader.SkipNextBlock();
+        BOOST_CHECK_EQUAL("efghijkl", reader.ReadNextBlockView());
+        BOOST_CHECK_EQUAL("mnopqrst", reader.ReadNextBlockView());
+        BOOST_CHECK_EQUAL(std::string("uvwxyz") + std::string(2, 0), reader.ReadNextBlock());
+        BOOST_CHECK(reader.IsEnd());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_read_block_view) {
+    const std::string content = "0123456789";
+    for (const auto& read_mode_name : GetPossibleReadModes()) {
+        CreateFile(content);
+        FileBlockReader reader(GetTestFilePath(), 3, GetReadMode(read_mode_name));
+        BOOST_CHECK_EQUAL("789", reader.ReadBlockView(7, 3));
+        // the sequential position is unchanged
+        BOOST_CHECK_EQUAL("012", reader.ReadNextBlockView());
+        BOOST_CHECK_EQUAL("45", reader.ReadBlockView(4, 2));
+        BOOST_CHECK_EQUAL("345", reader.ReadNextBlockView());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_unaligned_reads) {
+    // longer than the O_DIRECT readahead, neither the blocks nor the size are multiples of a page
+    std::string content;
+    for (size_t i = 0; content.size() < 200000; ++i) {
+        content += std::to_string(i) + ' ';
+    }
+    for (const auto& read_mode_name : GetPossibleReadModes()) {
+        CreateFile(content);
+        FileBlockReader reader(GetTestFilePath(), 1000, GetReadMode(read_mode_name), std::nullopt, 30000);
+        BOOST_CHECK_EQUAL(content.substr(content.size() - 5000), reader.ReadBlockView(content.size() - 5000, 5000));
+        uintmax_t offset = 0;
+        for (size_t block_size = 1000; !reader.IsEnd(); block_size = std::min<size_t>(block_size * 2, 30000)) {
+            BOOST_REQUIRE_EQUAL(content.substr(offset, block_size), reader.ReadNextBlockView());
+            offset += block_size;
+            BOOST_CHECK_EQUAL(content.substr(4097, 3), reader.ReadBlockView(4097, 3));
+        }
+        BOOST_CHECK_GE(offset, content.size());
+        reader.Close();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_dropped_pages) {
+    const std::string content(1 << 20, 'a');
+    CreateFile(content);
+    struct statfs file_system{};
+    BOOST_REQUIRE_EQUAL(0, statfs(GetTestFilePath().c_str(), &file_system));
+    if (file_system.f_type == TMPFS_MAGIC) {
+        // tmpfs pages are the file itself, they can't be dropped
+        return;
+    }
+    for (const auto read_mode : {ReadMode::kFadvise, ReadMode::kDirect}) {
+        // the written pages are evicted first, so only the reads could bring them back
+        const int fd = open(GetTestFilePath().c_str(), O_RDONLY);
+        BOOST_REQUIRE_NE(-1, fd);
+        fsync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+        BOOST_REQUIRE_EQUAL(0, GetResidentBytes(GetTestFilePath(), content.size()));
+
+        FileBlockReader reader(GetTestFilePath(), 100000, read_mode);
+        uintmax_t size = 0;
+        while (!reader.IsEnd()) {
+            size += reader.ReadNextBlockView().size();
+        }
+        reader.Close();
+        BOOST_CHECK_EQUAL(content.size(), size);
+        BOOST_CHECK_EQUAL(0, GetResidentBytes(GetTestFilePath(), content.size()));
+    }
+    BOOST_CHECK_EQUAL(0, GetResidentBytes(GetTestFilePath().string() + ".missing", content.size()));
+}
+
+BOOST_AUTO_TEST_CASE(test_truncated_file) {
+    // the file was listed with 10 bytes and truncated since, the mapping would raise SIGBUS past its end
+    CreateFile("01234");
+    for (const auto& read_mode_name : GetPossibleReadModes()) {
+        FileBlockReader reader(GetTestFilePath(), 4, GetReadMode(read_mode_name), 10);
+        BOOST_CHECK_EQUAL("0123", reader.ReadNextBlockView());
+        BOOST_CHECK_EQUAL("4", reader.ReadNextBlockView());
+        BOOST_CHECK(reader.IsEnd());
+        reader.Close();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_block_requests) {
+    const std::string content = "0123456789";
+    CreateFile(content);
+    FileBlockReader reader(GetTestFilePath(), 4, ReadMode::kIoUring);
+    const auto read = [](const ReadRequest& request) {
+        std::string result(request.size, 0);
+        result.resize(pread(request.fd, result.data(), request.size, request.offset));
+        return result;
+    };
+    BOOST_CHECK_EQUAL("789", read(reader.GetBlockRequest(7, 3)));
+    BOOST_CHECK_EQUAL("0123", read(reader.GetNextBlockRequest()));
+    reader.SkipNextBlock();
+    BOOST_CHECK_EQUAL("4567", reader.ReadNextBlockView());
+    BOOST_CHECK_EQUAL("89", read(reader.GetNextBlockRequest()));
+    reader.SkipNextBlock();
+    BOOST_CHECK(reader.IsEnd());
+    reader.Close();
+    BOOST_CHECK(!reader.IsOpen());
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_file) {
+    CreateFile("");
+    FileBlockReader reader(GetTestFilePath(), 10);
+    BOOST_CHECK(reader.IsEnd());
+}
+
 
 }
@@ -0,0 +1,89 @@
+#define BOOST_TEST_MODULE test_reader_pool
+
+#include "reader_pool.h"
+#include <iostream>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_reader_pool)
+
+static const std::string kRootPath = "test_reader_pool_dir";
+
+fs::path CreateFile(const std::string& file_name, const std::string& content) {
+    fs::path path = fs::temp_directory_path() / kRootPath / file_name;
+    fs::create_directories(path.parent_path());
+    fs::ofstream out{path};
+    out << content;
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(test_open_readers_limit) {
+    const std::vector<std::string> contents{"aaaaaa", "bbbbbb", "cccccc", "dddddd"};
+    std::vector<std::unique_ptr<FileBlockReader>> readers;
+    for (size_t i = 0; i < contents.size(); ++i) {
+        readers.push_back(std::make_unique<FileBlockReader>(CreateFile(std::to_string(i), contents[i]), 2));
+    }
+
+    ReaderPool reader_pool(2);
+    for (size_t offset = 0; offset < 6; offset += 2) {
+        for (size_t i = 0; i < readers.size(); ++i) {
+            const auto lease = reader_pool.Acquire(*readers[i]);
+            BOOST_CHECK_EQUAL(contents[i].substr(offset, 2), readers[i]->ReadNextBlockView());
+            const auto open_readers = std::count_if(readers.begin(), readers.end(),
+                    [](const auto& reader) { return reader->IsOpen(); });
+            BOOST_CHECK_LE(open_readers, 2);
+        }
+    }
+    for (auto& reader : readers) {
+        BOOST_CHECK(reader->IsEnd());
+        reader_pool.Release(*reader);
+        BOOST_CHECK(!reader->IsOpen());
+    }
+
+    const auto stats = reader_pool.GetStats();
+    BOOST_CHECK_EQUAL(0, stats.hits);
+    BOOST_CHECK_EQUAL(4, stats.misses);
+    BOOST_CHECK_EQUAL(8, stats.reopens);
+    BOOST_CHECK_EQUAL(2, stats.peak_open_readers);
+}
+
+BOOST_AUTO_TEST_CASE(test_hits) {
+    FileBlockReader reader(CreateFile("hits", "0123456789"), 1);
+    ReaderPool reader_pool(1);
+    for (char c = '0'; c <= '9'; ++c) {
+        const auto lease = reader_pool.Acquire(reader);
+        BOOST_CHECK_EQUAL(std::string(1, c), reader.ReadNextBlockView());
+    }
+    reader_pool.Release(reader);
+
+    const auto stats = reader_pool.GetStats();
+    BOOST_CHECK_EQUAL(9, stats.hits);
+    BOOST_CHECK_EQUAL(1, stats.misses);
+    BOOST_CHECK_EQUAL(0, stats.reopens);
+}
+
+BOOST_AUTO_TEST_CASE(test_leased_reader_is_not_closed) {
+    FileBlockReader first_reader(CreateFile("first", "0123456789"), 1);
+    FileBlockReader second_reader(CreateFile("second", "0123456789"), 1);
+    ReaderPool reader_pool(1);
+    {
+        const auto first_lease = reader_pool.Acquire(first_reader);
+        BOOST_CHECK_EQUAL("0", first_reader.ReadNextBlockView());
+        const auto second_lease = reader_pool.Acquire(second_reader);
+        BOOST_CHECK_EQUAL("0", second_reader.ReadNextBlockView());
+        BOOST_CHECK(first_reader.IsOpen());
+        BOOST_CHECK(second_reader.IsOpen());
+    }
+    // the limit is restored once the leases are returned
+    BOOST_CHECK_EQUAL(1, first_reader.IsOpen() + second_reader.IsOpen());
+    {
+        const auto lease = reader_pool.Acquire(first_reader);
+        BOOST_CHECK(first_reader.IsOpen());
+        BOOST_CHECK(!second_reader.IsOpen());
+        BOOST_CHECK_EQUAL("1", first_reader.ReadNextBlockView());
+    }
+    reader_pool.Release(first_reader);
+    reader_pool.Release(second_reader);
+}
+
+}
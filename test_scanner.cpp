@@ -1,9 +1,12 @@
 #define BOOST_TEST_MODULE test_scanner
 
+#include "file_filter.h"
 #include "scanner.h"
 #include <set>
 #include <unordered_set>
 #include <iostream>
+#include <sys/stat.h>
+#include <boost/crc.hpp>
 #include <boost/test/unit_test.hpp>
 
 
@@ -18,6 +21,7 @@ fs::path GetRootPath() {
 void CreateFile(const std::string& file_name, const std::string& content) {
     assert(fs::path{file_name}.is_relative());
     fs::path path = GetRootPath() / file_name;
+    fs::create_directories(path.parent_path());
     fs::ofstream out{path};
     out << content;
 }
@@ -51,8 +55,9 @@ std::vector<std::vector<fs::path>> CanonizeFileGroups(std::vector<std::vector<fs
     return file_groups;
 }
 
-void TestScanner(std::unordered_map<std::string, std::string> file_name_to_file_content) {
-    ResetRootDirectory();
+// Creates the files and returns the canonized groups of equal ones.
+std::vector<std::vector<fs::path>> CreateFiles(
+        const std::unordered_map<std::string, std::string>& file_name_to_file_content) {
     std::unordered_map<std::string, std::vector<fs::path>> content_to_file_names;
     for (const auto& [name, content] : file_name_to_file_content) {
         CreateFile(name, content);
@@ -64,9 +69,40 @@ void TestScanner(std::unordered_map<std::string, std::string> file_name_to_file_
             expected_file_groups.push_back(file_names);
         }
     }
+    return CanonizeFileGroups(std::move(expected_file_groups));
+}
 
-    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 1, "sha1"};
-    BOOST_CHECK(CanonizeFileGroups(expected_file_groups) == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+void SortFileGroups(std::vector<FileGroup>& file_groups) {
+    std::sort(file_groups.begin(), file_groups.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.paths < rhs.paths;
+    });
+}
+
+// Collects the groups the scanner reports to the callback, sorted by their paths.
+std::vector<FileGroup> FindFileGroups(const Scanner& scanner) {
+    std::vector<FileGroup> file_groups;
+    scanner.FindEqualFileGroups([&file_groups](FileGroup file_group) {
+        file_groups.push_back(std::move(file_group));
+    });
+    SortFileGroups(file_groups);
+    return file_groups;
+}
+
+void CheckFileGroups(const std::vector<FileGroup>& expected_file_groups, const std::vector<FileGroup>& file_groups) {
+    BOOST_REQUIRE_EQUAL(expected_file_groups.size(), file_groups.size());
+    for (size_t i = 0; i < file_groups.size(); ++i) {
+        BOOST_CHECK_EQUAL(expected_file_groups[i].file_size, file_groups[i].file_size);
+        BOOST_CHECK(expected_file_groups[i].paths == file_groups[i].paths);
+        BOOST_CHECK(expected_file_groups[i].link_ids == file_groups[i].link_ids);
+    }
+}
+
+void TestScanner(const std::unordered_map<std::string, std::string>& file_name_to_file_content, int block_size = 1,
+                 ScannerOptions options = {}) {
+    ResetRootDirectory();
+    const auto expected_file_groups = CreateFiles(file_name_to_file_content);
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, block_size, "sha1", options};
+    BOOST_CHECK(expected_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
 }
 
 BOOST_AUTO_TEST_CASE(simple_test) {
@@ -80,4 +116,494 @@ BOOST_AUTO_TEST_CASE(simple_test) {
     TestScanner({{"a", "11"}, {"b", "11"}, {"c", "121"}, {"d", "121"}, {"e", "121"}, {"f", "222"}, {"g", "222"}});
 }
 
+BOOST_AUTO_TEST_CASE(test_different_sizes) {
+    TestScanner({{"a", "1"}, {"b", std::string("1\0", 2)}}, 2);
+    TestScanner({{"a", "12"}, {"b", "12"}, {"c", "123"}, {"d", "1234"}}, 4);
+    TestScanner({{"a", "1"}, {"b", "1"}, {"c", "22"}, {"d", "22"}, {"e", "333"}}, 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_threads) {
+    std::unordered_map<std::string, std::string> file_name_to_file_content;
+    for (int i = 0; i < 64; ++i) {
+        file_name_to_file_content[std::to_string(i)] = std::string(100 + i % 3, 'a') + std::to_string(i % 5);
+    }
+    for (size_t thread_count : {2, 4}) {
+        ScannerOptions options;
+        options.thread_count = thread_count;
+        TestScanner({{"a", "11"}, {"b", "11"}, {"c", "121"}, {"d", "121"}, {"e", "121"}, {"f", "122"}}, 1, options);
+        TestScanner(file_name_to_file_content, 1, options);
+        TestScanner(file_name_to_file_content, 7, options);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_open_files) {
+    ResetRootDirectory();
+    for (int i = 0; i < 32; ++i) {
+        CreateFile(std::to_string(i), std::string(100, 'a') + std::to_string(i % 4));
+    }
+    ScannerOptions options;
+    options.thread_count = 2;
+    // the multi-buffer hash batches of both threads together stay within the limit
+    options.max_open_files = 4;
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 16, "md5", options};
+    BOOST_CHECK_EQUAL(4, scanner.FindEqualFileGroups().size());
+    BOOST_CHECK_LE(scanner.GetReaderPoolStats().peak_open_readers, 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_io_ring_open_files) {
+    ResetRootDirectory();
+    for (int i = 0; i < 64; ++i) {
+        CreateFile(std::to_string(i), std::string(100, 'a') + std::to_string(i % 4));
+    }
+    ScannerOptions options;
+    options.read_mode = ReadMode::kIoUring;
+    options.thread_count = 3;
+    // the rings of all the threads together keep no more files open than the limit
+    options.max_open_files = 6;
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 16, "sha1", options};
+    BOOST_CHECK_EQUAL(4, scanner.FindEqualFileGroups().size());
+    BOOST_CHECK_LE(scanner.GetReaderPoolStats().peak_open_readers, 6);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_modes) {
+    std::unordered_map<std::string, std::string> file_name_to_file_content;
+    for (int i = 0; i < 64; ++i) {
+        file_name_to_file_content[std::to_string(i)] = std::string(100 + i % 3, 'a') + std::to_string(i % 5);
+    }
+    for (const auto& read_mode_name : GetPossibleReadModes()) {
+        for (size_t queue_depth : {1, 5}) {
+            for (size_t thread_count : {1, 3}) {
+                ScannerOptions options;
+                options.read_mode = GetReadMode(read_mode_name);
+                options.queue_depth = queue_depth;
+                options.max_block_size = 16;
+                options.max_open_files = 4;
+                options.thread_count = thread_count;
+                TestScanner(file_name_to_file_content, 1, options);
+                TestScanner(file_name_to_file_content, 7, options);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_options) {
+    ResetRootDirectory();
+    ScannerOptions options;
+    options.max_open_files = 0;
+    BOOST_CHECK_THROW((Scanner{{"."}, {}, 0, 0, {".*"}, 1, "md5", options}), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_physical_order) {
+    ResetRootDirectory();
+    std::unordered_map<std::string, std::string> file_name_to_file_content;
+    for (int i = 0; i < 40; ++i) {
+        file_name_to_file_content["d" + std::to_string(i % 2) + "/" + std::to_string(i)] =
+                std::string(50, 'a') + std::to_string(i % 3);
+    }
+    const auto expected_file_groups = CreateFiles(file_name_to_file_content);
+    for (const auto& directories : std::vector<std::vector<fs::path>>{{}, {"d0"}, {"d0", "d1"}, {"."}}) {
+        for (int block_size : {1, 16}) {
+            ScannerOptions options;
+            options.physical_order_directories = directories;
+            Scanner scanner{{"d0", "d1"}, {}, 0, 0, {".*"}, block_size, "sha1", options};
+            BOOST_CHECK(expected_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+        }
+    }
+
+    // the link ids of a group number its files in the order they were read
+    ScannerOptions options;
+    options.physical_order_directories = {"."};
+    Scanner scanner{{"d0", "d1"}, {}, 0, 0, {".*"}, 16, "sha1", options};
+    size_t group_count = 0;
+    scanner.FindEqualFileGroups([&group_count](FileGroup file_group) {
+        std::vector<std::pair<size_t, uint64_t>> offsets;
+        for (size_t i = 0; i < file_group.paths.size(); ++i) {
+            struct stat file_stat{};
+            BOOST_REQUIRE_EQUAL(0, stat(file_group.paths[i].c_str(), &file_stat));
+            const FileInfo file_info{file_group.paths[i], file_group.file_size, file_stat.st_dev, file_stat.st_ino};
+            offsets.emplace_back(file_group.link_ids[i], GetPhysicalOffset(file_info));
+        }
+        std::sort(offsets.begin(), offsets.end());
+        BOOST_CHECK(std::is_sorted(offsets.begin(), offsets.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.second < rhs.second;
+        }));
+        ++group_count;
+    });
+    BOOST_CHECK_EQUAL(3, group_count);
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_budget) {
+    ResetRootDirectory();
+    for (int i = 0; i < 120; ++i) {
+        const auto name = "d" + std::to_string(i % 3) + "/" + std::to_string(i);
+        // sizes 50 and 51, first blocks of 16 bytes differing in some files, ends differing in others
+        CreateFile(name, std::string(i % 4 == 0 ? 1 : 0, 'b') + std::to_string(i % 3) + std::string(48, 'a')
+                         + std::to_string(i % 5));
+    }
+    fs::create_hard_link("d0/0", "d1/link");
+    fs::create_hard_link("d2/5", "d2/link");
+    const auto find_groups = [](uintmax_t memory_budget, size_t thread_count) {
+        ScannerOptions options;
+        options.memory_budget = memory_budget;
+        options.thread_count = thread_count;
+        // d0 is reached twice, its files must not be doubled
+        Scanner scanner{{"d0", "d1", "d2", "."}, {}, 1, 0, {".*"}, 16, "sha1", options};
+        auto file_groups = FindFileGroups(scanner);
+        return std::make_pair(std::move(file_groups), scanner.GetScanStats());
+    };
+    const auto [expected_file_groups, expected_stats] = find_groups(0, 1);
+    BOOST_CHECK_EQUAL(0, expected_stats.spill_runs);
+    BOOST_REQUIRE_EQUAL(30, expected_file_groups.size());
+    // a budget of one byte spills every file and splits every size by the first blocks
+    for (uintmax_t memory_budget : {1, 4 << 10, 1 << 20}) {
+        for (size_t thread_count : {1, 3}) {
+            const auto [file_groups, stats] = find_groups(memory_budget, thread_count);
+            CheckFileGroups(expected_file_groups, file_groups);
+            BOOST_CHECK_EQUAL(expected_stats.files_listed, stats.files_listed);
+            BOOST_CHECK_EQUAL(expected_stats.candidate_files, stats.candidate_files);
+            BOOST_CHECK_EQUAL(expected_stats.size_buckets, stats.size_buckets);
+            BOOST_CHECK_EQUAL(memory_budget < (1 << 20), stats.spill_runs > 0);
+        }
+    }
+}
+
+// Every group is found by exactly one shard, in memory and with a memory budget.
+BOOST_AUTO_TEST_CASE(test_shards) {
+    ResetRootDirectory();
+    for (int i = 0; i < 60; ++i) {
+        CreateFile("d/" + std::to_string(i), std::string(i % 10 + 1, 'a') + std::to_string(i % 3));
+    }
+    const auto find_groups = [](size_t shard_count, size_t shard_index, uintmax_t memory_budget) {
+        ScannerOptions options;
+        options.shard_count = shard_count;
+        options.shard_index = shard_index;
+        options.memory_budget = memory_budget;
+        Scanner scanner{{"d"}, {}, 0, 0, {".*"}, 4, "md5", options};
+        auto file_groups = FindFileGroups(scanner);
+        BOOST_CHECK_EQUAL(60, scanner.GetScanStats().files_listed);
+        return file_groups;
+    };
+    const auto expected_file_groups = find_groups(1, 0, 0);
+    BOOST_REQUIRE_EQUAL(30, expected_file_groups.size());
+    for (uintmax_t memory_budget : {0, 1}) {
+        std::vector<FileGroup> file_groups;
+        for (size_t shard_index = 0; shard_index < 3; ++shard_index) {
+            const auto shard_file_groups = find_groups(3, shard_index, memory_budget);
+            BOOST_CHECK(shard_file_groups.size() < expected_file_groups.size());
+            file_groups.insert(file_groups.end(), shard_file_groups.begin(), shard_file_groups.end());
+        }
+        SortFileGroups(file_groups);
+        CheckFileGroups(expected_file_groups, file_groups);
+    }
+}
+
+// The index has to give the groups a full scan finds after every change.
+BOOST_AUTO_TEST_CASE(test_index) {
+    ResetRootDirectory();
+    for (int i = 0; i < 20; ++i) {
+        CreateFile("d" + std::to_string(i % 2) + "/" + std::to_string(i), std::string(20, 'a') + std::to_string(i % 4));
+    }
+    fs::create_hard_link("d0/0", "d0/link");
+    fs::create_directories("d1/excluded");
+    Scanner scanner{{"d0", "d1"}, {"d1/excluded"}, 1, 1, {".*"}, 4, "md5"};
+    const auto check_groups = [&scanner] {
+        std::vector<std::vector<fs::path>> file_groups;
+        for (auto& file_group : scanner.GetIndexedGroups()) {
+            file_groups.push_back(std::move(file_group.paths));
+        }
+        Scanner full_scanner{{"d0", "d1"}, {"d1/excluded"}, 1, 1, {".*"}, 4, "md5"};
+        BOOST_CHECK(full_scanner.FindEqualFileGroups() == file_groups);
+    };
+    scanner.BuildIndex();
+    check_groups();
+    const auto blocks_read = scanner.GetScanStats().blocks_read;
+
+    const auto root_path = fs::canonical(GetRootPath());
+    // a new file joins a group, only its size is refined again and the digests of the others are kept:
+    // the new file alone is read, its 6 blocks and the last one probed first
+    CreateFile("d1/new", std::string(20, 'a') + "0");
+    scanner.AddFile(root_path / "d1" / "new");
+    check_groups();
+    BOOST_CHECK_EQUAL(7, scanner.GetScanStats().blocks_read - blocks_read);
+
+    // a changed file moves to another size, its hard link with it
+    CreateFile("d0/0", "changed");
+    scanner.AddFile(root_path / "d0" / "0");
+    check_groups();
+    CreateFile("d0/2", "changed");
+    scanner.AddFile(root_path / "d0" / "2");
+    check_groups();
+
+    fs::remove("d1/1");
+    scanner.RemoveFile(root_path / "d1" / "1");
+    scanner.RemoveFile(root_path / "d1" / "missing");
+    check_groups();
+
+    // files the filter rejects are not added
+    CreateFile("d1/excluded/a", "changed");
+    scanner.AddFile(root_path / "d1" / "excluded" / "a");
+    fs::create_directories("d1/deep/deeper");
+    CreateFile("d1/deep/deeper/a", "changed");
+    scanner.AddFile(root_path / "d1" / "deep" / "deeper" / "a");
+    CreateFile("d1/deep/a", "changed");
+    scanner.AddFile(root_path / "d1" / "deep" / "a");
+    check_groups();
+
+    fs::remove_all("d1/deep");
+    scanner.RemoveDirectory(root_path / "d1" / "deep");
+    check_groups();
+}
+
+BOOST_AUTO_TEST_CASE(test_scan_stats) {
+    ResetRootDirectory();
+    CreateFile("a", "1234");
+    CreateFile("b", "1234");
+    CreateFile("c", "1235");
+    CreateFile("d", "1");
+    const fs::path trace_path = fs::temp_directory_path() / "test_scanner_trace.json";
+    fs::remove(trace_path);
+    ScannerOptions options;
+    options.measure_block_times = true;
+    options.trace_path = trace_path;
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 2, "md5", options};
+    BOOST_CHECK_EQUAL(1, scanner.FindEqualFileGroups().size());
+    auto stats = scanner.GetScanStats();
+    BOOST_CHECK_EQUAL(4, stats.files_listed);
+    BOOST_CHECK_EQUAL(3, stats.candidate_files);
+    BOOST_CHECK_EQUAL(1, stats.size_buckets);
+    BOOST_CHECK_EQUAL(1, stats.groups);
+    // the first blocks are equal, the second ones tell c apart
+    BOOST_CHECK_EQUAL(6, stats.blocks_read);
+    BOOST_CHECK_EQUAL(12, stats.bytes_read);
+    BOOST_CHECK_EQUAL(0, stats.cached_blocks);
+    BOOST_CHECK_EQUAL(3, stats.trie_nodes);
+    BOOST_CHECK_EQUAL(0, stats.refine_rounds);
+    BOOST_CHECK_GT(stats.refine_seconds, 0);
+
+    std::stringstream trace;
+    trace << fs::ifstream(trace_path).rdbuf();
+    BOOST_CHECK(trace.str().find("\"name\":\"list files\"") != std::string::npos);
+    BOOST_CHECK(trace.str().find("\"size\":4,\"files\":3") != std::string::npos);
+
+    // the counters are summed over the scans
+    BOOST_CHECK_EQUAL(1, scanner.FindEqualFileGroups().size());
+    stats = scanner.GetScanStats();
+    BOOST_CHECK_EQUAL(8, stats.files_listed);
+    BOOST_CHECK_EQUAL(2, stats.groups);
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_cache) {
+    ResetRootDirectory();
+    const fs::path cache_path = fs::temp_directory_path() / "test_scanner_hash_cache";
+    fs::remove(cache_path);
+    CreateFile("a", "1234");
+    CreateFile("b", "1234");
+    CreateFile("c", "1235");
+    ScannerOptions options;
+    options.hash_cache_path = cache_path;
+    const std::vector<std::vector<fs::path>> expected_file_groups{{GetRootPath() / "a", GetRootPath() / "b"}};
+    {
+        Scanner scanner{{"."}, {}, 0, 0, {".*"}, 2, "md5", options};
+        BOOST_CHECK(expected_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+        BOOST_CHECK_EQUAL(3, scanner.GetReaderPoolStats().misses);
+    }
+    {
+        // nothing is read from the disk once every block digest is known
+        Scanner scanner{{"."}, {}, 0, 0, {".*"}, 2, "md5", options};
+        BOOST_CHECK(expected_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+        BOOST_CHECK_EQUAL(0, scanner.GetReaderPoolStats().misses);
+        BOOST_CHECK_EQUAL(3, scanner.GetHashCacheStats().hits);
+    }
+    // a changed file gets a new modification time and is read again
+    CreateFile("c", "1234");
+    fs::last_write_time("c", fs::last_write_time("c") + 10);
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 2, "md5", options};
+    const std::vector<std::vector<fs::path>> changed_file_groups{
+            {GetRootPath() / "a", GetRootPath() / "b", GetRootPath() / "c"}};
+    BOOST_CHECK(changed_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+    BOOST_CHECK_EQUAL(1, scanner.GetReaderPoolStats().misses);
+}
+
+BOOST_AUTO_TEST_CASE(test_streaming) {
+    ResetRootDirectory();
+    CreateFile("a", "12");
+    CreateFile("b", "12");
+    CreateFile("c", "123");
+    CreateFile("d", "123");
+    CreateFile("e", "124");
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 1, "md5"};
+    std::vector<std::vector<fs::path>> file_groups;
+    scanner.FindEqualFileGroups([&file_groups](FileGroup file_group) {
+        BOOST_CHECK_EQUAL(fs::file_size(file_group.paths.front()), file_group.file_size);
+        file_groups.push_back(std::move(file_group.paths));
+    });
+    BOOST_CHECK(CanonizeFileGroups(scanner.FindEqualFileGroups()) == CanonizeFileGroups(file_groups));
+    BOOST_CHECK_EQUAL(2, file_groups.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_hard_links) {
+    ResetRootDirectory();
+    CreateFile("a", "1234");
+    CreateFile("b", "1234");
+    CreateFile("c", "12345");
+    fs::create_hard_link("a", "a2");
+    fs::create_hard_link("c", "c2");
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 2, "md5"};
+    const auto file_groups = FindFileGroups(scanner);
+    BOOST_REQUIRE_EQUAL(2, file_groups.size());
+    BOOST_CHECK(
+            (std::vector<fs::path>{GetRootPath() / "a", GetRootPath() / "a2", GetRootPath() / "b"})
+            == file_groups[0].paths);
+    BOOST_CHECK(file_groups[0].link_ids[0] == file_groups[0].link_ids[1]);
+    BOOST_CHECK(file_groups[0].link_ids[0] != file_groups[0].link_ids[2]);
+    BOOST_CHECK((std::vector<fs::path>{GetRootPath() / "c", GetRootPath() / "c2"}) == file_groups[1].paths);
+    // every inode is opened once, the lone one with its links isn't read at all
+    BOOST_CHECK_EQUAL(2, scanner.GetReaderPoolStats().misses);
+}
+
+// The rounds find the same groups as the trie, hard links, probes, verification and the hash cache included.
+BOOST_AUTO_TEST_CASE(test_grouping_engines) {
+    ResetRootDirectory();
+    for (int i = 0; i < 90; ++i) {
+        // 24 contents of sizes 40 to 42 differing in the first block, in the middle or at the end
+        const int key = i % 24;
+        CreateFile(std::to_string(i), std::to_string(key % 2) + std::string(18 + key / 2 % 3, 'a')
+                                      + std::to_string(key / 6 % 2) + std::string(18, 'b') + std::to_string(key / 12));
+    }
+    fs::create_hard_link("0", "link0");
+    fs::create_hard_link("1", "link1");
+    CreateFile("single", std::string(100, 'c'));
+    fs::create_hard_link("single", "link_single");
+    const fs::path cache_path = fs::temp_directory_path() / "test_scanner_engine_cache";
+    const auto find_groups = [&cache_path](GroupingEngine grouping_engine, size_t thread_count,
+                                           const std::string& read_mode, bool use_cache) {
+        ScannerOptions options;
+        options.grouping_engine = grouping_engine;
+        options.thread_count = thread_count;
+        options.read_mode = GetReadMode(read_mode);
+        options.max_block_size = 8;
+        options.probe_count = 2;
+        options.verify_groups = true;
+        options.hash_cache_path = use_cache ? cache_path : fs::path();
+        Scanner scanner{{"."}, {}, 0, 0, {".*"}, 2, "md5", options};
+        auto file_groups = FindFileGroups(scanner);
+        return std::make_pair(std::move(file_groups), scanner.GetScanStats());
+    };
+    fs::remove(cache_path);
+    const auto [expected_file_groups, expected_stats] = find_groups(GroupingEngine::kTrie, 1, "pread", false);
+    BOOST_REQUIRE_EQUAL(24 + 1, expected_file_groups.size());
+    for (const bool use_cache : {false, true, true}) {
+        for (const auto& read_mode : {"pread", "io_uring"}) {
+            for (const size_t thread_count : {1, 3}) {
+                const auto [file_groups, stats] = find_groups(GroupingEngine::kRounds, thread_count, read_mode,
+                                                              use_cache);
+                CheckFileGroups(expected_file_groups, file_groups);
+                if (!use_cache) {
+                    BOOST_CHECK_EQUAL(expected_stats.blocks_read, stats.blocks_read);
+                    BOOST_CHECK_GT(stats.refine_rounds, 0);
+                }
+                BOOST_CHECK_EQUAL(0, stats.trie_nodes);
+                BOOST_CHECK_EQUAL(0, stats.split_groups);
+            }
+        }
+    }
+    BOOST_CHECK(GetGroupingEngine("rounds") == GroupingEngine::kRounds);
+}
+
+// Two different strings of 8 bytes with equal crc32, found once by a birthday search over "%08x".
+static const std::pair<std::string, std::string> kCrc32Collision{"0008ddf9", "02008894"};
+
+uint32_t CalcCrc32(const std::string& str) {
+    boost::crc_32_type crc;
+    crc.process_bytes(str.data(), str.size());
+    return crc.checksum();
+}
+
+BOOST_AUTO_TEST_CASE(test_verify_groups) {
+    ResetRootDirectory();
+    const auto& [first, second] = kCrc32Collision;
+    BOOST_REQUIRE_NE(first, second);
+    BOOST_REQUIRE_EQUAL(CalcCrc32(first), CalcCrc32(second));
+    // more files than are compared at once
+    for (int i = 0; i < 70; ++i) {
+        CreateFile(std::to_string(i), i % 2 == 0 ? first : second);
+    }
+    CreateFile("single", first);
+    fs::create_hard_link("single", "link");
+    ScannerOptions options;
+    Scanner weak_scanner{{"."}, {}, 0, 0, {".*"}, 16, "crc32", options};
+    BOOST_CHECK_EQUAL(1, weak_scanner.FindEqualFileGroups().size());
+
+    options.verify_groups = true;
+    // the compared files count against the open files limit
+    options.max_open_files = 4;
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 16, "crc32", options};
+    auto file_groups = scanner.FindEqualFileGroups();
+    std::sort(file_groups.begin(), file_groups.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.size() < rhs.size();
+    });
+    BOOST_REQUIRE_EQUAL(2, file_groups.size());
+    BOOST_CHECK_EQUAL(35, file_groups[0].size());
+    BOOST_CHECK_EQUAL(37, file_groups[1].size());
+    std::set<std::string> contents;
+    for (const auto& path : file_groups[0]) {
+        std::stringstream content;
+        content << fs::ifstream(path).rdbuf();
+        contents.insert(content.str());
+    }
+    BOOST_CHECK_EQUAL(1, contents.size());
+    const auto stats = scanner.GetScanStats();
+    BOOST_CHECK_EQUAL(1, stats.split_groups);
+    // a file of the first class is compared again with the second batch
+    BOOST_CHECK_EQUAL((71 + 2) * 8, stats.verified_bytes);
+    BOOST_CHECK_EQUAL(2, stats.groups);
+    BOOST_CHECK_LE(scanner.GetReaderPoolStats().peak_open_readers, 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_growing_blocks) {
+    std::unordered_map<std::string, std::string> file_name_to_file_content;
+    for (int i = 0; i < 30; ++i) {
+        std::string content(200, 'a');
+        content[i * 7 % 200] = static_cast<char>('b' + i % 4);
+        file_name_to_file_content[std::to_string(i)] = content;
+    }
+    for (size_t thread_count : {1, 3}) {
+        ResetRootDirectory();
+        const auto expected_file_groups = CreateFiles(file_name_to_file_content);
+        ScannerOptions options;
+        options.max_block_size = 64;
+        options.thread_count = thread_count;
+        Scanner scanner{{"."}, {}, 0, 0, {".*"}, 1, "sha1", options};
+        BOOST_CHECK(expected_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_probes) {
+    std::unordered_map<std::string, std::string> file_name_to_file_content;
+    for (int i = 0; i < 40; ++i) {
+        std::string content(100, 'a');
+        content[i * 13 % 100] = static_cast<char>('b' + i % 3);
+        file_name_to_file_content[std::to_string(i)] = content;
+    }
+    for (size_t probe_count : {0, 1, 3}) {
+        ResetRootDirectory();
+        const auto expected_file_groups = CreateFiles(file_name_to_file_content);
+        for (int block_size : {1, 7, 50}) {
+            ScannerOptions options;
+            options.probe_count = probe_count;
+            Scanner scanner{{"."}, {}, 0, 0, {".*"}, block_size, "sha1", options};
+            BOOST_CHECK(expected_file_groups == CanonizeFileGroups(scanner.FindEqualFileGroups()));
+        }
+    }
+
+    // files differing at the end are told apart by the first probe
+    ResetRootDirectory();
+    CreateFile("a", std::string(100, 'a') + "1");
+    CreateFile("b", std::string(100, 'a') + "2");
+    Scanner scanner{{"."}, {}, 0, 0, {".*"}, 1, "sha1"};
+    BOOST_CHECK(scanner.FindEqualFileGroups().empty());
+    const auto stats = scanner.GetReaderPoolStats();
+    BOOST_CHECK_EQUAL(2, stats.hits + stats.misses);
+}
+
 }
@@ -0,0 +1,95 @@
+#define BOOST_TEST_MODULE test_shard
+
+#include "shard.h"
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_shard)
+
+fs::path CreateShardDirectory() {
+    const auto directory = fs::temp_directory_path() / "test_shard_dir";
+    fs::remove_all(directory);
+    fs::create_directory(directory);
+    return directory;
+}
+
+std::vector<FileGroup> MergeShardFiles(const std::vector<fs::path>& shard_paths) {
+    std::vector<FileGroup> result;
+    MergeShards(shard_paths, [&result](FileGroup file_group) { result.push_back(std::move(file_group)); });
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_merge) {
+    const auto directory = CreateShardDirectory();
+    const auto shard0 = GetShardPath(directory, 0);
+    const auto shard1 = GetShardPath(directory, 1);
+    const auto shard2 = GetShardPath(directory, 2);
+    const std::string odd_path = std::string("/c d/\"e\"\n\t\\\x01\xff");
+    WriteShard(shard0, {{5, {"/b", "/c"}, {0, 1}}, {3, {odd_path, "/a"}, {0, 0}}});
+    WriteShard(shard1, {{4, {"/d", "/e"}, {0, 1}}, {5, {"/a", "/d"}, {}}});
+    WriteShard(shard2, {});
+    BOOST_CHECK(!fs::exists(shard0.string() + ".tmp"));
+
+    const auto file_groups = MergeShardFiles({shard0, shard1, shard2});
+    BOOST_REQUIRE_EQUAL(4, file_groups.size());
+    BOOST_CHECK_EQUAL(3, file_groups[0].file_size);
+    BOOST_CHECK(file_groups[0].paths == (std::vector<fs::path>{odd_path, "/a"}));
+    BOOST_CHECK(file_groups[0].link_ids == (std::vector<size_t>{0, 0}));
+    BOOST_CHECK_EQUAL(4, file_groups[1].file_size);
+    BOOST_CHECK(file_groups[2].paths == (std::vector<fs::path>{"/a", "/d"}));
+    BOOST_CHECK(file_groups[2].link_ids.empty());
+    BOOST_CHECK(file_groups[3].paths == (std::vector<fs::path>{"/b", "/c"}));
+
+    fs::ofstream(shard2) << "{\"size\":1,\"paths\":[\"/a\"\n";
+    BOOST_CHECK_THROW(MergeShardFiles({shard0, shard2}), fs::filesystem_error);
+    BOOST_CHECK_THROW(MergeShardFiles({directory / "missing"}), fs::filesystem_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_run_shards) {
+    const auto directory = CreateShardDirectory();
+    const auto run_shard = [&directory](size_t shard_index) {
+        WriteShard(GetShardPath(directory, shard_index), {{shard_index, {"/a", "/b"}, {0, 1}}});
+    };
+    WriteShard(GetShardPath(directory, 1), {{10, {"/done", "/before"}, {0, 1}}});
+    RunShards(4, 2, directory, run_shard);
+    std::vector<fs::path> shard_paths;
+    for (size_t shard_index = 0; shard_index < 4; ++shard_index) {
+        shard_paths.push_back(GetShardPath(directory, shard_index));
+    }
+    const auto file_groups = MergeShardFiles(shard_paths);
+    BOOST_REQUIRE_EQUAL(4, file_groups.size());
+    // the completed shard is not run again
+    BOOST_CHECK_EQUAL(0, file_groups[0].file_size);
+    BOOST_CHECK_EQUAL(2, file_groups[1].file_size);
+    BOOST_CHECK_EQUAL(3, file_groups[2].file_size);
+    BOOST_CHECK_EQUAL(10, file_groups[3].file_size);
+
+    fs::remove(shard_paths[0]);
+    fs::remove(shard_paths[2]);
+    BOOST_CHECK_THROW(RunShards(4, 3, directory, [&run_shard](size_t shard_index) {
+        if (shard_index == 2) {
+            throw std::runtime_error("failed");
+        }
+        run_shard(shard_index);
+    }), std::runtime_error);
+    BOOST_CHECK(fs::exists(shard_paths[0]));
+    BOOST_CHECK(!fs::exists(shard_paths[2]));
+    // a shard leaving no file fails as well
+    BOOST_CHECK_THROW(RunShards(4, 1, directory, [](size_t) {}), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_manifest) {
+    const auto directory = CreateShardDirectory();
+    const ShardManifest manifest{{"shards", "4"}, {"include-directory", "/a"}, {"include-directory", "/b"}};
+    CheckShardManifest(directory, manifest);
+    BOOST_CHECK(fs::exists(directory / "manifest"));
+    // rerunning the same scan resumes it
+    CheckShardManifest(directory, manifest);
+    BOOST_CHECK_THROW(CheckShardManifest(directory, {{"shards", "3"}, {"include-directory", "/a"},
+                                                     {"include-directory", "/b"}}), fs::filesystem_error);
+    BOOST_CHECK_THROW(CheckShardManifest(directory, {{"shards", "4"}, {"include-directory", "/a"}}),
+                      fs::filesystem_error);
+}
+
+}
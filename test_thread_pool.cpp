@@ -0,0 +1,84 @@
+#define BOOST_TEST_MODULE test_thread_pool
+
+#include "thread_pool.h"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_thread_pool)
+
+void SpawnTasks(TaskGroup& task_group, std::atomic<size_t>& counter, int depth) {
+    counter.fetch_add(1);
+    if (depth == 0) {
+        return;
+    }
+    for (int i = 0; i < 2; ++i) {
+        task_group.Run([&task_group, &counter, depth] { SpawnTasks(task_group, counter, depth - 1); });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_all_tasks_run) {
+    for (size_t thread_count : {1, 2, 4}) {
+        ThreadPool thread_pool(thread_count);
+        BOOST_CHECK_EQUAL(thread_pool.GetThreadCount(), thread_count);
+        std::vector<int> results(1000, 0);
+        TaskGroup task_group(thread_pool);
+        for (size_t i = 0; i < results.size(); ++i) {
+            task_group.Run([&results, i] { results[i] = static_cast<int>(i); });
+        }
+        task_group.Wait();
+        for (size_t i = 0; i < results.size(); ++i) {
+            BOOST_CHECK_EQUAL(results[i], static_cast<int>(i));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_tasks) {
+    for (size_t thread_count : {1, 3}) {
+        ThreadPool thread_pool(thread_count);
+        std::atomic<size_t> counter{0};
+        TaskGroup task_group(thread_pool);
+        task_group.Run([&task_group, &counter] { SpawnTasks(task_group, counter, 10); });
+        task_group.Wait();
+        BOOST_CHECK_EQUAL(counter.load(), (1u << 11) - 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_groups) {
+    ThreadPool thread_pool(4);
+    std::atomic<size_t> counter{0};
+    TaskGroup task_group(thread_pool);
+    for (int i = 0; i < 16; ++i) {
+        task_group.Run([&thread_pool, &counter] {
+            TaskGroup nested_task_group(thread_pool);
+            for (int j = 0; j < 16; ++j) {
+                nested_task_group.Run([&counter] { counter.fetch_add(1); });
+            }
+            nested_task_group.Wait();
+        });
+    }
+    task_group.Wait();
+    BOOST_CHECK_EQUAL(counter.load(), 256u);
+}
+
+BOOST_AUTO_TEST_CASE(test_exception) {
+    for (size_t thread_count : {1, 2}) {
+        ThreadPool thread_pool(thread_count);
+        std::atomic<size_t> counter{0};
+        TaskGroup task_group(thread_pool);
+        for (int i = 0; i < 10; ++i) {
+            task_group.Run([&counter, i] {
+                counter.fetch_add(1);
+                if (i == 5) {
+                    throw std::runtime_error("task failed");
+                }
+            });
+        }
+        BOOST_CHECK_THROW(task_group.Wait(), std::runtime_error);
+        BOOST_CHECK_EQUAL(counter.load(), 10u);
+    }
+}
+
+}
@@ -0,0 +1,57 @@
+#define BOOST_TEST_MODULE test_trace
+
+#include "trace.h"
+#include <sstream>
+#include <thread>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_trace)
+
+std::string ReadFile(const fs::path& path) {
+    std::stringstream result;
+    result << fs::ifstream(path).rdbuf();
+    return result.str();
+}
+
+BOOST_AUTO_TEST_CASE(test_spans) {
+    const fs::path trace_path = fs::temp_directory_path() / "test_trace.json";
+    Tracer tracer;
+    {
+        TraceSpan span(&tracer, "outer", "\"files\":2");
+        std::thread([&tracer] { TraceSpan inner(&tracer, "inner"); }).join();
+    }
+    tracer.Write(trace_path);
+    const auto trace = ReadFile(trace_path);
+    // the inner span ends first and its thread is numbered first
+    const auto inner = trace.find("{\"name\":\"inner\",\"ph\":\"X\",\"pid\":1,\"tid\":1,");
+    const auto outer = trace.find("{\"name\":\"outer\",\"ph\":\"X\",\"pid\":1,\"tid\":2,");
+    BOOST_CHECK(inner != std::string::npos);
+    BOOST_CHECK(outer != std::string::npos);
+    BOOST_CHECK_LT(inner, outer);
+    BOOST_CHECK(trace.find("\"args\":{\"files\":2}") != std::string::npos);
+    BOOST_CHECK(trace.find("\"args\":{}") != std::string::npos);
+    BOOST_CHECK_EQUAL(0, trace.find("{\"traceEvents\":["));
+}
+
+BOOST_AUTO_TEST_CASE(test_clear) {
+    const fs::path trace_path = fs::temp_directory_path() / "test_trace.json";
+    Tracer tracer;
+    { TraceSpan span(&tracer, "first"); }
+    tracer.Write(trace_path);
+    tracer.Clear();
+    { TraceSpan span(&tracer, "second"); }
+    tracer.Write(trace_path);
+    // only the spans since the clearing are written
+    const auto trace = ReadFile(trace_path);
+    BOOST_CHECK(trace.find("\"name\":\"first\"") == std::string::npos);
+    BOOST_CHECK(trace.find("\"name\":\"second\"") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_disabled_span) {
+    // a span without a tracer records nothing
+    TraceSpan span(nullptr, "nothing");
+}
+
+}
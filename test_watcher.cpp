@@ -0,0 +1,91 @@
+#define BOOST_TEST_MODULE test_watcher
+
+#include "watcher.h"
+#include <set>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+
+BOOST_AUTO_TEST_SUITE(test_watcher)
+
+fs::path CreateRootDirectory() {
+    const auto root_path = fs::temp_directory_path() / "test_watcher_dir";
+    fs::remove_all(root_path);
+    fs::create_directory(root_path);
+    return fs::canonical(root_path);
+}
+
+void CreateFile(const fs::path& path, const std::string& content) {
+    fs::ofstream out{path};
+    out << content;
+}
+
+// Collects the changes until the expected ones came or a second passed.
+std::set<std::pair<FileChange::Kind, fs::path>> WaitForChanges(
+        DirectoryWatcher& watcher, const std::set<std::pair<FileChange::Kind, fs::path>>& expected_changes) {
+    std::set<std::pair<FileChange::Kind, fs::path>> result;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (std::chrono::steady_clock::now() < deadline
+           && !std::includes(result.begin(), result.end(), expected_changes.begin(), expected_changes.end())) {
+        for (const auto& change : watcher.Wait(std::chrono::milliseconds(100))) {
+            result.emplace(change.kind, change.path);
+        }
+    }
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_files) {
+    const auto root_path = CreateRootDirectory();
+    CreateFile(root_path / "a", "1");
+    DirectoryWatcher watcher({root_path}, 0);
+    BOOST_CHECK_EQUAL(1, watcher.GetWatchCount());
+    BOOST_CHECK(watcher.Wait(std::chrono::milliseconds(0)).empty());
+
+    CreateFile(root_path / "b", "2");
+    auto changes = WaitForChanges(watcher, {{FileChange::Kind::kChanged, root_path / "b"}});
+    BOOST_CHECK(changes.count({FileChange::Kind::kChanged, root_path / "b"}));
+    BOOST_CHECK(!changes.count({FileChange::Kind::kChanged, root_path / "a"}));
+
+    fs::rename(root_path / "a", root_path / "c");
+    fs::remove(root_path / "b");
+    const std::set<std::pair<FileChange::Kind, fs::path>> expected_changes = {
+        {FileChange::Kind::kRemoved, root_path / "a"},
+        {FileChange::Kind::kChanged, root_path / "c"},
+        {FileChange::Kind::kRemoved, root_path / "b"},
+    };
+    BOOST_CHECK(WaitForChanges(watcher, expected_changes) == expected_changes);
+}
+
+BOOST_AUTO_TEST_CASE(test_directories) {
+    const auto root_path = CreateRootDirectory();
+    fs::create_directories(root_path / "d1" / "d2");
+    DirectoryWatcher watcher({root_path}, 1);
+    // d2 is below the depth
+    BOOST_CHECK_EQUAL(2, watcher.GetWatchCount());
+
+    CreateFile(root_path / "d1" / "d2" / "a", "1");
+    CreateFile(root_path / "d1" / "a", "1");
+    auto changes = WaitForChanges(watcher, {{FileChange::Kind::kChanged, root_path / "d1" / "a"}});
+    BOOST_CHECK(changes.count({FileChange::Kind::kChanged, root_path / "d1" / "a"}));
+    BOOST_CHECK(!changes.count({FileChange::Kind::kChanged, root_path / "d1" / "d2" / "a"}));
+
+    // files of a directory moved in are reported, files written right after its creation too
+    fs::create_directories(root_path / "e1");
+    CreateFile(root_path / "e1" / "a", "1");
+    fs::rename(root_path / "d1", root_path / "e2");
+    const std::set<std::pair<FileChange::Kind, fs::path>> expected_changes = {
+        {FileChange::Kind::kChanged, root_path / "e1" / "a"},
+        {FileChange::Kind::kDirectoryRemoved, root_path / "d1"},
+        {FileChange::Kind::kChanged, root_path / "e2" / "a"},
+    };
+    changes = WaitForChanges(watcher, expected_changes);
+    BOOST_CHECK(std::includes(changes.begin(), changes.end(), expected_changes.begin(), expected_changes.end()));
+    BOOST_CHECK_EQUAL(3, watcher.GetWatchCount());
+
+    fs::remove_all(root_path / "e2");
+    changes = WaitForChanges(watcher, {{FileChange::Kind::kDirectoryRemoved, root_path / "e2"}});
+    BOOST_CHECK(changes.count({FileChange::Kind::kDirectoryRemoved, root_path / "e2"}));
+    BOOST_CHECK_EQUAL(2, watcher.GetWatchCount());
+}
+
+}
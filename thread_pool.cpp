@@ -0,0 +1,213 @@
+#include "thread_pool.h"
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ThreadPoolImpl {
+public:
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* task_group;
+    };
+
+    explicit ThreadPoolImpl(size_t thread_count) : deques_(std::max<size_t>(thread_count, 1)) {
+        // deque 0 belongs to the thread waiting for a task group from outside the pool
+        for (size_t i = 1; i < deques_.size(); ++i) {
+            workers_.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ~ThreadPoolImpl() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        condition_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    size_t GetThreadCount() const {
+        return deques_.size();
+    }
+
+    void Push(Task task) {
+        if (current_pool_ == this) {
+            auto& deque = deques_[current_deque_];
+            std::lock_guard lock(deque.mutex);
+            deque.tasks.push_back(std::move(task));
+            queued_tasks_.fetch_add(1);
+        } else {
+            std::lock_guard lock(shared_queue_.mutex);
+            shared_queue_.tasks.push_back(std::move(task));
+            queued_shared_tasks_.fetch_add(1);
+        }
+        Notify();
+    }
+
+    void Notify() {
+        // taking the mutex orders the notification after the check made by a thread about to sleep
+        { std::lock_guard lock(mutex_); }
+        condition_.notify_all();
+    }
+
+    void Wait(TaskGroup& task_group) {
+        const bool external = current_pool_ != this;
+        if (external) {
+            current_pool_ = this;
+            current_deque_ = 0;
+        }
+        // only a wait from outside the pool may start tasks from the shared queue
+        const bool take_shared = external;
+        while (task_group.pending_tasks_.load() > 0) {
+            if (auto task = PopTask(take_shared)) {
+                RunTask(*task);
+                continue;
+            }
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [&] { return task_group.pending_tasks_.load() == 0 || HasTasks(take_shared); });
+        }
+        if (external) {
+            current_pool_ = nullptr;
+        }
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerLoop(size_t deque_index) {
+        current_pool_ = this;
+        current_deque_ = deque_index;
+        while (true) {
+            if (auto task = PopTask(true)) {
+                RunTask(*task);
+                continue;
+            }
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [&] { return stopping_ || HasTasks(true); });
+            if (stopping_) {
+                return;
+            }
+        }
+    }
+
+    bool HasTasks(bool take_shared) const {
+        return queued_tasks_.load() > 0 || (take_shared && queued_shared_tasks_.load() > 0);
+    }
+
+    std::optional<Task> PopTask(bool take_shared) {
+        if (auto task = PopBack(deques_[current_deque_])) {
+            return task;
+        }
+        if (take_shared) {
+            if (auto task = PopFront(shared_queue_)) {
+                queued_shared_tasks_.fetch_sub(1);
+                return task;
+            }
+        }
+        for (size_t i = 1; i < deques_.size(); ++i) {
+            if (auto task = PopFront(deques_[(current_deque_ + i) % deques_.size()])) {
+                queued_tasks_.fetch_sub(1);
+                return task;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Task> PopBack(TaskQueue& queue) {
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return std::nullopt;
+        }
+        Task task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        queued_tasks_.fetch_sub(1);
+        return task;
+    }
+
+    std::optional<Task> PopFront(TaskQueue& queue) {
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return std::nullopt;
+        }
+        Task task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return task;
+    }
+
+    void RunTask(Task& task) {
+        std::exception_ptr exception;
+        try {
+            task.function();
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        task.task_group->OnTaskDone(exception);
+    }
+
+    static thread_local ThreadPoolImpl* current_pool_;
+    static thread_local size_t current_deque_;
+
+    std::vector<TaskQueue> deques_;
+    TaskQueue shared_queue_;
+    std::atomic<size_t> queued_tasks_{0};         // in the deques
+    std::atomic<size_t> queued_shared_tasks_{0};  // in shared_queue_
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+thread_local ThreadPoolImpl* ThreadPoolImpl::current_pool_ = nullptr;
+thread_local size_t ThreadPoolImpl::current_deque_ = 0;
+
+ThreadPool::ThreadPool(size_t thread_count) : impl_(std::make_unique<ThreadPoolImpl>(thread_count)) {
+}
+
+ThreadPool::~ThreadPool() = default;
+
+size_t ThreadPool::GetThreadCount() const {
+    return impl_->GetThreadCount();
+}
+
+TaskGroup::TaskGroup(ThreadPool& thread_pool) : thread_pool_(thread_pool) {
+}
+
+TaskGroup::~TaskGroup() {
+    assert(pending_tasks_.load() == 0);
+}
+
+void TaskGroup::Run(std::function<void()> task) {
+    pending_tasks_.fetch_add(1);
+    thread_pool_.impl_->Push({std::move(task), this});
+}
+
+void TaskGroup::Wait() {
+    thread_pool_.impl_->Wait(*this);
+    std::lock_guard lock(exception_mutex_);
+    if (exception_) {
+        std::rethrow_exception(std::exchange(exception_, nullptr));
+    }
+}
+
+void TaskGroup::OnTaskDone(std::exception_ptr exception) {
+    if (exception) {
+        std::lock_guard lock(exception_mutex_);
+        if (!exception_) {
+            exception_ = exception;
+        }
+    }
+    // the group may be destroyed by its waiter as soon as the counter drops to zero
+    auto* thread_pool_impl = thread_pool_.impl_.get();
+    if (pending_tasks_.fetch_sub(1) == 1) {
+        thread_pool_impl->Notify();
+    }
+}
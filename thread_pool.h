@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+class ThreadPoolImpl;
+
+// Work-stealing pool. Every thread owns a deque: tasks spawned by a task go to the back of the deque
+// of the thread running it and are taken from there first, idle threads steal from the front of the
+// other deques. Tasks submitted from outside the pool go to a shared queue.
+class ThreadPool {
+public:
+    // thread_count includes the thread calling TaskGroup::Wait, so 1 means running everything inline.
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    [[nodiscard]] size_t GetThreadCount() const;
+
+private:
+    friend class TaskGroup;
+    std::unique_ptr<ThreadPoolImpl> impl_;
+};
+
+// A set of tasks which can be waited for. Tasks may add more tasks to their group.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& thread_pool);
+    ~TaskGroup();
+
+    void Run(std::function<void()> task);
+    // Runs pending tasks of the pool until every task of the group is done, rethrows the first exception
+    // thrown by them. A wait nested in a task only helps with tasks spawned by other tasks, so it can't
+    // start unrelated work submitted from outside.
+    void Wait();
+
+private:
+    friend class ThreadPoolImpl;
+    void OnTaskDone(std::exception_ptr exception);
+
+    ThreadPool& thread_pool_;
+    std::atomic<size_t> pending_tasks_{0};
+    std::mutex exception_mutex_;
+    std::exception_ptr exception_;
+};
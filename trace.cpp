@@ -0,0 +1,79 @@
+#include "trace.h"
+#include <cerrno>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/format.hpp>
+
+class TracerImpl {
+public:
+    void AddSpan(std::string name, Tracer::Clock::time_point start, Tracer::Clock::time_point end,
+                 std::string args) {
+        std::lock_guard lock(mutex_);
+        // threads are numbered in the order of their first span, the trace viewers show them in this order
+        const auto [iter, _] = thread_ids_.try_emplace(std::this_thread::get_id(), thread_ids_.size() + 1);
+        events_.push_back({std::move(name), std::move(args), start, end, iter->second});
+    }
+
+    void Write(const fs::path& path) const {
+        std::lock_guard lock(mutex_);
+        fs::ofstream out{path};
+        if (!out) {
+            throw fs::filesystem_error("open", path,
+                                       boost::system::error_code(errno, boost::system::system_category()));
+        }
+        out << "{\"traceEvents\":[";
+        for (size_t i = 0; i < events_.size(); ++i) {
+            const auto& event = events_[i];
+            // names and args are made by the scanner, they need no escaping
+            out << (i > 0 ? ",\n" : "\n")
+                << boost::format("{\"name\":\"%1%\",\"ph\":\"X\",\"pid\":1,\"tid\":%2%,\"ts\":%3%,\"dur\":%4%,"
+                                 "\"args\":{%5%}}")
+                    % event.name % event.thread_id % ToMicroseconds(event.start - origin_)
+                    % ToMicroseconds(event.end - event.start) % event.args;
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    void Clear() {
+        std::lock_guard lock(mutex_);
+        events_.clear();
+    }
+
+private:
+    struct Event {
+        std::string name;
+        std::string args;
+        Tracer::Clock::time_point start;
+        Tracer::Clock::time_point end;
+        size_t thread_id;
+    };
+
+    static int64_t ToMicroseconds(Tracer::Clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+
+    const Tracer::Clock::time_point origin_ = Tracer::Clock::now();
+    mutable std::mutex mutex_;
+    std::map<std::thread::id, size_t> thread_ids_;
+    std::vector<Event> events_;
+};
+
+Tracer::Tracer() : impl_(std::make_unique<TracerImpl>()) {
+}
+
+Tracer::~Tracer() = default;
+
+void Tracer::AddSpan(std::string name, Clock::time_point start, Clock::time_point end, std::string args) {
+    impl_->AddSpan(std::move(name), start, end, std::move(args));
+}
+
+void Tracer::Write(const fs::path& path) const {
+    impl_->Write(path);
+}
+
+void Tracer::Clear() {
+    impl_->Clear();
+}
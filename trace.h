@@ -0,0 +1,54 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+class TracerImpl;
+
+// Collects the spans of a scan and writes them as Chrome trace events, which chrome://tracing and Perfetto
+// show per thread. Thread-safe.
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Tracer();
+    ~Tracer();
+
+    // args are the members of a JSON object, e.g. "\"files\":3", or empty.
+    void AddSpan(std::string name, Clock::time_point start, Clock::time_point end, std::string args = {});
+    void Write(const fs::path& path) const;
+    // Drops the spans added so far, so a long-running process writes each report's spans and no more.
+    void Clear();
+
+private:
+    std::unique_ptr<TracerImpl> impl_;
+};
+
+// Adds a span from its construction to its destruction, does nothing if the tracer is null.
+class TraceSpan {
+public:
+    TraceSpan(Tracer* tracer, std::string name, std::string args = {})
+            : tracer_(tracer)
+            , name_(tracer_ != nullptr ? std::move(name) : std::string())
+            , args_(tracer_ != nullptr ? std::move(args) : std::string())
+            , start_(tracer_ != nullptr ? Tracer::Clock::now() : Tracer::Clock::time_point()) {
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        if (tracer_ != nullptr) {
+            tracer_->AddSpan(std::move(name_), start_, Tracer::Clock::now(), std::move(args_));
+        }
+    }
+
+private:
+    Tracer* tracer_;
+    std::string name_;
+    std::string args_;
+    Tracer::Clock::time_point start_;
+};
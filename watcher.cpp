@@ -0,0 +1,169 @@
+#include "watcher.h"
+#include <algorithm>
+#include <unordered_map>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+// Files are reported when they are closed after writing rather than on every write.
+static constexpr uint32_t kWatchedEvents = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                           | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+// Events read by one read call.
+static constexpr size_t kEventBufferSize = 64 * 1024;
+
+[[noreturn]] static void ThrowSystemError(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error(what, path, boost::system::error_code(errno, boost::system::system_category()));
+}
+
+class DirectoryWatcherImpl {
+public:
+    DirectoryWatcherImpl(const std::vector<fs::path>& directories, int max_depth) : max_depth_(max_depth) {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ == -1) {
+            ThrowSystemError("inotify_init1", {});
+        }
+        try {
+            for (const auto& directory : directories) {
+                AddDirectory(fs::canonical(fs::absolute(directory)), 0, nullptr);
+            }
+        } catch (...) {
+            close(fd_);
+            throw;
+        }
+    }
+
+    ~DirectoryWatcherImpl() {
+        close(fd_);
+    }
+
+    std::vector<FileChange> Wait(std::chrono::milliseconds timeout) {
+        std::vector<FileChange> changes;
+        pollfd poll_fd{fd_, POLLIN, 0};
+        const int result = poll(&poll_fd, 1, timeout.count() < 0 ? -1 : static_cast<int>(timeout.count()));
+        if (result == -1 && errno != EINTR) {
+            ThrowSystemError("poll", {});
+        }
+        if (result <= 0) {
+            return changes;
+        }
+        alignas(inotify_event) char buffer[kEventBufferSize];
+        while (true) {
+            const ssize_t size = read(fd_, buffer, sizeof(buffer));
+            if (size == -1 && errno == EINTR) {
+                continue;
+            }
+            if (size == -1 && errno == EAGAIN) {
+                break;
+            }
+            if (size == -1) {
+                ThrowSystemError("read", {});
+            }
+            for (ssize_t offset = 0; offset < size;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                HandleEvent(*event, changes);
+            }
+        }
+        return changes;
+    }
+
+    [[nodiscard]] size_t GetWatchCount() const {
+        return watches_.size();
+    }
+
+private:
+    struct Watch {
+        fs::path directory;
+        int depth;
+    };
+
+    // The directory is listed after the watch is added, so no file created in between is missed. Its files
+    // are reported if changes is not null.
+    void AddDirectory(const fs::path& directory, int depth, std::vector<FileChange>* changes) {
+        const int watch = inotify_add_watch(fd_, directory.c_str(), kWatchedEvents);
+        if (watch == -1) {
+            if (errno == ENOENT || errno == ENOTDIR) {
+                // gone already
+                return;
+            }
+            ThrowSystemError("inotify_add_watch", directory);
+        }
+        watches_[watch] = {directory, depth};
+        boost::system::error_code error_code;
+        for (fs::directory_iterator iter(directory, error_code), end; !error_code && iter != end;
+             iter.increment(error_code)) {
+            const auto status = iter->symlink_status(error_code);
+            if (fs::is_directory(status)) {
+                if (depth < max_depth_) {
+                    AddDirectory(iter->path(), depth + 1, changes);
+                }
+            } else if (changes != nullptr && fs::is_regular_file(status)) {
+                changes->push_back({FileChange::Kind::kChanged, iter->path()});
+            }
+        }
+    }
+
+    // The watches of a deleted directory are dropped by the kernel, the ones of a moved away directory would
+    // report its files under the old paths.
+    void RemoveDirectory(const fs::path& directory) {
+        for (auto iter = watches_.begin(); iter != watches_.end();) {
+            const auto& watched_directory = iter->second.directory;
+            if (std::mismatch(directory.begin(), directory.end(), watched_directory.begin(),
+                              watched_directory.end()).first == directory.end()) {
+                inotify_rm_watch(fd_, iter->first);
+                iter = watches_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    void HandleEvent(const inotify_event& event, std::vector<FileChange>& changes) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            changes.push_back({FileChange::Kind::kOverflow, {}});
+            return;
+        }
+        if (event.mask & IN_IGNORED) {
+            watches_.erase(event.wd);
+            return;
+        }
+        const auto iter = watches_.find(event.wd);
+        if (iter == watches_.end() || event.len == 0) {
+            return;
+        }
+        auto path = iter->second.directory / event.name;
+        const int depth = iter->second.depth;
+        if (event.mask & IN_ISDIR) {
+            if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (depth < max_depth_) {
+                    AddDirectory(path, depth + 1, &changes);
+                }
+            } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+                RemoveDirectory(path);
+                changes.push_back({FileChange::Kind::kDirectoryRemoved, std::move(path)});
+            }
+        } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            changes.push_back({FileChange::Kind::kRemoved, std::move(path)});
+        } else {
+            changes.push_back({FileChange::Kind::kChanged, std::move(path)});
+        }
+    }
+
+    int max_depth_;
+    int fd_;
+    std::unordered_map<int, Watch> watches_;
+};
+
+DirectoryWatcher::DirectoryWatcher(const std::vector<fs::path>& directories, int max_depth)
+        : impl_(std::make_unique<DirectoryWatcherImpl>(directories, max_depth)) {
+}
+
+DirectoryWatcher::~DirectoryWatcher() = default;
+
+std::vector<FileChange> DirectoryWatcher::Wait(std::chrono::milliseconds timeout) {
+    return impl_->Wait(timeout);
+}
+
+size_t DirectoryWatcher::GetWatchCount() const {
+    return impl_->GetWatchCount();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+class DirectoryWatcherImpl;
+
+struct FileChange {
+    enum class Kind {
+        kChanged,           // created, written and closed, moved in, or its attributes changed
+        kRemoved,           // deleted or moved away
+        kDirectoryRemoved,  // everything under the directory is gone
+        kOverflow,          // events were lost, everything has to be scanned again
+    };
+
+    Kind kind;
+    fs::path path;
+};
+
+// Watches directory trees with inotify. Directories which appear later are watched as soon as they are seen,
+// and the files already in them are reported as changed. Symlinks are not followed. A file written through
+// a descriptor which stays open (or a mapping) is only reported once the descriptor is closed.
+class DirectoryWatcher {
+public:
+    // Watches the directories and their subdirectories max_depth levels down, like the scan level of the
+    // file filter. The paths of the changes start with the canonical paths of the directories.
+    DirectoryWatcher(const std::vector<fs::path>& directories, int max_depth);
+    ~DirectoryWatcher();
+
+    // Waits up to timeout for a change, a negative timeout waits forever. Returns the change together with
+    // all the others already queued, nothing on timeout.
+    std::vector<FileChange> Wait(std::chrono::milliseconds timeout);
+    [[nodiscard]] size_t GetWatchCount() const;
+
+private:
+    std::unique_ptr<DirectoryWatcherImpl> impl_;
+};
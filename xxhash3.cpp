@@ -0,0 +1,442 @@
+#include "hash_kernels.h"
+#include "cpu_features.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// XXH3 as specified by the reference xxHash implementation (v0.8), default secret and seed 0 only.
+
+static constexpr size_t kStripeSize = 64;
+static constexpr size_t kSecretConsumeRate = 8;
+static constexpr size_t kAccumulatorCount = kStripeSize / sizeof(uint64_t);
+static constexpr size_t kSecretSize = 192;
+static constexpr size_t kSecretSizeMin = 136;
+static constexpr size_t kMidSizeMax = 240;
+static constexpr size_t kSecretMergeAccumulatorsStart = 11;
+static constexpr size_t kSecretLastAccumulatorStart = 7;
+static constexpr size_t kStripesPerBlock = (kSecretSize - kStripeSize) / kSecretConsumeRate;
+static constexpr size_t kBlockSize = kStripeSize * kStripesPerBlock;
+
+static constexpr uint32_t kPrime32_1 = 0x9e3779b1;
+static constexpr uint32_t kPrime32_2 = 0x85ebca77;
+static constexpr uint32_t kPrime32_3 = 0xc2b2ae3d;
+static constexpr uint64_t kPrime64_1 = 0x9e3779b185ebca87;
+static constexpr uint64_t kPrime64_2 = 0xc2b2ae3d27d4eb4f;
+static constexpr uint64_t kPrime64_3 = 0x165667b19e3779f9;
+static constexpr uint64_t kPrime64_4 = 0x85ebca77c2b2ae63;
+static constexpr uint64_t kPrime64_5 = 0x27d4eb2f165667c5;
+static constexpr uint64_t kPrimeMx1 = 0x165667919e3779f9;
+static constexpr uint64_t kPrimeMx2 = 0x9fb21c651e98df25;
+
+alignas(64) static constexpr uint8_t kSecret[kSecretSize] = {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+struct alignas(32) Accumulators {
+    uint64_t values[kAccumulatorCount];
+};
+
+static constexpr Accumulators kInitialAccumulators = {
+        {kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3, kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1}};
+
+static uint32_t Read32(const uint8_t* data) {
+    uint32_t result;
+    std::memcpy(&result, data, sizeof(result));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    result = __builtin_bswap32(result);
+#endif
+    return result;
+}
+
+static uint64_t Read64(const uint8_t* data) {
+    uint64_t result;
+    std::memcpy(&result, data, sizeof(result));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    result = __builtin_bswap64(result);
+#endif
+    return result;
+}
+
+static uint64_t RotateLeft64(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+static uint32_t RotateLeft32(uint32_t value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+__extension__ using Uint128 = unsigned __int128;
+
+static Xxh128Value Multiply64To128(uint64_t lhs, uint64_t rhs) {
+    const Uint128 product = static_cast<Uint128>(lhs) * rhs;
+    return {static_cast<uint64_t>(product), static_cast<uint64_t>(product >> 64)};
+}
+
+static uint64_t Multiply128Fold64(uint64_t lhs, uint64_t rhs) {
+    const auto product = Multiply64To128(lhs, rhs);
+    return product.low ^ product.high;
+}
+
+static uint64_t Xxh64Avalanche(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= kPrime64_2;
+    hash ^= hash >> 29;
+    hash *= kPrime64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t Avalanche(uint64_t hash) {
+    hash ^= hash >> 37;
+    hash *= kPrimeMx1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t StrongAvalanche(uint64_t hash, uint64_t size) {
+    hash ^= RotateLeft64(hash, 49) ^ RotateLeft64(hash, 24);
+    hash *= kPrimeMx2;
+    hash ^= (hash >> 35) + size;
+    hash *= kPrimeMx2;
+    hash ^= hash >> 28;
+    return hash;
+}
+
+static uint64_t Mix16Bytes(const uint8_t* input, const uint8_t* secret, uint64_t seed) {
+    return Multiply128Fold64(Read64(input) ^ (Read64(secret) + seed), Read64(input + 8) ^ (Read64(secret + 8) - seed));
+}
+
+static void Mix32Bytes(Xxh128Value& accumulator, const uint8_t* input1, const uint8_t* input2,
+                       const uint8_t* secret, uint64_t seed) {
+    accumulator.low += Mix16Bytes(input1, secret, seed);
+    accumulator.low ^= Read64(input2) + Read64(input2 + 8);
+    accumulator.high += Mix16Bytes(input2, secret + 16, seed);
+    accumulator.high ^= Read64(input1) + Read64(input1 + 8);
+}
+
+struct ScalarKernel {
+    static void Accumulate512(Accumulators& accumulators, const uint8_t* input, const uint8_t* secret) {
+        for (size_t i = 0; i < kAccumulatorCount; ++i) {
+            const uint64_t data = Read64(input + 8 * i);
+            const uint64_t keyed_data = data ^ Read64(secret + 8 * i);
+            accumulators.values[i ^ 1] += data;
+            accumulators.values[i] += (keyed_data & 0xffffffff) * (keyed_data >> 32);
+        }
+    }
+
+    static void Scramble(Accumulators& accumulators, const uint8_t* secret) {
+        for (size_t i = 0; i < kAccumulatorCount; ++i) {
+            uint64_t accumulator = accumulators.values[i];
+            accumulator ^= accumulator >> 47;
+            accumulator ^= Read64(secret + 8 * i);
+            accumulators.values[i] = accumulator * kPrime32_1;
+        }
+    }
+};
+
+#if defined(__x86_64__)
+struct Sse2Kernel {
+    static void Accumulate512(Accumulators& accumulators, const uint8_t* input, const uint8_t* secret) {
+        auto* vectors = reinterpret_cast<__m128i*>(accumulators.values);
+        for (size_t i = 0; i < kStripeSize / sizeof(__m128i); ++i) {
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+            const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+            const __m128i keyed_data = _mm_xor_si128(data, key);
+            const __m128i product = _mm_mul_epu32(keyed_data, _mm_shuffle_epi32(keyed_data, _MM_SHUFFLE(0, 3, 0, 1)));
+            const __m128i sum = _mm_add_epi64(vectors[i], _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+            vectors[i] = _mm_add_epi64(product, sum);
+        }
+    }
+
+    static void Scramble(Accumulators& accumulators, const uint8_t* secret) {
+        auto* vectors = reinterpret_cast<__m128i*>(accumulators.values);
+        const __m128i prime = _mm_set1_epi32(static_cast<int>(kPrime32_1));
+        for (size_t i = 0; i < kStripeSize / sizeof(__m128i); ++i) {
+            const __m128i shifted = _mm_xor_si128(vectors[i], _mm_srli_epi64(vectors[i], 47));
+            const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+            const __m128i keyed_data = _mm_xor_si128(shifted, key);
+            const __m128i product_low = _mm_mul_epu32(keyed_data, prime);
+            const __m128i product_high = _mm_mul_epu32(_mm_shuffle_epi32(keyed_data, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            vectors[i] = _mm_add_epi64(product_low, _mm_slli_epi64(product_high, 32));
+        }
+    }
+};
+
+struct Avx2Kernel {
+    __attribute__((target("avx2")))
+    static void Accumulate512(Accumulators& accumulators, const uint8_t* input, const uint8_t* secret) {
+        auto* vectors = reinterpret_cast<__m256i*>(accumulators.values);
+        for (size_t i = 0; i < kStripeSize / sizeof(__m256i); ++i) {
+            const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input) + i);
+            const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i);
+            const __m256i keyed_data = _mm256_xor_si256(data, key);
+            const __m256i product = _mm256_mul_epu32(keyed_data, _mm256_srli_epi64(keyed_data, 32));
+            const __m256i sum = _mm256_add_epi64(vectors[i], _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+            vectors[i] = _mm256_add_epi64(product, sum);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static void Scramble(Accumulators& accumulators, const uint8_t* secret) {
+        auto* vectors = reinterpret_cast<__m256i*>(accumulators.values);
+        const __m256i prime = _mm256_set1_epi32(static_cast<int>(kPrime32_1));
+        for (size_t i = 0; i < kStripeSize / sizeof(__m256i); ++i) {
+            const __m256i shifted = _mm256_xor_si256(vectors[i], _mm256_srli_epi64(vectors[i], 47));
+            const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i);
+            const __m256i keyed_data = _mm256_xor_si256(shifted, key);
+            const __m256i product_low = _mm256_mul_epu32(keyed_data, prime);
+            const __m256i product_high = _mm256_mul_epu32(_mm256_srli_epi64(keyed_data, 32), prime);
+            vectors[i] = _mm256_add_epi64(product_low, _mm256_slli_epi64(product_high, 32));
+        }
+    }
+};
+#endif
+
+template <typename Kernel>
+static void AccumulateStripes(Accumulators& accumulators, const uint8_t* input, size_t stripe_count) {
+    for (size_t i = 0; i < stripe_count; ++i) {
+        Kernel::Accumulate512(accumulators, input + i * kStripeSize, kSecret + i * kSecretConsumeRate);
+    }
+}
+
+template <typename Kernel>
+static void HashLongInput(Accumulators& accumulators, const uint8_t* input, size_t size) {
+    const size_t block_count = (size - 1) / kBlockSize;
+    for (size_t i = 0; i < block_count; ++i) {
+        AccumulateStripes<Kernel>(accumulators, input + i * kBlockSize, kStripesPerBlock);
+        Kernel::Scramble(accumulators, kSecret + kSecretSize - kStripeSize);
+    }
+    const size_t stripe_count = ((size - 1) - kBlockSize * block_count) / kStripeSize;
+    AccumulateStripes<Kernel>(accumulators, input + block_count * kBlockSize, stripe_count);
+    Kernel::Accumulate512(accumulators, input + size - kStripeSize,
+                          kSecret + kSecretSize - kStripeSize - kSecretLastAccumulatorStart);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"), flatten))
+static void HashLongInputAvx2(Accumulators& accumulators, const uint8_t* input, size_t size) {
+    HashLongInput<Avx2Kernel>(accumulators, input, size);
+}
+#endif
+
+static Accumulators HashLongInput(const uint8_t* input, size_t size, Xxh3Kernel kernel) {
+    Accumulators accumulators = kInitialAccumulators;
+    switch (kernel) {
+#if defined(__x86_64__)
+        case Xxh3Kernel::kAvx2:
+            HashLongInputAvx2(accumulators, input, size);
+            break;
+        case Xxh3Kernel::kSse2:
+            HashLongInput<Sse2Kernel>(accumulators, input, size);
+            break;
+#endif
+        default:
+            HashLongInput<ScalarKernel>(accumulators, input, size);
+    }
+    return accumulators;
+}
+
+static uint64_t MergeAccumulators(const Accumulators& accumulators, const uint8_t* secret, uint64_t start) {
+    uint64_t result = start;
+    for (size_t i = 0; i < kAccumulatorCount; i += 2) {
+        result += Multiply128Fold64(accumulators.values[i] ^ Read64(secret + 8 * i),
+                                    accumulators.values[i + 1] ^ Read64(secret + 8 * i + 8));
+    }
+    return Avalanche(result);
+}
+
+static uint64_t Hash64UpTo16(const uint8_t* input, size_t size) {
+    if (size > 8) {
+        const uint64_t bitflip1 = Read64(kSecret + 24) ^ Read64(kSecret + 32);
+        const uint64_t bitflip2 = Read64(kSecret + 40) ^ Read64(kSecret + 48);
+        const uint64_t input_low = Read64(input) ^ bitflip1;
+        const uint64_t input_high = Read64(input + size - 8) ^ bitflip2;
+        return Avalanche(size + __builtin_bswap64(input_low) + input_high + Multiply128Fold64(input_low, input_high));
+    }
+    if (size >= 4) {
+        const uint64_t bitflip = Read64(kSecret + 8) ^ Read64(kSecret + 16);
+        const uint64_t input64 = Read32(input + size - 4) + (static_cast<uint64_t>(Read32(input)) << 32);
+        return StrongAvalanche(input64 ^ bitflip, size);
+    }
+    if (size > 0) {
+        const uint32_t combined = static_cast<uint32_t>(input[0]) << 16 | static_cast<uint32_t>(input[size >> 1]) << 24 |
+                                  input[size - 1] | static_cast<uint32_t>(size) << 8;
+        const uint64_t bitflip = Read32(kSecret) ^ Read32(kSecret + 4);
+        return Xxh64Avalanche(combined ^ bitflip);
+    }
+    return Xxh64Avalanche(Read64(kSecret + 56) ^ Read64(kSecret + 64));
+}
+
+static uint64_t Hash64UpTo128(const uint8_t* input, size_t size) {
+    uint64_t accumulator = size * kPrime64_1;
+    if (size > 32) {
+        if (size > 64) {
+            if (size > 96) {
+                accumulator += Mix16Bytes(input + 48, kSecret + 96, 0);
+                accumulator += Mix16Bytes(input + size - 64, kSecret + 112, 0);
+            }
+            accumulator += Mix16Bytes(input + 32, kSecret + 64, 0);
+            accumulator += Mix16Bytes(input + size - 48, kSecret + 80, 0);
+        }
+        accumulator += Mix16Bytes(input + 16, kSecret + 32, 0);
+        accumulator += Mix16Bytes(input + size - 32, kSecret + 48, 0);
+    }
+    accumulator += Mix16Bytes(input, kSecret, 0);
+    accumulator += Mix16Bytes(input + size - 16, kSecret + 16, 0);
+    return Avalanche(accumulator);
+}
+
+static uint64_t Hash64UpTo240(const uint8_t* input, size_t size) {
+    static constexpr size_t kStartOffset = 3;
+    static constexpr size_t kLastOffset = 17;
+    uint64_t accumulator = size * kPrime64_1;
+    const size_t round_count = size / 16;
+    for (size_t i = 0; i < 8; ++i) {
+        accumulator += Mix16Bytes(input + 16 * i, kSecret + 16 * i, 0);
+    }
+    accumulator = Avalanche(accumulator);
+    for (size_t i = 8; i < round_count; ++i) {
+        accumulator += Mix16Bytes(input + 16 * i, kSecret + 16 * (i - 8) + kStartOffset, 0);
+    }
+    accumulator += Mix16Bytes(input + size - 16, kSecret + kSecretSizeMin - kLastOffset, 0);
+    return Avalanche(accumulator);
+}
+
+static Xxh128Value Hash128UpTo16(const uint8_t* input, size_t size) {
+    if (size > 8) {
+        const uint64_t bitflip_low = Read64(kSecret + 32) ^ Read64(kSecret + 40);
+        const uint64_t bitflip_high = Read64(kSecret + 48) ^ Read64(kSecret + 56);
+        const uint64_t input_low = Read64(input);
+        uint64_t input_high = Read64(input + size - 8);
+        auto product = Multiply64To128(input_low ^ input_high ^ bitflip_low, kPrime64_1);
+        product.low += static_cast<uint64_t>(size - 1) << 54;
+        input_high ^= bitflip_high;
+        product.high += input_high + (input_high & 0xffffffff) * (kPrime32_2 - 1);
+        product.low ^= __builtin_bswap64(product.high);
+        auto result = Multiply64To128(product.low, kPrime64_2);
+        result.high += product.high * kPrime64_2;
+        return {Avalanche(result.low), Avalanche(result.high)};
+    }
+    if (size >= 4) {
+        const uint64_t input64 = Read32(input) + (static_cast<uint64_t>(Read32(input + size - 4)) << 32);
+        const uint64_t bitflip = Read64(kSecret + 16) ^ Read64(kSecret + 24);
+        auto product = Multiply64To128(input64 ^ bitflip, kPrime64_1 + (static_cast<uint64_t>(size) << 2));
+        product.high += product.low << 1;
+        product.low ^= product.high >> 3;
+        product.low ^= product.low >> 35;
+        product.low *= kPrimeMx2;
+        product.low ^= product.low >> 28;
+        return {product.low, Avalanche(product.high)};
+    }
+    if (size > 0) {
+        const uint32_t combined_low = static_cast<uint32_t>(input[0]) << 16 |
+                                      static_cast<uint32_t>(input[size >> 1]) << 24 | input[size - 1] |
+                                      static_cast<uint32_t>(size) << 8;
+        const uint32_t combined_high = RotateLeft32(__builtin_bswap32(combined_low), 13);
+        const uint64_t bitflip_low = Read32(kSecret) ^ Read32(kSecret + 4);
+        const uint64_t bitflip_high = Read32(kSecret + 8) ^ Read32(kSecret + 12);
+        return {Xxh64Avalanche(combined_low ^ bitflip_low), Xxh64Avalanche(combined_high ^ bitflip_high)};
+    }
+    return {Xxh64Avalanche(Read64(kSecret + 64) ^ Read64(kSecret + 72)),
+            Xxh64Avalanche(Read64(kSecret + 80) ^ Read64(kSecret + 88))};
+}
+
+static Xxh128Value FinalizeMid128(const Xxh128Value& accumulator, size_t size) {
+    return {Avalanche(accumulator.low + accumulator.high),
+            0 - Avalanche(accumulator.low * kPrime64_1 + accumulator.high * kPrime64_4 + size * kPrime64_2)};
+}
+
+static Xxh128Value Hash128UpTo128(const uint8_t* input, size_t size) {
+    Xxh128Value accumulator{size * kPrime64_1, 0};
+    if (size > 32) {
+        if (size > 64) {
+            if (size > 96) {
+                Mix32Bytes(accumulator, input + 48, input + size - 64, kSecret + 96, 0);
+            }
+            Mix32Bytes(accumulator, input + 32, input + size - 48, kSecret + 64, 0);
+        }
+        Mix32Bytes(accumulator, input + 16, input + size - 32, kSecret + 32, 0);
+    }
+    Mix32Bytes(accumulator, input, input + size - 16, kSecret, 0);
+    return FinalizeMid128(accumulator, size);
+}
+
+static Xxh128Value Hash128UpTo240(const uint8_t* input, size_t size) {
+    static constexpr size_t kStartOffset = 3;
+    static constexpr size_t kLastOffset = 17;
+    Xxh128Value accumulator{size * kPrime64_1, 0};
+    const size_t round_count = size / 32;
+    for (size_t i = 0; i < 4; ++i) {
+        Mix32Bytes(accumulator, input + 32 * i, input + 32 * i + 16, kSecret + 32 * i, 0);
+    }
+    accumulator = {Avalanche(accumulator.low), Avalanche(accumulator.high)};
+    for (size_t i = 4; i < round_count; ++i) {
+        Mix32Bytes(accumulator, input + 32 * i, input + 32 * i + 16, kSecret + kStartOffset + 32 * (i - 4), 0);
+    }
+    Mix32Bytes(accumulator, input + size - 16, input + size - 32, kSecret + kSecretSizeMin - kLastOffset - 16, 0);
+    return FinalizeMid128(accumulator, size);
+}
+
+static Xxh3Kernel GetBestXxh3Kernel() {
+#if defined(__x86_64__)
+    return GetCpuFeatures().avx2 ? Xxh3Kernel::kAvx2 : Xxh3Kernel::kSse2;
+#else
+    return Xxh3Kernel::kScalar;
+#endif
+}
+
+static const Xxh3Kernel kBestXxh3Kernel = GetBestXxh3Kernel();
+
+uint64_t Xxh3_64(const void* data, size_t size, Xxh3Kernel kernel) {
+    const auto* input = static_cast<const uint8_t*>(data);
+    if (size <= 16) {
+        return Hash64UpTo16(input, size);
+    }
+    if (size <= 128) {
+        return Hash64UpTo128(input, size);
+    }
+    if (size <= kMidSizeMax) {
+        return Hash64UpTo240(input, size);
+    }
+    const auto accumulators = HashLongInput(input, size, kernel);
+    return MergeAccumulators(accumulators, kSecret + kSecretMergeAccumulatorsStart, size * kPrime64_1);
+}
+
+uint64_t Xxh3_64(const void* data, size_t size) {
+    return Xxh3_64(data, size, kBestXxh3Kernel);
+}
+
+Xxh128Value Xxh3_128(const void* data, size_t size, Xxh3Kernel kernel) {
+    const auto* input = static_cast<const uint8_t*>(data);
+    if (size <= 16) {
+        return Hash128UpTo16(input, size);
+    }
+    if (size <= 128) {
+        return Hash128UpTo128(input, size);
+    }
+    if (size <= kMidSizeMax) {
+        return Hash128UpTo240(input, size);
+    }
+    const auto accumulators = HashLongInput(input, size, kernel);
+    return {MergeAccumulators(accumulators, kSecret + kSecretMergeAccumulatorsStart, size * kPrime64_1),
+            MergeAccumulators(accumulators, kSecret + kSecretSize - sizeof(Accumulators) - kSecretMergeAccumulatorsStart,
+                              ~(size * kPrime64_2))};
+}
+
+Xxh128Value Xxh3_128(const void* data, size_t size) {
+    return Xxh3_128(data, size, kBestXxh3Kernel);
+}